@@ -4,12 +4,64 @@
 -- g_app
 -- g_level
 -- g_camera
+-- g_render -- render settings, read and changed like fields, taking effect
+--     from the next frame:
+--     threads -- drawing columns, 1 to 64 (e.g. g_render.threads = 8)
+--     resolution -- {w, h} to draw at, at most 16384 a side, scaled up to
+--         the window, or nil for the window's size
+--     far_plane -- nothing further is drawn, 0 for the camera's
+--     fog, floor, textures -- booleans
 -- quit()
--- spawn_barrel()
+-- spawn_barrel() -- returns the new sprite's id
+-- remove_sprite(id) -- false if it's already gone
+-- add_wall(x1, y1, x2, y2, texture) -- returns the new wall's index
+--     Walls added this way are dynamic: they can be moved or switched off
+--     (e.g. doors, moving platforms). They can go past the level's other
+--     walls, but then the level's PVS (if it has one) isn't used anymore.
+--     Returns nil if the coordinates aren't finite or are too far away.
+-- move_wall(index, x1, y1, x2, y2) -- false if it isn't a dynamic wall or
+--     the new position is too far away, nil if it isn't finite
+-- set_wall_enabled(index, enabled) -- disabled walls are invisible and
+--     don't block. False if it isn't a dynamic wall, or it was moved too far
+--     away while disabled
+-- get_camera() -- x, y, angle
+-- raycast(x, y, angle, distance[, kinds[, texture]])
+--     Nearest hit along a ray. `kinds` is "walls", "sprites" or "any"
+--     (default). If `texture` is given, only sprites using it can be hit,
+--     so none if it isn't loaded.
+--     Returns nil, or kind ("wall"/"sprite"), distance, x, y, and the wall's
+--     index or sprite's id.
 -- load_level(filename)
+-- load_world(dir[, budget_mb]) -- stream a chunked world (see
+--     level_compiler --chunk-size) instead of a level, keeping at most
+--     budget_mb (default 64) of chunks loaded
+-- preload_level(filename) -- start loading in the background
+-- level_ready(filename) -- true once a preloaded level can be switched to
+-- switch_level(filename) -- switch as soon as the level is loaded
+-- set_shading_rates(enabled[, floor_2x1, floor_2x2, walls_2x1]) -- shade
+--     floor and ceiling past floor_2x1 units every other column, and past
+--     floor_2x2 every other row too; copy the walls of the column to the
+--     left when its nearest wall is past walls_2x1
+-- set_frame_pacing(mode[, fps]) -- "uncapped", "fixed" (fps frames a second,
+--     60 by default) or "power_saver" (at most 30, sleeping between frames).
+--     Resets the pacing stats.
+-- get_frame_pacing() -- frame time stats (see below), plus mode, target_fps,
+--     missed_deadlines and spin_margin_ms
+-- print_frame_pacing() -- the same, written to the console
+-- get_input_latency() -- stats of the time from key presses and releases to
+--     the frame showing them, plus late_latching
+-- print_input_latency() -- the same, written to the console
+-- set_late_latching(enabled) -- turn the camera by the keys held right
+--     before each frame is drawn. Resets the latency stats.
+-- print_render_settings() -- g_render's settings, written to the console
+--
+-- Stats are tables of samples, average_ms, p50_ms, p95_ms, p99_ms, worst_ms,
+-- and histogram, where histogram[i] counts samples from i - 1 to i ms (the
+-- last bucket also counts everything longer).
 --
 
--- This function is called by raycaster_app once per frame.
+-- This function is called by raycaster_app once per tick, 60 times a second
+-- whatever the frame rate.
 function update()
 	-- empty for now but could be anything...
 end
@@ -71,6 +71,25 @@ def parse_wall(obj):
     return walls
 
 
+def parse_sector(obj):
+    """Return the outline of a sector polygon as a list of {x, y} objects"""
+
+    origin_x = float(obj.get('x'))
+    origin_y = float(obj.get('y'))
+
+    for child in obj:
+        if child.tag == 'polygon':
+            points = parse_polyline(child)
+            for point in points:
+                point['x'] += origin_x
+                point['y'] += origin_y
+            return points
+
+    sys.stderr.write('Ignoring sector {} without a polygon\n'
+        .format(obj.get('id')))
+    return None
+
+
 def parse_sprite(sprite):
     """Go through object and pick out all sprite stuff"""
 
@@ -88,6 +107,7 @@ def parse_objectgroup(objectgroup):
     """Go through all objects and translate into desired format"""
     walls = []
     sprites = []
+    sectors = []
     player_start = None
 
     for obj in objectgroup:
@@ -99,8 +119,12 @@ def parse_objectgroup(objectgroup):
             player_start = {'x': float(obj.get('x')), 'y': float(obj.get('y'))}
         elif type_ == 'sprite':
             sprites.append(parse_sprite(obj))
+        elif type_ == 'sector':
+            sector = parse_sector(obj)
+            if sector:
+                sectors.append(sector)
 
-    return player_start, walls, sprites
+    return player_start, walls, sprites, sectors
 
 
 def main(argv):
@@ -126,13 +150,17 @@ def main(argv):
     player_start = None # 2-tuple: <x, y>
     walls = [] # List of 5-tuples: <x1, y1, x2, y2, texid>
     sprites = [] # List of 3-tuples: <x, y, texid> 
+    sectors = [] # List of outlines, each a list of <x, y>
+    map_props = {} # Optional textures/floor/ceiling
 
     # Find important layers
     sys.stderr.write('Finding layers...\n') # DEBUG
     for child in root:
-        if child.tag == 'objectgroup':
+        if child.tag == 'properties':
+            map_props = parse_properties(child)
+        elif child.tag == 'objectgroup':
             sys.stderr.write('Parsing objects...\n') # DEBUG
-            player_start, walls, sprites = parse_objectgroup(child)
+            player_start, walls, sprites, sectors = parse_objectgroup(child)
 
             # Only parse the first objectgroup... for now...
             continue
@@ -149,6 +177,11 @@ def main(argv):
         sprite['x'] /= tilewidth
         sprite['y'] /= tilewidth
 
+    for sector in sectors:
+        for point in sector:
+            point['x'] /= tilewidth
+            point['y'] /= tileheight
+
     player_start['x'] = player_start['x'] / tilewidth
     player_start['y'] = player_start['y'] / tileheight
 
@@ -157,6 +190,14 @@ def main(argv):
     sys.stderr.write('Writing to {}...\n'.format(lua_file))
     with open(lua_file, 'w') as out:
         out.write('return {\n')
+        if 'textures' in map_props:
+            # Comma separated file names; the first one is texid 1
+            names = [n.strip() for n in map_props['textures'].split(',')]
+            out.write('  textures = {{{}}},\n'.format(
+                ', '.join('"{}"'.format(n) for n in names)))
+        for key in ('floor', 'ceiling'):
+            if key in map_props:
+                out.write('  {} = "{}",\n'.format(key, map_props[key]))
         out.write('  player_start = {{x = {}, y = {}}},\n'
             .format(player_start['x'], player_start['y']))
         out.write('  walls = {\n')
@@ -171,6 +212,13 @@ def main(argv):
             out.write('    {{x = {}, y = {}, texid = {}}},\n'
                 .format(sprite['x'], sprite['y'], sprite['texid']))
         out.write('  },\n')
+        if sectors:
+            out.write('  sectors = {\n')
+            for sector in sectors:
+                out.write('    {{{}}},\n'.format(', '.join(
+                    '{{x = {}, y = {}}}'.format(p['x'], p['y'])
+                    for p in sector)))
+            out.write('  },\n')
         out.write('}\n')
 
     sys.stderr.write('Done!\n')
@@ -0,0 +1,36 @@
+/// Bundles textures, scripts and levels into one asset pack (see
+/// asset_pack.hpp) so the game can start from a single memory-mapped file.
+
+#include <sdl_application/asset_pack.hpp>
+
+#include <cstdio>
+#include <exception>
+#include <string>
+#include <vector>
+
+int main(int argc, char** argv)
+{
+    if (argc < 4) {
+        std::fprintf(stderr,
+            "Usage: %s output.pack assets_dir name...\n"
+            "Names are relative to assets_dir, e.g. wall.bmp lua/main.lua\n",
+            argv[0]);
+        return 1;
+    }
+
+    std::string const output = argv[1];
+    std::string const base_dir = argv[2];
+    std::vector<std::string> const names(argv + 3, argv + argc);
+
+    try {
+        sdl_app::write_asset_pack(output, base_dir, names);
+    } catch (std::exception const& e) {
+        std::fprintf(stderr, "Failed to write %s: %s\n", output.c_str(),
+            e.what());
+        return 1;
+    }
+
+    std::printf("Packed %u assets into %s\n",
+        static_cast<unsigned>(names.size()), output.c_str());
+    return 0;
+}
@@ -0,0 +1,204 @@
+/// Moves lots of bodies around random mazes of different sizes with
+/// move_and_slide() and reports the cost per move. The maze density is the
+/// same at every size, so the numbers should stay flat as the map grows. Also
+/// checks that no body ever ends up closer to a wall than its radius.
+///
+/// Each size is run again with sliding doors (dynamic walls) moving every
+/// step, which should cost the bodies about the same as the static map.
+
+#include <raycaster/collision.hpp>
+#include <raycaster/level.hpp>
+#include <raycaster/wall_grid.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace mymath;
+using namespace raycaster;
+
+namespace {
+
+constexpr auto body_radius = 0.2f;
+constexpr auto body_speed = 0.05f;
+/// Fraction of tile edges that have a wall
+constexpr auto wall_density = 0.3f;
+/// Allowed overlap, to absorb float error
+constexpr auto penetration_tolerance = 0.001f;
+/// Steps for a door to go from closed to open
+constexpr auto door_period = 50;
+
+struct body {
+    point2f position;
+    point2f velocity;
+};
+
+float distance_to_wall(point2f const& p, wall const& w)
+{
+    auto const d = w.data.end - w.data.start;
+    auto const m = p - w.data.start;
+    auto const len_sq = d.x * d.x + d.y * d.y;
+    auto const t = len_sq > 0.f
+        ? clamp((m.x * d.x + m.y * d.y) / len_sq, 0.f, 1.f)
+        : 0.f;
+    auto const closest = w.data.start + d * t;
+    return line2f{p, closest}.length();
+}
+
+/// A `size` x `size` tile map with a solid border and random inner walls on
+/// tile edges.
+std::vector<wall> make_maze(int size, std::mt19937& rng)
+{
+    std::uniform_real_distribution<float> chance{0.f, 1.f};
+    auto const extent = static_cast<float>(size);
+
+    std::vector<wall> walls;
+    walls.push_back(make_wall({{0.f, 0.f}, {extent, 0.f}}, 1));
+    walls.push_back(make_wall({{extent, 0.f}, {extent, extent}}, 1));
+    walls.push_back(make_wall({{extent, extent}, {0.f, extent}}, 1));
+    walls.push_back(make_wall({{0.f, extent}, {0.f, 0.f}}, 1));
+
+    for (auto y = 0; y < size; ++y) {
+        for (auto x = 0; x < size; ++x) {
+            auto const fx = static_cast<float>(x);
+            auto const fy = static_cast<float>(y);
+            if (x > 0 && chance(rng) < wall_density) {
+                walls.push_back(make_wall({{fx, fy}, {fx, fy + 1.f}}, 1));
+            }
+            if (y > 0 && chance(rng) < wall_density) {
+                walls.push_back(make_wall({{fx, fy}, {fx + 1.f, fy}}, 1));
+            }
+        }
+    }
+    return walls;
+}
+
+point2f random_velocity(std::mt19937& rng)
+{
+    std::uniform_real_distribution<float> angle{0.f, 2.f * M_PI};
+    auto const a = angle(rng);
+    return point2f{std::cos(a), std::sin(a)} * body_speed;
+}
+
+/// Door `i` slides along the tile edge starting at `origin`
+line2f door_line(point2f const& origin, int i, int step)
+{
+    // Triangle wave between closed and 90% open, so the door never
+    // degenerates to a point
+    auto const phase = (step + i) % (2 * door_period);
+    auto const open = 0.9f
+        * static_cast<float>(phase < door_period ? phase
+                                                 : 2 * door_period - phase)
+        / door_period;
+    return {{origin.x + open, origin.y}, {origin.x + 1.f, origin.y}};
+}
+
+void run(int map_size, int body_count, int steps, int door_count)
+{
+    std::mt19937 rng{1234};
+    level lvl;
+    lvl.walls = make_maze(map_size, rng);
+    lvl.grid = build_wall_grid(lvl.walls);
+    auto const& walls = lvl.walls;
+    auto const& grid = lvl.grid;
+
+    std::uniform_int_distribution<int> edge{1, map_size - 1};
+    std::vector<point2f> door_origins;
+    std::vector<std::size_t> doors;
+    for (auto i = 0; i < door_count; ++i) {
+        door_origins.push_back({static_cast<float>(edge(rng) - 1),
+            static_cast<float>(edge(rng))});
+        doors.push_back(
+            add_dynamic_wall(lvl, door_line(door_origins.back(), i, 0), 1));
+    }
+
+    // One body per tile, at most, starting in the middle
+    std::uniform_int_distribution<int> tile{0, map_size - 1};
+    std::vector<body> bodies;
+    for (auto i = 0; i < body_count; ++i) {
+        bodies.push_back({{tile(rng) + 0.5f, tile(rng) + 0.5f},
+            random_velocity(rng)});
+    }
+
+    collision_scratch scratch;
+    auto blocked = 0u;
+    auto door_time = 0.0;
+
+    auto const start = std::chrono::steady_clock::now();
+    for (auto step = 0; step < steps; ++step) {
+        auto const doors_start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < doors.size(); ++i) {
+            move_dynamic_wall(lvl, doors[i],
+                door_line(door_origins[i], static_cast<int>(i), step));
+        }
+        door_time += std::chrono::duration<double, std::nano>(
+            std::chrono::steady_clock::now() - doors_start)
+                         .count();
+
+        for (auto& b : bodies) {
+            auto const target = b.position + b.velocity;
+            b.position = move_and_slide(
+                walls, grid, b.position, b.velocity, body_radius, scratch);
+            if (!(b.position == target)) {
+                // Bounce off in a new direction
+                b.velocity = random_velocity(rng);
+                ++blocked;
+            }
+        }
+    }
+    auto const elapsed = std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - start)
+                             .count()
+        - door_time;
+
+    // Validate the final positions against every nearby wall. Doors can slide
+    // into a body that's standing still, so only static walls count.
+    auto penetrations = 0u;
+    for (auto const& b : bodies) {
+        grid.query(rectangle2<float>{{b.position.x - 1.f, b.position.y - 1.f},
+                       {b.position.x + 1.f, b.position.y + 1.f}},
+            scratch.nearby_walls);
+        for (auto const index : scratch.nearby_walls) {
+            if (is_dynamic_wall(lvl, index)) {
+                continue;
+            }
+            if (distance_to_wall(b.position, walls[index])
+                < body_radius - penetration_tolerance) {
+                ++penetrations;
+            }
+        }
+    }
+
+    auto const moves = static_cast<double>(body_count) * steps;
+    auto const door_moves = static_cast<double>(door_count) * steps;
+    std::printf("%5dx%-5d %8u walls %6dx%-4d cells %5d doors  %8.1f ns/move  "
+                "%6.1f ns/door  %5.1f%% blocked  %u penetrations\n",
+        map_size, map_size, static_cast<unsigned>(walls.size()), grid.width,
+        grid.height, door_count, elapsed / moves,
+        door_count > 0 ? door_time / door_moves : 0.0,
+        100.0 * blocked / moves, penetrations);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    auto const body_count = argc > 1 ? std::atoi(argv[1]) : 10000;
+    auto const steps = argc > 2 ? std::atoi(argv[2]) : 200;
+    auto const door_count = argc > 3 ? std::atoi(argv[3]) : 500;
+    if (body_count <= 0 || steps <= 0 || door_count < 0) {
+        std::fprintf(stderr, "Usage: %s [bodies] [steps] [doors]\n", argv[0]);
+        return 1;
+    }
+
+    std::printf("%d bodies, %d steps, radius %.2f\n", body_count, steps,
+        body_radius);
+    for (auto const size : {32, 128, 512, 2048}) {
+        run(size, body_count, steps, 0);
+        run(size, body_count, steps, door_count);
+    }
+    return 0;
+}
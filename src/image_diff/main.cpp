@@ -0,0 +1,129 @@
+/// Compares two images of the same size, e.g. screenshots of the same view
+/// with and without variable-rate shading, and prints how far apart they
+/// are. Optionally writes an image of the differences, amplified so small
+/// ones show up.
+
+#include <sdl_raii/sdl_raii.hpp>
+
+#include <SDL.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+/// Pixels with a channel off by more than this count as visibly different
+constexpr auto visible_difference = 16;
+/// Differences are multiplied by this in the diff image
+constexpr auto diff_gain = 4;
+
+/// @return The image at `path` as ARGB8888
+sdl::surface load(char const* path)
+{
+    auto const loaded = SDL_LoadBMP(path);
+    if (!loaded) {
+        throw std::runtime_error{
+            std::string{"Couldn't load "} + path + ": " + SDL_GetError()};
+    }
+    // Freed once it's converted
+    auto const owned = sdl::make_surface(loaded);
+    return sdl::make_surface(
+        SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_ARGB8888, 0));
+}
+
+std::uint32_t get_pixel(SDL_Surface const& surf, int x, int y)
+{
+    std::uint32_t pixel;
+    std::memcpy(&pixel,
+        static_cast<std::uint8_t const*>(surf.pixels) + y * surf.pitch + x * 4,
+        4);
+    return pixel;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if (argc != 3 && argc != 4) {
+        std::fprintf(stderr, "Usage: %s a.bmp b.bmp [diff.bmp]\n", argv[0]);
+        return 1;
+    }
+
+    try {
+        auto const a = load(argv[1]);
+        auto const b = load(argv[2]);
+        if (a->w != b->w || a->h != b->h) {
+            throw std::runtime_error{"The images aren't the same size"};
+        }
+
+        sdl::surface diff;
+        if (argc == 4) {
+            diff = sdl::make_surface(SDL_CreateRGBSurfaceWithFormat(
+                0, a->w, a->h, 32, SDL_PIXELFORMAT_ARGB8888));
+        }
+
+        double total_abs = 0.;
+        double total_squared = 0.;
+        auto max_difference = 0;
+        long different_pixels = 0;
+        long visibly_different_pixels = 0;
+        for (auto y = 0; y < a->h; ++y) {
+            for (auto x = 0; x < a->w; ++x) {
+                auto const pa = get_pixel(*a, x, y);
+                auto const pb = get_pixel(*b, x, y);
+                auto pixel_max = 0;
+                std::uint32_t diff_pixel = 0xFF000000u;
+                for (auto shift = 0; shift < 24; shift += 8) {
+                    auto const ca = static_cast<int>((pa >> shift) & 0xFF);
+                    auto const cb = static_cast<int>((pb >> shift) & 0xFF);
+                    auto const d = std::abs(ca - cb);
+                    total_abs += d;
+                    total_squared += d * d;
+                    pixel_max = std::max(pixel_max, d);
+                    diff_pixel |= static_cast<std::uint32_t>(
+                                      std::min(d * diff_gain, 255))
+                        << shift;
+                }
+                max_difference = std::max(max_difference, pixel_max);
+                different_pixels += pixel_max > 0;
+                visibly_different_pixels += pixel_max > visible_difference;
+                if (diff) {
+                    std::memcpy(static_cast<std::uint8_t*>(diff->pixels)
+                            + y * diff->pitch + x * 4,
+                        &diff_pixel, 4);
+                }
+            }
+        }
+
+        auto const pixels = static_cast<double>(a->w) * a->h;
+        auto const samples = pixels * 3;
+        auto const rmse = std::sqrt(total_squared / samples);
+        std::printf("%dx%d pixels\n", a->w, a->h);
+        std::printf("mean abs error %.3f, rmse %.3f, max %d (per channel)\n",
+            total_abs / samples, rmse, max_difference);
+        if (rmse > 0.) {
+            std::printf("psnr %.2f dB\n", 20. * std::log10(255. / rmse));
+        } else {
+            std::printf("psnr inf (identical)\n");
+        }
+        std::printf("%.3f%% of pixels differ, %.3f%% by more than %d\n",
+            100. * different_pixels / pixels,
+            100. * visibly_different_pixels / pixels, visible_difference);
+
+        if (diff && SDL_SaveBMP(diff.get(), argv[3]) != 0) {
+            throw std::runtime_error{std::string{"Couldn't save "} + argv[3]
+                + ": " + SDL_GetError()};
+        }
+    } catch (std::exception const& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,283 @@
+/// Compiles level scripts (the `.tmx.lua` files made by tmx2lua.py) into the
+/// binary format from level_binary.hpp, so the game can load them without
+/// running Lua. With `--pvs`, it also precomputes the level's potentially
+/// visible sets (see pvs.hpp). With `--chunk-size`, it splits the level into
+/// chunks for world_streamer instead.
+
+#include <raycaster/level.hpp>
+#include <raycaster/level_binary.hpp>
+#include <raycaster/pvs.hpp>
+#include <raycaster/world_streamer.hpp>
+
+#include <lua_raii/lua_raii.hpp>
+#include <sdl_application/asset_store.hpp>
+#include <sdl_application/thread_pool.hpp>
+
+#include <SDL.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace mymath;
+using namespace raycaster;
+
+namespace {
+
+bool ends_with(std::string const& str, std::string const& suffix)
+{
+    return str.size() >= suffix.size()
+        && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+/// `foo.tmx.lua` -> `foo.rclv`
+std::string default_output(std::string input)
+{
+    for (auto const suffix : {".lua", ".tmx"}) {
+        if (ends_with(input, suffix)) {
+            input.erase(input.size() - std::string{suffix}.size());
+        }
+    }
+    return input + level_binary_extension;
+}
+
+/// Whether a texture has no magenta (transparent) texels, so walls using it
+/// block the view. Textures that can't be loaded count as transparent.
+bool is_opaque_texture(std::string const& path)
+{
+    sdl::surface surf;
+    try {
+        surf = sdl_app::load_image(path);
+    } catch (std::exception const& e) {
+        std::fprintf(stderr, "Treating %s as transparent: %s\n",
+            path.c_str(), e.what());
+        return false;
+    }
+
+    // BGR24, and magenta reads the same either way round
+    auto const pixels = static_cast<Uint8 const*>(surf->pixels);
+    for (auto y = 0; y < surf->h; ++y) {
+        auto const row = pixels + y * surf->pitch;
+        for (auto x = 0; x < surf->w; ++x) {
+            auto const texel = row + x * 3;
+            if (texel[0] == 255 && texel[1] == 0 && texel[2] == 255) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void build_level_pvs(level& lvl, std::string const& assets_dir)
+{
+    std::vector<bool> opaque(lvl.texture_names.size(), false);
+    for (std::size_t i = 0; i < opaque.size(); ++i) {
+        if (!lvl.texture_names[i].empty()) {
+            opaque[i]
+                = is_opaque_texture(assets_dir + "/" + lvl.texture_names[i]);
+        }
+    }
+
+    sdl_app::thread_pool pool;
+    auto const start = std::chrono::steady_clock::now();
+    lvl.pvs = build_pvs(lvl, opaque, pool);
+    auto const elapsed = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start);
+
+    // Average share of walls and cells left after culling
+    auto const cell_count = lvl.grid.cell_count();
+    double walls = 0.;
+    double cells = 0.;
+    pvs_bits bits;
+    for (auto cell = 0; cell < cell_count; ++cell) {
+        lvl.pvs.get_walls(cell, bits);
+        walls += static_cast<double>(bits.count());
+        lvl.pvs.get_cells(cell, bits);
+        cells += static_cast<double>(bits.count());
+    }
+    auto const percent = [cell_count](double visible, double total) {
+        return total > 0. ? 100. * visible / (total * cell_count) : 100.;
+    };
+
+    std::printf("PVS: %.2f s on %u threads, %.1f%% of walls and %.1f%% of "
+                "cells visible per cell on average, %u bytes\n",
+        elapsed.count(), pool.size(),
+        percent(walls, static_cast<double>(lvl.pvs.wall_count)),
+        percent(cells, static_cast<double>(cell_count)),
+        static_cast<unsigned>(lvl.pvs.wall_runs.size()
+            + lvl.pvs.cell_runs.size()
+            + 4 * (lvl.pvs.wall_offsets.size() + lvl.pvs.cell_offsets.size())));
+}
+
+/// Split `lvl` into square chunks of `chunk_size` units and write the ones
+/// with anything in them to `dir`, along with the world.lua that describes
+/// them. Walls crossing chunk boundaries are cut in pieces.
+///
+/// @return The number of chunk files written
+std::size_t write_chunks(
+    level const& lvl, float chunk_size, std::string const& dir)
+{
+    auto const chunk_of = [chunk_size](point2f const& p) {
+        return chunk_coord{static_cast<int>(std::floor(p.x / chunk_size)),
+            static_cast<int>(std::floor(p.y / chunk_size))};
+    };
+
+    std::map<std::pair<int, int>, level> chunks;
+    auto const get_chunk = [&](chunk_coord c) -> level& {
+        auto& chunk = chunks[{c.x, c.y}];
+        if (chunk.texture_names.empty()) {
+            chunk.texture_names = lvl.texture_names;
+            chunk.floor_texture = lvl.floor_texture;
+            chunk.ceiling_texture = lvl.ceiling_texture;
+            chunk.player_start = lvl.player_start;
+        }
+        return chunk;
+    };
+
+    for (auto const& w : lvl.walls) {
+        auto const bb = w.data.get_bounding_box();
+        auto const lo = chunk_of(bb.tl);
+        auto const hi = chunk_of(bb.br);
+        for (auto cy = lo.y; cy <= hi.y; ++cy) {
+            for (auto cx = lo.x; cx <= hi.x; ++cx) {
+                // A one cell grid is a handy box to clip against
+                wall_grid box;
+                box.origin = point2f{cx * chunk_size, cy * chunk_size};
+                box.cell_size = chunk_size;
+                box.width = 1;
+                box.height = 1;
+                auto t0 = 0.f;
+                auto t1 = 1.f;
+                if (!box.clip(w.data, t0, t1)
+                    || (t1 - t0) * w.length < 0.0001f) {
+                    continue;
+                }
+
+                auto const along = displacement(w.data.start, w.data.end);
+                auto const piece = line2f{
+                    w.data.start + along * t0, w.data.start + along * t1};
+                // Pieces along a chunk boundary only go to one side
+                if (chunk_of(linear_interpolate(piece, 0.5f))
+                    != chunk_coord{cx, cy}) {
+                    continue;
+                }
+                get_chunk({cx, cy}).walls.push_back(
+                    make_wall(piece, w.texture));
+            }
+        }
+    }
+
+    auto const& positions = lvl.sprites.get_positions();
+    for (std::size_t i = 0; i < positions.size(); ++i) {
+        get_chunk(chunk_of(positions[i]))
+            .sprites.spawn(positions[i], lvl.sprites.get_textures()[i],
+                lvl.sprites.get_states()[i]);
+    }
+
+    for (auto& entry : chunks) {
+        auto& chunk = entry.second;
+        chunk.grid = build_wall_grid(chunk.walls);
+        save_level_binary(chunk,
+            chunk_filename(dir, {entry.first.first, entry.first.second}));
+    }
+
+    auto const manifest_name = dir + "/world.lua";
+    auto manifest = std::fopen(manifest_name.c_str(), "w");
+    if (!manifest) {
+        throw std::runtime_error{"Couldn't open for writing: " + manifest_name};
+    }
+    std::fprintf(manifest,
+        "return {\n"
+        "  chunk_size = %.9g,\n"
+        "  player_start = {x = %.9g, y = %.9g},\n"
+        "}\n",
+        chunk_size, lvl.player_start.x, lvl.player_start.y);
+    if (std::fclose(manifest) != 0) {
+        throw std::runtime_error{"Failed writing " + manifest_name};
+    }
+
+    return chunks.size();
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    std::string assets_dir;
+    auto chunk_size = 0.f;
+    std::vector<std::string> args;
+    for (auto i = 1; i < argc; ++i) {
+        if (std::string{argv[i]} == "--pvs" && i + 1 < argc) {
+            assets_dir = argv[++i];
+        } else if (std::string{argv[i]} == "--chunk-size" && i + 1 < argc) {
+            chunk_size = static_cast<float>(std::atof(argv[++i]));
+            if (!(chunk_size > 0.f)) {
+                std::fprintf(stderr, "Bad chunk size: %s\n", argv[i]);
+                return 1;
+            }
+        } else {
+            args.emplace_back(argv[i]);
+        }
+    }
+
+    // The PVS is per grid cell, and chunks each have their own grid
+    if (args.empty() || args.size() > 2
+        || (chunk_size > 0.f && (args.size() != 2 || !assets_dir.empty()))) {
+        std::fprintf(stderr,
+            "Usage: %s [--pvs assets_dir] level.tmx.lua [output%s]\n"
+            "       %s --chunk-size size level.tmx.lua output_dir\n",
+            argv[0], level_binary_extension, argv[0]);
+        return 1;
+    }
+
+    auto const& input = args[0];
+    auto const output = args.size() == 2 ? args[1] : default_output(input);
+
+    if (ends_with(input, ".tmx")) {
+        std::fprintf(stderr,
+            "%s is a Tiled map; convert it with "
+            "dev_assets/levels/tmx2lua.py first\n",
+            input.c_str());
+        return 1;
+    }
+
+    try {
+        auto L = lua::make_state();
+        auto const lvl = load_level_lua(input, L.get());
+        if (chunk_size > 0.f) {
+            auto const written = write_chunks(*lvl, chunk_size, output);
+            std::printf("%s -> %s: %u walls, %u sprites in %u chunks of %g "
+                        "units\n",
+                input.c_str(), output.c_str(),
+                static_cast<unsigned>(lvl->walls.size()),
+                static_cast<unsigned>(lvl->sprites.size()),
+                static_cast<unsigned>(written), chunk_size);
+            return 0;
+        }
+        if (!assets_dir.empty()) {
+            build_level_pvs(*lvl, assets_dir);
+        }
+        save_level_binary(*lvl, output);
+
+        std::printf("%s -> %s: %u walls, %u sprites, %u sectors, %dx%d grid "
+                    "(cell size %g, %u entries)\n",
+            input.c_str(), output.c_str(),
+            static_cast<unsigned>(lvl->walls.size()),
+            static_cast<unsigned>(lvl->sprites.size()), lvl->sectors.size(),
+            lvl->grid.width, lvl->grid.height, lvl->grid.cell_size,
+            static_cast<unsigned>(lvl->grid.wall_indices.size()));
+    } catch (std::exception const& e) {
+        std::fprintf(stderr, "Failed to compile %s: %s\n", input.c_str(),
+            e.what());
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,259 @@
+#pragma once
+
+#include <mycolor/mycolor.hpp>
+
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MYCOLOR_HAS_SSE2 1
+#endif
+
+namespace mycolor {
+
+/// A color packed into one 32-bit word as 0xAARRGGBB.
+///
+/// That's the layout of SDL_PIXELFORMAT_ARGB8888 and SDL_PIXELFORMAT_RGB888
+/// (XRGB8888), so a framebuffer pixel in either format is one load or store.
+/// The operations below work on all four channels at once by treating the
+/// word as two 16-bit lanes (R_B_ and A_G_), with each channel's product
+/// getting 8 bits of headroom in its lane (SWAR).
+struct packed_color {
+    std::uint32_t value;
+};
+
+constexpr bool operator==(packed_color const& lhs, packed_color const& rhs)
+{
+    return lhs.value == rhs.value;
+}
+
+constexpr bool operator!=(packed_color const& lhs, packed_color const& rhs)
+{
+    return lhs.value != rhs.value;
+}
+
+constexpr packed_color pack(color const& c, std::uint8_t alpha = 255)
+{
+    return {static_cast<std::uint32_t>(alpha) << 24
+        | static_cast<std::uint32_t>(c.r) << 16
+        | static_cast<std::uint32_t>(c.g) << 8 | c.b};
+}
+
+constexpr color unpack(packed_color const& c)
+{
+    return {static_cast<std::uint8_t>(c.value >> 16),
+        static_cast<std::uint8_t>(c.value >> 8),
+        static_cast<std::uint8_t>(c.value)};
+}
+
+constexpr std::uint8_t alpha(packed_color const& c)
+{
+    return static_cast<std::uint8_t>(c.value >> 24);
+}
+
+/// True if the RGB part matches, ignoring alpha.
+constexpr bool same_rgb(packed_color const& lhs, packed_color const& rhs)
+{
+    return ((lhs.value ^ rhs.value) & 0x00FFFFFFu) == 0;
+}
+
+/// Interpolation weights are 8.8 fixed point: 0 is all `a`, 256 all `b`.
+constexpr std::uint32_t weight_one = 256;
+
+/// Convert a [0, 1] factor to a weight (clamped).
+constexpr std::uint32_t to_weight(float t)
+{
+    return static_cast<std::uint32_t>(
+        std::max(std::min(t, 1.f), 0.f) * weight_one + 0.5f);
+}
+
+/// Convert a 0-255 light level to a weight, mapping 255 to exactly 256 so
+/// full light leaves colors untouched.
+constexpr std::uint32_t light_to_weight(std::uint8_t light)
+{
+    return light + (light >> 7);
+}
+
+namespace detail {
+constexpr std::uint32_t lane_mask = 0x00FF00FFu;
+} // namespace detail
+
+/// Scale all four channels by `weight` / 256.
+constexpr packed_color scale(packed_color const& c, std::uint32_t weight)
+{
+    auto const rb = (((c.value & detail::lane_mask) * weight) >> 8)
+        & detail::lane_mask;
+    auto const ag
+        = (((c.value >> 8) & detail::lane_mask) * weight) & ~detail::lane_mask;
+    return {rb | ag};
+}
+
+/// Blend from `a` (weight 0) to `b` (weight 256). Each lane holds at most
+/// 255 * 256, so the two products never carry into each other.
+constexpr packed_color linear_interpolate(
+    packed_color const& a, packed_color const& b, std::uint32_t weight)
+{
+    auto const rb = (((a.value & detail::lane_mask) * (weight_one - weight)
+                         + (b.value & detail::lane_mask) * weight)
+                        >> 8)
+        & detail::lane_mask;
+    auto const ag
+        = (((a.value >> 8) & detail::lane_mask) * (weight_one - weight)
+              + ((b.value >> 8) & detail::lane_mask) * weight)
+        & ~detail::lane_mask;
+    return {rb | ag};
+}
+
+/// Darken by a 0-255 light level (255 leaves the color as is, 0 is black).
+/// Alpha is scaled too.
+constexpr packed_color shade(packed_color const& c, std::uint8_t light)
+{
+    return scale(c, light_to_weight(light));
+}
+
+/// Per-channel saturating add, all four channels at once.
+constexpr packed_color add(packed_color const& a, packed_color const& b)
+{
+    // Add the low 7 bits of each byte so nothing carries across bytes, then
+    // put the top bits back in by hand
+    auto const low = (a.value & 0x7F7F7F7Fu) + (b.value & 0x7F7F7F7Fu);
+    auto const sum = low ^ ((a.value ^ b.value) & 0x80808080u);
+    // A byte overflowed if both top bits were set, or one was and the low
+    // bits carried into it
+    auto const overflow
+        = ((a.value & b.value) | ((a.value | b.value) & ~sum)) & 0x80808080u;
+    // 0x80 -> 0xFF for every overflowed byte
+    auto const saturate = (overflow << 1) - (overflow >> 7);
+    return {sum | saturate};
+}
+
+/// Per-channel multiply (`a * b / 255`, rounded), e.g. for tinting.
+constexpr packed_color multiply(packed_color const& a, packed_color const& b)
+{
+    // The products need a full 16 bits each, so there's no room to do two
+    // channels per multiply here
+    std::uint32_t result = 0;
+    for (auto shift = 0; shift < 32; shift += 8) {
+        auto const x
+            = ((a.value >> shift) & 0xFFu) * ((b.value >> shift) & 0xFFu) + 128;
+        result |= (((x + (x >> 8)) >> 8) & 0xFFu) << shift;
+    }
+    return {result};
+}
+
+//
+// batches
+//
+
+#if defined(MYCOLOR_HAS_SSE2)
+namespace detail {
+
+/// Weights for pixels `i` and `i + 1`, repeated for each of their channels.
+inline __m128i pair_weights(std::uint16_t const* weights, int i)
+{
+    return _mm_set_epi16(weights[i + 1], weights[i + 1], weights[i + 1],
+        weights[i + 1], weights[i], weights[i], weights[i], weights[i]);
+}
+
+/// lerp of 4 pixels with 16 bits per channel: widen, multiply-add, narrow.
+inline __m128i lerp4(__m128i a, __m128i b, std::uint16_t const* weights)
+{
+    auto const zero = _mm_setzero_si128();
+    auto const one = _mm_set1_epi16(weight_one);
+
+    auto const w_lo = pair_weights(weights, 0);
+    auto const w_hi = pair_weights(weights, 2);
+
+    auto const lo = _mm_srli_epi16(
+        _mm_add_epi16(
+            _mm_mullo_epi16(
+                _mm_unpacklo_epi8(a, zero), _mm_sub_epi16(one, w_lo)),
+            _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), w_lo)),
+        8);
+    auto const hi = _mm_srli_epi16(
+        _mm_add_epi16(
+            _mm_mullo_epi16(
+                _mm_unpackhi_epi8(a, zero), _mm_sub_epi16(one, w_hi)),
+            _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), w_hi)),
+        8);
+    return _mm_packus_epi16(lo, hi);
+}
+
+} // namespace detail
+#endif
+
+/// linear_interpolate() on 4 pixels at once, with a weight per pixel.
+/// Gives the same results as the single pixel version. `out` may alias `a` or
+/// `b`.
+inline void linear_interpolate4(packed_color const* a, packed_color const* b,
+    std::uint16_t const* weights, packed_color* out)
+{
+#if defined(MYCOLOR_HAS_SSE2)
+    auto const va = _mm_loadu_si128(reinterpret_cast<__m128i const*>(a));
+    auto const vb = _mm_loadu_si128(reinterpret_cast<__m128i const*>(b));
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i*>(out), detail::lerp4(va, vb, weights));
+#else
+    for (auto i = 0; i < 4; ++i) {
+        out[i] = linear_interpolate(a[i], b[i], weights[i]);
+    }
+#endif
+}
+
+/// linear_interpolate4() on 8 pixels. The build doesn't enable AVX2, so this
+/// is two 4 pixel batches, which still keeps both SSE2 pipes busy.
+inline void linear_interpolate8(packed_color const* a, packed_color const* b,
+    std::uint16_t const* weights, packed_color* out)
+{
+    linear_interpolate4(a, b, weights, out);
+    linear_interpolate4(a + 4, b + 4, weights + 4, out + 4);
+}
+
+/// shade() on 4 pixels at once, with a light level per pixel. `out` may
+/// alias `pixels`.
+inline void shade4(
+    packed_color const* pixels, std::uint8_t const* light, packed_color* out)
+{
+    std::uint16_t weights[4];
+    packed_color const black[4] = {};
+    for (auto i = 0; i < 4; ++i) {
+        // Shading is a blend towards black
+        weights[i] = static_cast<std::uint16_t>(
+            weight_one - light_to_weight(light[i]));
+    }
+    linear_interpolate4(pixels, black, weights, out);
+}
+
+/// shade4() on 8 pixels.
+inline void shade8(
+    packed_color const* pixels, std::uint8_t const* light, packed_color* out)
+{
+    shade4(pixels, light, out);
+    shade4(pixels + 4, light + 4, out + 4);
+}
+
+/// add() on 4 pixels at once. `out` may alias `a` or `b`.
+inline void add4(
+    packed_color const* a, packed_color const* b, packed_color* out)
+{
+#if defined(MYCOLOR_HAS_SSE2)
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out),
+        _mm_adds_epu8(_mm_loadu_si128(reinterpret_cast<__m128i const*>(a)),
+            _mm_loadu_si128(reinterpret_cast<__m128i const*>(b))));
+#else
+    for (auto i = 0; i < 4; ++i) {
+        out[i] = add(a[i], b[i]);
+    }
+#endif
+}
+
+/// add4() on 8 pixels.
+inline void add8(
+    packed_color const* a, packed_color const* b, packed_color* out)
+{
+    add4(a, b, out);
+    add4(a + 4, b + 4, out + 4);
+}
+
+} // namespace mycolor
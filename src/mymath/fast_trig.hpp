@@ -0,0 +1,103 @@
+#pragma once
+
+#include <mymath/vec2.hpp>
+
+#include <cmath>
+
+namespace mymath {
+
+/// Sine and cosine of `radians` at once, without calling into libm.
+///
+/// The angle is reduced to [-pi/4, pi/4] around the nearest multiple of pi/2
+/// and evaluated with short Taylor polynomials (degree 7 for sine, 8 for
+/// cosine). For |radians| <= 10 the absolute error is below 4e-7, about the
+/// same as rounding the result to float. Past that the float range reduction
+/// dominates and the error grows with the angle (roughly 4e-6 at 100, 3e-5 at
+/// 1000), so keep angles wrapped.
+inline void fast_sincos(float radians, float& sin_out, float& cos_out)
+{
+    constexpr float two_over_pi = 0.636619772f;
+    // pi/2 split in two so `quadrant * pi/2` loses less precision
+    constexpr float pi_over_2_hi = 1.57079601f;
+    constexpr float pi_over_2_lo = 3.13916473e-07f;
+
+    // Round to nearest with a plain conversion; std::nearbyint() is a libm
+    // call on baseline x86-64
+    auto const scaled = radians * two_over_pi;
+    auto const q = static_cast<int>(scaled + (scaled < 0.f ? -0.5f : 0.5f));
+    auto const quadrant = static_cast<float>(q);
+    auto const r
+        = (radians - quadrant * pi_over_2_hi) - quadrant * pi_over_2_lo;
+    auto const r2 = r * r;
+
+    auto const s = r
+        * (1.f
+            + r2
+                * (-1.f / 6.f
+                    + r2 * (1.f / 120.f + r2 * (-1.f / 5040.f))));
+    auto const c = 1.f
+        + r2
+            * (-0.5f
+                + r2
+                    * (1.f / 24.f
+                        + r2 * (-1.f / 720.f + r2 * (1.f / 40320.f))));
+
+    // Rotate by the quadrant without branches, so loops can vectorize
+    auto const odd = (q & 1) != 0;
+    sin_out = (odd ? c : s) * ((q & 2) ? -1.f : 1.f);
+    cos_out = (odd ? s : c) * (((q + 1) & 2) ? -1.f : 1.f);
+}
+
+/// The unit vector pointing at `radians` (counter-clockwise from +x).
+/// Same accuracy as fast_sincos().
+inline vec2f unit_vector(float radians)
+{
+    auto s = 0.f;
+    auto c = 0.f;
+    fast_sincos(radians, s, c);
+    return {c, s};
+}
+
+/// atan2 without calling into libm. Same conventions as `std::atan2`: the
+/// result is in [-pi, pi], the sign follows `y` (including -0) and
+/// `fast_atan2(0, 0)` is 0.
+///
+/// Uses a degree 11 odd polynomial for atan on [0, 1] (Hastings) and octant
+/// symmetry for the rest. Absolute error is below 2e-6 radians everywhere.
+inline float fast_atan2(float y, float x)
+{
+    constexpr float pi = 3.14159265f;
+    constexpr float pi_over_2 = 1.57079633f;
+
+    auto const ax = std::abs(x);
+    auto const ay = std::abs(y);
+    auto const hi = ax > ay ? ax : ay;
+    if (hi == 0.f) {
+        return 0.f;
+    }
+    auto const lo = ax > ay ? ay : ax;
+
+    auto const z = lo / hi;
+    auto const z2 = z * z;
+    auto a = z
+        * (0.99997726f
+            + z2
+                * (-0.33262347f
+                    + z2
+                        * (0.19354346f
+                            + z2
+                                * (-0.11643287f
+                                    + z2
+                                        * (0.05265332f
+                                            + z2 * -0.01172120f)))));
+
+    if (ay > ax) {
+        a = pi_over_2 - a;
+    }
+    if (x < 0.f) {
+        a = pi - a;
+    }
+    return std::signbit(y) ? -a : a;
+}
+
+} // namespace mymath
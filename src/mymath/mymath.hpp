@@ -1,4 +1,6 @@
 #pragma once
 
 #include <mymath/cartesian.hpp>
+#include <mymath/fast_trig.hpp>
 #include <mymath/linear_algebra.hpp>
+#include <mymath/vec2.hpp>
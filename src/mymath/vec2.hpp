@@ -0,0 +1,146 @@
+#pragma once
+
+#include <mymath/cartesian.hpp>
+
+#include <cmath>
+#include <type_traits>
+
+namespace mymath {
+
+//
+// vec2
+//
+
+/// A Cartesian 2D vector. Unlike the polar `vector2`, adding one to a point
+/// needs no trig, so this is the one to use in the renderer's inner loops.
+///
+/// Two packed components and nothing else: arrays of vec2 are contiguous x/y
+/// pairs the compiler can load 2 (or 4) at a time.
+template <typename T> struct alignas(2 * sizeof(T)) vec2 {
+    static_assert(std::is_floating_point<T>::value, "vec2 requires fp type.");
+
+    T x;
+    T y;
+
+    vec2<T>& operator+=(vec2<T> const& rhs)
+    {
+        x += rhs.x;
+        y += rhs.y;
+        return *this;
+    }
+
+    vec2<T>& operator-=(vec2<T> const& rhs)
+    {
+        x -= rhs.x;
+        y -= rhs.y;
+        return *this;
+    }
+
+    vec2<T>& operator*=(T rhs)
+    {
+        x *= rhs;
+        y *= rhs;
+        return *this;
+    }
+};
+
+using vec2f = vec2<float>;
+
+static_assert(sizeof(vec2f) == 2 * sizeof(float), "vec2f must stay packed");
+static_assert(std::is_trivially_copyable<vec2f>::value,
+    "vec2f must stay trivially copyable");
+
+//
+// vec2 operations
+//
+
+template <typename T> vec2<T> operator+(vec2<T> lhs, vec2<T> const& rhs)
+{
+    lhs += rhs;
+    return lhs;
+}
+
+template <typename T> vec2<T> operator-(vec2<T> lhs, vec2<T> const& rhs)
+{
+    lhs -= rhs;
+    return lhs;
+}
+
+template <typename T> vec2<T> operator-(vec2<T> const& v)
+{
+    return {-v.x, -v.y};
+}
+
+template <typename T> vec2<T> operator*(vec2<T> lhs, T rhs)
+{
+    lhs *= rhs;
+    return lhs;
+}
+
+template <typename T> vec2<T> operator*(T lhs, vec2<T> rhs)
+{
+    rhs *= lhs;
+    return rhs;
+}
+
+template <typename T> T dot(vec2<T> const& a, vec2<T> const& b)
+{
+    return a.x * b.x + a.y * b.y;
+}
+
+/// Z component of the 3D cross product: positive if `b` is counter-clockwise
+/// from `a`.
+template <typename T> T cross(vec2<T> const& a, vec2<T> const& b)
+{
+    return a.x * b.y - a.y * b.x;
+}
+
+/// `v` rotated 90 degrees counter-clockwise.
+template <typename T> vec2<T> perp(vec2<T> const& v)
+{
+    return {-v.y, v.x};
+}
+
+template <typename T> T length_squared(vec2<T> const& v)
+{
+    return dot(v, v);
+}
+
+template <typename T> T length(vec2<T> const& v)
+{
+    return std::sqrt(dot(v, v));
+}
+
+/// @return `v` scaled to unit length, or the zero vector if `v` is zero
+template <typename T> vec2<T> normalize(vec2<T> const& v)
+{
+    auto const len = length(v);
+    return len > T(0) ? v * (T(1) / len) : vec2<T>{T(0), T(0)};
+}
+
+//
+// point-vec2 operations
+//
+
+template <typename T> point2<T> operator+(point2<T> lhs, vec2<T> const& rhs)
+{
+    lhs.x += rhs.x;
+    lhs.y += rhs.y;
+    return lhs;
+}
+
+template <typename T> point2<T> operator-(point2<T> lhs, vec2<T> const& rhs)
+{
+    lhs.x -= rhs.x;
+    lhs.y -= rhs.y;
+    return lhs;
+}
+
+/// The vector from `from` to `to`.
+template <typename T>
+vec2<T> displacement(point2<T> const& from, point2<T> const& to)
+{
+    return {to.x - from.x, to.y - from.y};
+}
+
+} // namespace mymath
@@ -20,13 +20,22 @@ camera::camera(
 {
 }
 
-void camera::rotate(float yaw_delta) { _yaw += yaw_delta; }
+void camera::rotate(float yaw_delta)
+{
+    // Wrap so fast_sincos() stays accurate however long the player spins
+    _yaw = std::remainder(_yaw + yaw_delta, static_cast<float>(2 * M_PI));
+}
 
 void camera::move(vector2f const& vec) { _position = _position + vec; }
 
 void camera::set_position(mymath::point2f const& pos) { _position = pos; }
 
-void camera::set_rotation(float rotation) { _yaw = rotation; }
+void camera::set_rotation(float rotation)
+{
+    _yaw = std::remainder(rotation, static_cast<float>(2 * M_PI));
+}
+
+void camera::set_far(float far) { _far = far; }
 
 point2f const& camera::get_position() const { return _position; }
 
@@ -42,13 +51,14 @@ float camera::get_left() const { return _right; }
 
 float camera::get_fov() const { return _fov; }
 
+vec2f camera::get_forward() const { return unit_vector(_yaw); }
+
 line2f camera::get_projection_plane() const
 {
-    auto const midpoint = _position + vector2f{_yaw, _near};
-    auto const start
-        = midpoint + vector2f{static_cast<float>(_yaw + M_PI / 2), get_right()};
-    auto const end
-        = midpoint + vector2f{static_cast<float>(_yaw - M_PI / 2), get_left()};
+    auto const forward = get_forward();
+    auto const midpoint = _position + forward * _near;
+    auto const start = midpoint + perp(forward) * get_right();
+    auto const end = midpoint - perp(forward) * get_left();
     return {start, end};
 }
 
@@ -18,6 +18,7 @@ public:
     void move(mymath::vector2f const& vec);
     void set_position(mymath::point2f const& pos);
     void set_rotation(float rotation);
+    void set_far(float far);
 
     mymath::point2f const& get_position() const;
     float get_rotation() const;
@@ -27,16 +28,19 @@ public:
     float get_left() const;
     float get_fov() const;
 
+    /// Unit vector in the direction the camera is facing.
+    mymath::vec2f get_forward() const;
+
     mymath::line2f get_projection_plane() const;
 
 private:
     mymath::point2f _position;
-    /// Camera rotation on the XY plane
+    /// Camera rotation on the XY plane, kept in [-pi, pi]
     float _yaw; // (radians)
     /// The distance of the projection plane from the camera.
     float const _near;
     /// Objects that exceed this distance are not drawn.
-    float const _far;
+    float _far;
     /// The size of half the projection plane.
     float const _right;
     /// FOV is `atan(near / right)`
@@ -0,0 +1,160 @@
+#include "collision.hpp"
+
+#include "level.hpp"
+#include "wall_grid.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace mymath;
+
+namespace {
+
+using namespace raycaster;
+
+/// Sliding into a corner produces a new hit for each wall. Give up on the
+/// rest of the movement after this many.
+constexpr int max_slide_iterations = 4;
+
+/// Stop this far short of a wall so the next move doesn't start out touching
+/// it.
+constexpr float contact_skin = 0.0005f;
+
+float dot(point2f const& a, point2f const& b)
+{
+    return a.x * b.x + a.y * b.y;
+}
+
+point2f normalized(point2f const& p)
+{
+    auto const length = std::sqrt(dot(p, p));
+    return length > 0.f ? p * (1.f / length) : point2f{0.f, 0.f};
+}
+
+/// Sweep a circle at `p` moving by `d` against the point `c`.
+///
+/// @param t In: earliest hit so far. Out: the new earliest hit, if closer.
+/// @return true if the point is hit before `t`
+bool sweep_point(point2f const& p, point2f const& d, point2f const& c,
+    float radius, float& t, point2f& normal)
+{
+    auto const m = p - c;
+    auto const b = dot(m, d);
+    if (b >= 0.f) {
+        // Moving away (or not moving)
+        return false;
+    }
+
+    auto const c_term = dot(m, m) - radius * radius;
+    if (c_term <= 0.f) {
+        // Already touching
+        t = 0.f;
+        normal = normalized(m);
+        return true;
+    }
+
+    auto const a = dot(d, d);
+    auto const discriminant = b * b - a * c_term;
+    if (discriminant < 0.f) {
+        return false;
+    }
+
+    auto const hit_t = (-b - std::sqrt(discriminant)) / a;
+    if (hit_t >= t) {
+        return false;
+    }
+    t = hit_t;
+    normal = normalized(m + d * hit_t);
+    return true;
+}
+
+/// Sweep a circle at `p` moving by `d` against a wall: the face on the side
+/// the circle is on, then both end points.
+///
+/// @param t In: earliest hit so far. Out: the new earliest hit, if closer.
+/// @return true if the wall is hit before `t`
+bool sweep_wall(point2f const& p, point2f const& d, wall const& w,
+    float radius, float& t, point2f& normal)
+{
+    auto found = false;
+
+    if (w.length > 0.f) {
+        auto n = w.normal;
+        auto h = dot(p - w.data.start, n);
+        if (h < 0.f) {
+            n = n * -1.f;
+            h = -h;
+        }
+
+        auto const approach = dot(d, n);
+        if (approach < 0.f) {
+            // Overlapping the face already counts as a hit right away
+            auto const hit_t = std::max(0.f, (h - radius) / -approach);
+            if (hit_t < t) {
+                auto const tangent
+                    = (w.data.end - w.data.start) * (1.f / w.length);
+                auto const along = dot(p + d * hit_t - w.data.start, tangent);
+                if (along >= 0.f && along <= w.length) {
+                    t = hit_t;
+                    normal = n;
+                    found = true;
+                }
+            }
+        }
+    }
+
+    found |= sweep_point(p, d, w.data.start, radius, t, normal);
+    found |= sweep_point(p, d, w.data.end, radius, t, normal);
+    return found;
+}
+
+} // namespace
+
+namespace raycaster {
+
+point2f move_and_slide(std::vector<wall> const& walls, wall_grid const& grid,
+    point2f const& position, point2f const& delta, float radius,
+    collision_scratch& scratch)
+{
+    auto const distance = std::sqrt(dot(delta, delta));
+    if (distance == 0.f) {
+        return position;
+    }
+
+    // Sliding never takes the circle further than `distance` from where it
+    // started, so one query covers every iteration
+    auto const reach = distance + radius + contact_skin;
+    grid.query(rectangle2<float>{{position.x - reach, position.y - reach},
+                   {position.x + reach, position.y + reach}},
+        scratch.nearby_walls);
+
+    auto pos = position;
+    auto remaining = delta;
+    for (auto i = 0; i < max_slide_iterations; ++i) {
+        auto t = 1.f;
+        auto normal = point2f{0.f, 0.f};
+        auto hit = false;
+        for (auto const index : scratch.nearby_walls) {
+            hit |= sweep_wall(pos, remaining, walls[index], radius, t, normal);
+        }
+
+        if (!hit) {
+            return pos + remaining;
+        }
+
+        auto const length = std::sqrt(dot(remaining, remaining));
+        auto const safe_t = std::max(0.f, t - contact_skin / length);
+        pos += remaining * safe_t;
+
+        // Project what's left of the movement onto the wall
+        remaining = remaining * (1.f - t);
+        remaining -= normal * dot(remaining, normal);
+        if (dot(remaining, remaining) < contact_skin * contact_skin) {
+            break;
+        }
+    }
+
+    return pos;
+}
+
+} // namespace raycaster
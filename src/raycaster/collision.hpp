@@ -0,0 +1,37 @@
+/// @file collision.hpp
+/// @brief Moving circles through a level without passing through its walls.
+
+#pragma once
+
+#include <mymath/mymath.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace raycaster {
+
+struct wall;
+struct wall_grid;
+
+/// Working memory for move_and_slide(). Keep one around per caller so moves
+/// don't allocate.
+struct collision_scratch {
+    std::vector<std::uint32_t> nearby_walls;
+};
+
+/// Move a circle from `position` by `delta`, stopping at the first wall it
+/// would touch and sliding the rest of the way along it.
+///
+/// The circle is swept continuously, so it can't tunnel through walls or
+/// slip through the gap where two walls meet. Only walls in the grid cells
+/// around the movement are tested. The cost therefore depends on how crowded
+/// that area is, not on the size of the level.
+///
+/// @param walls The level's walls
+/// @param grid The grid built over `walls`
+/// @return The new position of the circle's center
+mymath::point2f move_and_slide(std::vector<wall> const& walls,
+    wall_grid const& grid, mymath::point2f const& position,
+    mymath::point2f const& delta, float radius, collision_scratch& scratch);
+
+} // namespace raycaster
@@ -1,35 +1,11 @@
 #include "console.hpp"
 
 #include <mymath/mymath.hpp>
-#include <sdl_raii/sdl_assert.hpp>
 
 using namespace mymath;
 
 namespace {
 
-constexpr auto font_size = extent2i{6, 8}; // TODO unhardcode this
-
-// TODO put in common code, own header?
-inline bool draw_string(
-    std::string const& str, point2i pos, SDL_Surface& font, SDL_Surface& dest)
-{
-    for (auto const& c : str) {
-        if (c == '\0') {
-            break;
-        }
-
-        auto src_rect = SDL_Rect{c * font_size.w, 0, font_size.w, font_size.h};
-        auto dst_rect = SDL_Rect{pos.x, pos.y, font_size.w, font_size.h};
-        if (SDL_BlitSurface(&font, &src_rect, &dest, &dst_rect) != 0) {
-            return false;
-        }
-
-        pos.x += font_size.w;
-    }
-
-    return true;
-}
-
 constexpr auto log_draw_limit = 10;
 constexpr auto text_spacing_px = 10;
 
@@ -123,12 +99,16 @@ void console::update(sdl_app::input_buffer& input_buffer)
     }
 }
 
-void console::draw(SDL_Surface& framebuffer, SDL_Surface& font)
+void console::draw(
+    SDL_Surface& framebuffer, sdl_app::text_renderer const& text)
 {
-    using namespace std::string_literals;
-
-    SDL_CHECK(draw_string(
-        "> "s + _keyboard_string + "_", point2i{0, 0}, font, framebuffer));
+    auto const glyph_w = text.get_glyph_size().w;
+    auto pos = point2i{0, 0};
+    text.draw("> ", 2, pos, framebuffer);
+    pos.x += 2 * glyph_w;
+    text.draw(_keyboard_string, pos, framebuffer);
+    pos.x += static_cast<int>(_keyboard_string.size()) * glyph_w;
+    text.draw("_", 1, pos, framebuffer);
 
     auto i = 0;
     for (auto log_rev_iter = rbegin(_log); log_rev_iter != rend(_log);
@@ -137,9 +117,8 @@ void console::draw(SDL_Surface& framebuffer, SDL_Surface& font)
             break;
         }
 
-        SDL_CHECK(draw_string(*log_rev_iter,
-            point2i{0, (i + 1) * text_spacing_px}, font,
-            framebuffer)); // TODO magic number
+        text.draw(*log_rev_iter, point2i{0, (i + 1) * text_spacing_px},
+            framebuffer);
 
         ++i;
     }
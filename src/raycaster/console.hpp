@@ -1,6 +1,7 @@
 #pragma once
 
 #include <sdl_application/input_buffer.hpp>
+#include <sdl_application/text_renderer.hpp>
 
 #include <functional>
 #include <string>
@@ -24,7 +25,7 @@ public:
     void handle_event(SDL_Event const& event);
     void update(sdl_app::input_buffer& input_buffer);
 
-    void draw(SDL_Surface& framebuffer, SDL_Surface& font);
+    void draw(SDL_Surface& framebuffer, sdl_app::text_renderer const& text);
 
 private:
     std::string _keyboard_string;
@@ -0,0 +1,150 @@
+#include "entity_store.hpp"
+
+#include <stdexcept>
+
+using namespace mymath;
+
+namespace raycaster {
+
+entity_handle entity_store::spawn(
+    point2f const& position, unsigned int texture, entity_state state)
+{
+    auto const index = static_cast<std::uint32_t>(_positions.size());
+    if (index == std::numeric_limits<std::uint32_t>::max()) {
+        throw std::runtime_error{"Too many entities"};
+    }
+
+    std::uint32_t slot_index;
+    if (!_free_slots.empty()) {
+        slot_index = _free_slots.back();
+        _free_slots.pop_back();
+    } else {
+        slot_index = static_cast<std::uint32_t>(_slots.size());
+        _slots.push_back(slot{0, 0});
+    }
+    _slots[slot_index].index = index;
+
+    _positions.push_back(position);
+    _previous_positions.push_back(position);
+    _textures.push_back(texture);
+    _states.push_back(state);
+    _owners.push_back(slot_index);
+
+    return entity_handle{slot_index, _slots[slot_index].generation};
+}
+
+bool entity_store::despawn(entity_handle h)
+{
+    auto const i = find(h);
+    if (i == npos) {
+        return false;
+    }
+
+    // Fill the hole with the last entity
+    auto const last = _positions.size() - 1;
+    if (i != last) {
+        _positions[i] = _positions[last];
+        _previous_positions[i] = _previous_positions[last];
+        _textures[i] = _textures[last];
+        _states[i] = _states[last];
+        _owners[i] = _owners[last];
+        _slots[_owners[i]].index = static_cast<std::uint32_t>(i);
+    }
+    _positions.pop_back();
+    _previous_positions.pop_back();
+    _textures.pop_back();
+    _states.pop_back();
+    _owners.pop_back();
+
+    ++_slots[h.index].generation;
+    _free_slots.push_back(h.index);
+    return true;
+}
+
+bool entity_store::is_alive(entity_handle h) const
+{
+    return find(h) != npos;
+}
+
+std::size_t entity_store::find(entity_handle h) const
+{
+    // The ownership check catches made-up handles (e.g. from Lua) that
+    // match the generation of a free slot
+    if (h.index >= _slots.size() || _slots[h.index].generation != h.generation
+        || _slots[h.index].index >= _owners.size()
+        || _owners[_slots[h.index].index] != h.index) {
+        return npos;
+    }
+    return _slots[h.index].index;
+}
+
+entity_handle entity_store::get_handle(std::size_t i) const
+{
+    auto const slot_index = _owners.at(i);
+    return entity_handle{slot_index, _slots[slot_index].generation};
+}
+
+std::size_t entity_store::size() const
+{
+    return _positions.size();
+}
+
+bool entity_store::empty() const
+{
+    return _positions.empty();
+}
+
+void entity_store::reserve(std::size_t capacity)
+{
+    _positions.reserve(capacity);
+    _previous_positions.reserve(capacity);
+    _textures.reserve(capacity);
+    _states.reserve(capacity);
+    _owners.reserve(capacity);
+}
+
+void entity_store::clear()
+{
+    while (!empty()) {
+        despawn(get_handle(size() - 1));
+    }
+}
+
+std::vector<point2f> const& entity_store::get_positions() const
+{
+    return _positions;
+}
+
+std::vector<point2f> const& entity_store::get_previous_positions() const
+{
+    return _previous_positions;
+}
+
+void entity_store::save_positions() { _previous_positions = _positions; }
+
+std::vector<unsigned int> const& entity_store::get_textures() const
+{
+    return _textures;
+}
+
+std::vector<entity_state> const& entity_store::get_states() const
+{
+    return _states;
+}
+
+void entity_store::set_position(std::size_t i, point2f const& position)
+{
+    _positions[i] = position;
+}
+
+void entity_store::set_texture(std::size_t i, unsigned int texture)
+{
+    _textures[i] = texture;
+}
+
+void entity_store::set_state(std::size_t i, entity_state state)
+{
+    _states[i] = state;
+}
+
+} // namespace raycaster
@@ -0,0 +1,106 @@
+/// @file entity_store.hpp
+/// @brief Storage for sprites (and anything else that lives at a point).
+
+#pragma once
+
+#include <mymath/mymath.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace raycaster {
+
+/// Refers to an entity in an entity_store. Stays valid while the entity
+/// exists, no matter what else is spawned or despawned. Once the entity is
+/// despawned the handle goes stale, and lookups with it fail (even if its
+/// slot has been reused).
+struct entity_handle {
+    std::uint32_t index = std::numeric_limits<std::uint32_t>::max();
+    std::uint32_t generation = 0;
+};
+
+inline bool operator==(entity_handle const& lhs, entity_handle const& rhs)
+{
+    return lhs.index == rhs.index && lhs.generation == rhs.generation;
+}
+
+inline bool operator!=(entity_handle const& lhs, entity_handle const& rhs)
+{
+    return !(lhs == rhs);
+}
+
+enum class entity_state : std::uint8_t {
+    active,
+    /// Still drawn, but done interacting (e.g. an exploded barrel)
+    destroyed,
+};
+
+/// Entities stored as structure-of-arrays: one tightly packed array per field,
+/// all in the same order. Passes that only need positions (like the sprite
+/// pass of the renderer) stream through just that array.
+///
+/// The arrays have no gaps. Despawning moves the last entity into the hole,
+/// so both spawn and despawn are O(1), but an entity's position in the arrays
+/// can change. Use an entity_handle to refer to a particular entity over
+/// time.
+class entity_store {
+public:
+    static constexpr auto npos = std::numeric_limits<std::size_t>::max();
+
+    entity_handle spawn(mymath::point2f const& position, unsigned int texture,
+        entity_state state = entity_state::active);
+
+    /// @return false if `h` is stale
+    bool despawn(entity_handle h);
+
+    bool is_alive(entity_handle h) const;
+
+    /// @return The array index of `h`'s entity, or npos if `h` is stale
+    std::size_t find(entity_handle h) const;
+
+    /// @return The handle for the entity at array index `i`
+    entity_handle get_handle(std::size_t i) const;
+
+    std::size_t size() const;
+    bool empty() const;
+    void reserve(std::size_t capacity);
+    /// Despawn everything, invalidating all handles.
+    void clear();
+
+    std::vector<mymath::point2f> const& get_positions() const;
+    std::vector<unsigned int> const& get_textures() const;
+    std::vector<entity_state> const& get_states() const;
+
+    /// Positions as of the last save_positions(), in the same order as
+    /// get_positions(). Entities spawned since are where they spawned.
+    std::vector<mymath::point2f> const& get_previous_positions() const;
+    /// Remember every entity's position, e.g. at the start of a simulation
+    /// tick, so they can be drawn between where they were and where they are.
+    void save_positions();
+
+    void set_position(std::size_t i, mymath::point2f const& position);
+    void set_texture(std::size_t i, unsigned int texture);
+    void set_state(std::size_t i, entity_state state);
+
+private:
+    struct slot {
+        /// Array index of the entity using this slot
+        std::uint32_t index;
+        /// Bumped on despawn so old handles to this slot go stale
+        std::uint32_t generation;
+    };
+
+    std::vector<mymath::point2f> _positions;
+    std::vector<mymath::point2f> _previous_positions;
+    std::vector<unsigned int> _textures;
+    std::vector<entity_state> _states;
+    /// The slot each entity belongs to, parallel to the arrays above
+    std::vector<std::uint32_t> _owners;
+
+    std::vector<slot> _slots;
+    std::vector<std::uint32_t> _free_slots;
+};
+
+} // namespace raycaster
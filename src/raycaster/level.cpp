@@ -1,9 +1,13 @@
 #include "level.hpp"
 
+#include "level_binary.hpp"
+
 #include <lua_raii/lua_raii.hpp>
 
 #include <SDL.h>
 
+#include <algorithm>
+#include <cmath>
 #include <fstream>
 #include <sstream>
 #include <stdexcept>
@@ -12,14 +16,301 @@ using namespace mymath;
 
 namespace raycaster {
 
-std::unique_ptr<level> load_level(std::string const& filename, lua_State* L)
+namespace {
+
+bool ends_with(std::string const& str, std::string const& suffix)
+{
+    return str.size() >= suffix.size()
+        && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+/// The texids levels used back when the texture cache was hardcoded.
+std::vector<std::string> legacy_texture_names()
+{
+    return {
+        "",
+        "wall.bmp",
+        "stone.bmp",
+        "floor.bmp",
+        "column.bmp",
+        "",
+        "ceil.bmp",
+        "",
+        "barrel.bmp",
+        "barrel_explode.bmp",
+        "bat.bmp",
+    };
+}
+
+constexpr unsigned legacy_floor_texid = 3;
+constexpr unsigned legacy_ceiling_texid = 6;
+
+/// @return The texid of `name`, adding it to the table if needed
+unsigned find_or_add_texture(level& lvl, std::string const& name)
+{
+    auto const it
+        = std::find(lvl.texture_names.begin(), lvl.texture_names.end(), name);
+    if (it != lvl.texture_names.end()) {
+        return static_cast<unsigned>(it - lvl.texture_names.begin());
+    }
+    lvl.texture_names.push_back(name);
+    return static_cast<unsigned>(lvl.texture_names.size() - 1);
+}
+
+/// Read an optional string field from the table at the top of the stack.
+bool get_optional_string(lua_State* L, char const* field, std::string& out)
+{
+    auto const type = lua_getfield(L, -1, field);
+    if (type == LUA_TSTRING) {
+        out = lua::to<std::string>(L);
+    }
+    lua_pop(L, 1); // field
+    return type == LUA_TSTRING;
+}
+
+bool is_finite(line2f const& line)
+{
+    return std::isfinite(line.start.x) && std::isfinite(line.start.y)
+        && std::isfinite(line.end.x) && std::isfinite(line.end.y);
+}
+
+/// Add wall `index` to the grid's dynamic layer at `line`, growing the grid
+/// first if the wall is outside it.
+///
+/// @return false if the grid can't grow that far, nothing is changed then
+bool insert_dynamic_wall(level& lvl, std::size_t index, line2f const& line)
+{
+    switch (lvl.grid.grow_to_fit(line.get_bounding_box())) {
+    case wall_grid::grow_result::too_big:
+        return false;
+    case wall_grid::grow_result::grown:
+        if (!lvl.pvs.empty()) {
+            // The PVS is indexed by grid cell, and knows nothing of the new
+            // ones
+            SDL_Log("A dynamic wall is outside the level's grid, not using "
+                    "the level's PVS anymore");
+            lvl.pvs = pvs_table{};
+        }
+        break;
+    case wall_grid::grow_result::covered:
+        break;
+    }
+    lvl.grid.insert_dynamic(static_cast<std::uint32_t>(index), line);
+    return true;
+}
+
+} // namespace
+
+wall make_wall(line2f const& line, unsigned int texture)
+{
+    auto const length = line.length();
+    auto normal = point2f{0.f, 0.f};
+    if (length > 0.f) {
+        normal = point2f{line.start.y - line.end.y, line.end.x - line.start.x}
+            * (1.f / length);
+    }
+    return wall{line, texture, length, normal};
+}
+
+std::size_t add_dynamic_wall(
+    level& lvl, line2f const& line, unsigned int texture)
+{
+    if (!is_finite(line)) {
+        throw std::invalid_argument{"Wall coordinates aren't finite"};
+    }
+
+    auto const index = lvl.walls.size();
+    lvl.walls.push_back(make_wall(line, texture));
+    if (!insert_dynamic_wall(lvl, index, line)) {
+        lvl.walls.pop_back();
+        throw std::invalid_argument{"Wall is too far from the level"};
+    }
+    if (lvl.first_dynamic_wall > index) {
+        lvl.first_dynamic_wall = index;
+    }
+    return index;
+}
+
+bool is_dynamic_wall(level const& lvl, std::size_t index)
+{
+    return index >= lvl.first_dynamic_wall && index < lvl.walls.size();
+}
+
+bool move_dynamic_wall(level& lvl, std::size_t index, line2f const& line)
+{
+    if (!is_dynamic_wall(lvl, index) || !is_finite(line)) {
+        return false;
+    }
+
+    // Disabled walls aren't in the grid, they're checked when enabled
+    if (lvl.grid.dynamic_cells.count(static_cast<std::uint32_t>(index)) != 0
+        && !insert_dynamic_wall(lvl, index, line)) {
+        return false;
+    }
+
+    auto& w = lvl.walls[index];
+    w = make_wall(line, w.texture);
+    return true;
+}
+
+bool set_dynamic_wall_enabled(level& lvl, std::size_t index, bool enabled)
+{
+    if (!is_dynamic_wall(lvl, index)) {
+        return false;
+    }
+
+    auto const grid_index = static_cast<std::uint32_t>(index);
+    if (!enabled) {
+        lvl.grid.remove_dynamic(grid_index);
+    } else if (lvl.grid.dynamic_cells.count(grid_index) == 0) {
+        return insert_dynamic_wall(lvl, index, lvl.walls[index].data);
+    }
+    return true;
+}
+
+std::size_t memory_usage(level const& lvl)
+{
+    auto const bytes
+        = [](auto const& v) { return v.capacity() * sizeof(v[0]); };
+
+    std::size_t total = sizeof(level);
+    total += bytes(lvl.walls);
+    // Position, texture and state, plus a slot and an owner index each
+    total += lvl.sprites.size()
+        * (sizeof(point2f) + sizeof(unsigned int) + sizeof(entity_state)
+            + 3 * sizeof(std::uint32_t));
+
+    total += bytes(lvl.grid.cell_offsets) + bytes(lvl.grid.wall_indices)
+        + bytes(lvl.grid.dynamic_heads) + bytes(lvl.grid.dynamic_entries);
+    total += bytes(lvl.sectors.point_offsets) + bytes(lvl.sectors.points)
+        + bytes(lvl.sectors.neighbours) + bytes(lvl.sectors.wall_offsets)
+        + bytes(lvl.sectors.wall_indices);
+    total += bytes(lvl.pvs.wall_offsets) + bytes(lvl.pvs.wall_runs)
+        + bytes(lvl.pvs.cell_offsets) + bytes(lvl.pvs.cell_runs);
+
+    for (auto const& name : lvl.texture_names) {
+        total += sizeof(name) + name.capacity();
+    }
+    return total;
+}
+
+void bind_textures(level& lvl, texture_registry& textures)
+{
+    if (lvl.textures_bound) {
+        return;
+    }
+
+    bind_textures(lvl, acquire_textures(lvl, textures));
+}
+
+std::vector<texture_handle> acquire_textures(
+    level const& lvl, texture_registry& textures)
+{
+    std::vector<texture_handle> handles;
+    handles.reserve(lvl.texture_names.size());
+    for (auto const& name : lvl.texture_names) {
+        handles.push_back(textures.acquire(name));
+    }
+    return handles;
+}
+
+void bind_textures(level& lvl, std::vector<texture_handle> const& handles)
+{
+    if (lvl.textures_bound) {
+        return;
+    }
+
+    auto const resolve = [&handles](unsigned int texid) {
+        return texid < handles.size() ? handles[texid] : missing_texture;
+    };
+
+    for (auto& w : lvl.walls) {
+        w.texture = resolve(w.texture);
+    }
+    for (std::size_t i = 0; i < lvl.sprites.size(); ++i) {
+        lvl.sprites.set_texture(i, resolve(lvl.sprites.get_textures()[i]));
+    }
+    lvl.floor_texture = resolve(lvl.floor_texture);
+    lvl.ceiling_texture = resolve(lvl.ceiling_texture);
+    lvl.textures_bound = true;
+}
+
+std::unique_ptr<level> load_level(
+    std::string const& filename, lua_State* L, sdl_app::asset_pack const* pack)
+{
+    auto const start = SDL_GetPerformanceCounter();
+
+    auto const packed = pack ? pack->find(filename) : nullptr;
+
+    std::unique_ptr<level> new_level;
+    if (ends_with(filename, level_binary_extension)) {
+        new_level = packed
+            ? load_level_binary(packed->data, packed->size, filename)
+            : load_level_binary(filename);
+    } else if (packed) {
+        if (luaL_loadbuffer(L, reinterpret_cast<char const*>(packed->data),
+                packed->size, filename.c_str())
+            || lua_pcall(L, 0, LUA_MULTRET, 0)) {
+            throw std::runtime_error{lua::to<std::string>(L)};
+        }
+        new_level = read_level_table(L);
+    } else {
+        new_level = load_level_lua(filename, L);
+    }
+
+    auto const elapsed_ms = (SDL_GetPerformanceCounter() - start) * 1000.0
+        / SDL_GetPerformanceFrequency();
+    SDL_Log("Loaded %s: %u walls, %u sprites in %.3f ms", filename.c_str(),
+        static_cast<unsigned>(new_level->walls.size()),
+        static_cast<unsigned>(new_level->sprites.size()), elapsed_ms);
+
+    return new_level;
+}
+
+std::unique_ptr<level> load_level_lua(std::string const& filename, lua_State* L)
 {
     if (luaL_dofile(L, filename.c_str())) {
         throw std::runtime_error{lua::to<std::string>(L)};
     }
 
+    return read_level_table(L);
+}
+
+std::unique_ptr<level> read_level_table(lua_State* L)
+{
     auto new_level = std::make_unique<level>();
 
+    //
+    // textures
+    //
+
+    if (lua_getfield(L, 1, "textures") == LUA_TTABLE) {
+        // Lua arrays start at 1, so slot 0 stays unused
+        new_level->texture_names.push_back("");
+        auto const textures_length = luaL_len(L, 2);
+        for (auto i = 1; i <= textures_length; ++i) {
+            if (lua_geti(L, 2, i) == LUA_TSTRING) {
+                new_level->texture_names.push_back(lua::to<std::string>(L));
+            } else {
+                new_level->texture_names.push_back("");
+            }
+            lua_pop(L, 1); // textures[i]
+        }
+    } else {
+        new_level->texture_names = legacy_texture_names();
+    }
+    lua_pop(L, 1); // textures
+
+    new_level->floor_texture = legacy_floor_texid;
+    new_level->ceiling_texture = legacy_ceiling_texid;
+    std::string name;
+    if (get_optional_string(L, "floor", name)) {
+        new_level->floor_texture = find_or_add_texture(*new_level, name);
+    }
+    if (get_optional_string(L, "ceiling", name)) {
+        new_level->ceiling_texture = find_or_add_texture(*new_level, name);
+    }
+
     //
     // player_start
     //
@@ -51,13 +342,12 @@ std::unique_ptr<level> load_level(std::string const& filename, lua_State* L)
             throw std::runtime_error{"Bad or missing wall entry"};
         }
 
-        new_level->walls.push_back(wall{
+        new_level->walls.push_back(make_wall(
             line2f{
                 {lua::to<float>(L, -5), lua::to<float>(L, -4)},
                 {lua::to<float>(L, -3), lua::to<float>(L, -2)},
             },
-            lua::to<unsigned>(L, -1),
-        });
+            lua::to<unsigned>(L, -1)));
         lua_pop(L, 6); // texid, y2, x2, y2, y1, walls[i]
     }
     lua_pop(L, 1); // walls
@@ -78,15 +368,46 @@ std::unique_ptr<level> load_level(std::string const& filename, lua_State* L)
             throw std::runtime_error{"Bad or missing sprites entry"};
         }
 
-        new_level->sprites.push_back(sprite{
+        new_level->sprites.spawn(
             {lua::to<float>(L, -3), lua::to<float>(L, -2)},
-            lua::to<unsigned>(L, -1),
-        });
+            lua::to<unsigned>(L, -1));
         lua_pop(L, 4); // texid, y, x, sprites[i]
     }
     lua_pop(L, 1); // sprites
 
-    lua_pop(L, 1); // from dofile
+    //
+    // sectors (optional)
+    //
+
+    std::vector<std::vector<point2f>> outlines;
+    if (lua_getfield(L, 1, "sectors") == LUA_TTABLE) {
+        auto const sectors_length = luaL_len(L, 2);
+        for (auto i = 1; i <= sectors_length; ++i) {
+            if (lua_geti(L, 2, i) != LUA_TTABLE) {
+                throw std::runtime_error{"Bad sectors entry"};
+            }
+            outlines.emplace_back();
+            auto const points_length = luaL_len(L, 3);
+            for (auto j = 1; j <= points_length; ++j) {
+                if (lua_geti(L, 3, j) != LUA_TTABLE
+                    || lua_getfield(L, 4, "x") != LUA_TNUMBER
+                    || lua_getfield(L, 4, "y") != LUA_TNUMBER) {
+                    throw std::runtime_error{"Bad sector point"};
+                }
+                outlines.back().push_back(
+                    {lua::to<float>(L, -2), lua::to<float>(L, -1)});
+                lua_pop(L, 3); // y, x, point
+            }
+            lua_pop(L, 1); // sectors[i]
+        }
+    }
+    lua_pop(L, 1); // sectors
+
+    lua_pop(L, 1); // level table
+
+    new_level->grid = build_wall_grid(new_level->walls);
+    new_level->sectors
+        = build_sector_map(outlines, new_level->walls, new_level->grid);
 
     return new_level;
 }
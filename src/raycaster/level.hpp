@@ -1,8 +1,17 @@
 #pragma once
 
+#include "entity_store.hpp"
+#include "pvs.hpp"
+#include "sector.hpp"
+#include "texture_registry.hpp"
+#include "wall_grid.hpp"
+
 #include <lua_raii/lua_raii.hpp>
 #include <mymath/mymath.hpp>
+#include <sdl_application/asset_pack.hpp>
 
+#include <cstddef>
+#include <limits>
 #include <memory>
 #include <string>
 #include <vector>
@@ -12,20 +21,114 @@ namespace raycaster {
 struct wall {
     mymath::line2f data;
     unsigned int texture;
+    /// Precomputed `data.length()`
+    float length;
+    /// Precomputed unit normal (pointing left of `data.start -> data.end`)
+    mymath::point2f normal;
 };
 
-struct sprite {
-    mymath::point2f data;
-    unsigned int texture;
-};
+/// Create a wall, filling in the precomputed fields.
+wall make_wall(mymath::line2f const& line, unsigned int texture);
 
 struct level {
     std::vector<wall> walls;
-    std::vector<sprite> sprites;
+    entity_store sprites;
     mymath::point2f player_start;
+    /// Acceleration structure over `walls`
+    wall_grid grid;
+    /// Walls from here on were added with add_dynamic_wall() and can move.
+    /// Everything before is static and lives in the grid's flat arrays.
+    std::size_t first_dynamic_wall = std::numeric_limits<std::size_t>::max();
+    /// Optional, empty unless the level describes its sectors
+    sector_map sectors;
+    /// Optional, only compiled levels built with `level_compiler --pvs` have
+    /// one. Indexed by `grid` cell.
+    pvs_table pvs;
+
+    /// Texture file names, indexed by the `texid` used in the level file.
+    /// Empty names are unused slots.
+    std::vector<std::string> texture_names;
+    unsigned int floor_texture;
+    unsigned int ceiling_texture;
+
+    /// Whether the `texture` fields above (and in walls and sprites) are
+    /// still texids or have been resolved to texture handles.
+    bool textures_bound = false;
 };
 
-// Doesn't go through the asset manager yet
-std::unique_ptr<level> load_level(std::string const& filename, lua_State* L);
+/// Add a wall that can be moved or switched off later (a door, a moving
+/// platform). Only the grid cells it overlaps are updated. Walls can go
+/// outside the static walls' bounds, which grows the grid, but a level's PVS
+/// can't be used after that.
+///
+/// @param texture A texture handle if the level's textures are bound,
+/// otherwise a texid
+/// @return The new wall's index in `lvl.walls`
+/// @throw std::invalid_argument if `line` isn't finite or is so far out that
+/// the grid would need more than wall_grid::max_cells cells
+std::size_t add_dynamic_wall(
+    level& lvl, mymath::line2f const& line, unsigned int texture);
+
+/// @return Whether `index` is a wall added with add_dynamic_wall()
+bool is_dynamic_wall(level const& lvl, std::size_t index);
+
+/// Move a dynamic wall. The grid cells it leaves and enters are updated; the
+/// cost doesn't depend on how many other walls there are.
+///
+/// @return false if `index` isn't a dynamic wall, or `line` isn't finite or
+/// is too far out for the grid (see add_dynamic_wall()). The wall stays where
+/// it was then.
+bool move_dynamic_wall(
+    level& lvl, std::size_t index, mymath::line2f const& line);
+
+/// Switch a dynamic wall on or off (e.g. an open door). Disabled walls are
+/// taken out of the grid, so they aren't drawn and nothing collides with
+/// them. They can still be moved.
+///
+/// @return false if `index` isn't a dynamic wall, or it was moved too far out
+/// for the grid while disabled. It stays disabled then.
+bool set_dynamic_wall_enabled(level& lvl, std::size_t index, bool enabled);
+
+/// @return Roughly how many bytes `lvl` takes up, including what it points to
+std::size_t memory_usage(level const& lvl);
+
+/// Resolve texids to texture_registry handles, loading textures as needed.
+/// Call on the main thread before handing the level to the renderer.
+void bind_textures(level& lvl, texture_registry& textures);
+
+/// The first half of bind_textures(): the handle of each of the level's
+/// texids. Main thread only, but doesn't depend on the level's size.
+std::vector<texture_handle> acquire_textures(
+    level const& lvl, texture_registry& textures);
+
+/// The second half of bind_textures(), which goes through every wall and
+/// sprite. Can be done on any thread, e.g. to a copy of a level that isn't
+/// in play yet.
+///
+/// @param handles From acquire_textures()
+void bind_textures(level& lvl, std::vector<texture_handle> const& handles);
+
+/// Load a level. Files ending in `.rclv` are compiled binary levels (see
+/// level_binary.hpp) and don't touch `L`; anything else is run as a Lua
+/// script (e.g. the `.tmx.lua` files made by tmx2lua.py).
+///
+/// @param pack If set and it contains `filename`, the level is read from the
+/// pack instead of the file system
+std::unique_ptr<level> load_level(std::string const& filename, lua_State* L,
+    sdl_app::asset_pack const* pack = nullptr);
+
+/// Load a level from a Lua script. The script must return the level table.
+///
+/// The table may have a `textures` array naming the file for each texid, and
+/// `floor`/`ceiling` file names. Without them, the texids from the original
+/// hardcoded texture cache are used (1 = wall.bmp, 2 = stone.bmp, ...).
+///
+/// It may also have a `sectors` array, each sector being an outline of
+/// `{x = ..., y = ...}` points (see sector.hpp).
+std::unique_ptr<level> load_level_lua(std::string const& filename, lua_State* L);
+
+/// Build a level from the table returned by a level script, which must be the
+/// only thing on the stack. Pops it.
+std::unique_ptr<level> read_level_table(lua_State* L);
 
 } // namespace raycaster
@@ -0,0 +1,558 @@
+#include "level_binary.hpp"
+
+#include "level.hpp"
+
+#include <sdl_application/mapped_file.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+using namespace mymath;
+using namespace std::string_literals;
+
+namespace {
+
+using namespace raycaster;
+
+constexpr std::uint8_t magic[4] = {'R', 'C', 'L', 'V'};
+constexpr auto section_count = static_cast<std::uint32_t>(level_section::count);
+// magic, version, section_count, player_start (2), grid (5)
+constexpr std::size_t fixed_header_words = 10;
+constexpr std::size_t header_size
+    = (fixed_header_words + 2 * section_count) * sizeof(std::uint32_t);
+
+//
+// Little-endian encoding. Going through bytes keeps this independent of the
+// host byte order; on little-endian hosts it compiles down to plain loads.
+//
+
+std::uint32_t float_bits(float f)
+{
+    std::uint32_t u;
+    std::memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+float bits_float(std::uint32_t u)
+{
+    float f;
+    std::memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+std::uint32_t read_u32(std::uint8_t const* p)
+{
+    return static_cast<std::uint32_t>(p[0])
+        | static_cast<std::uint32_t>(p[1]) << 8
+        | static_cast<std::uint32_t>(p[2]) << 16
+        | static_cast<std::uint32_t>(p[3]) << 24;
+}
+
+float read_f32(std::uint8_t const* p) { return bits_float(read_u32(p)); }
+
+class binary_writer {
+public:
+    void put_u32(std::uint32_t u)
+    {
+        _bytes.push_back(static_cast<std::uint8_t>(u));
+        _bytes.push_back(static_cast<std::uint8_t>(u >> 8));
+        _bytes.push_back(static_cast<std::uint8_t>(u >> 16));
+        _bytes.push_back(static_cast<std::uint8_t>(u >> 24));
+    }
+
+    void put_f32(float f) { put_u32(float_bits(f)); }
+
+    /// Write a section's data and patch its entry in the section table.
+    template <typename Getter>
+    void put_section(level_section section, std::size_t count, Getter&& get)
+    {
+        auto const table_entry = (fixed_header_words
+                                     + 2 * static_cast<std::size_t>(section))
+            * sizeof(std::uint32_t);
+        patch_u32(table_entry, static_cast<std::uint32_t>(_bytes.size()));
+        patch_u32(table_entry + sizeof(std::uint32_t),
+            static_cast<std::uint32_t>(count));
+
+        for (std::size_t i = 0; i < count; ++i) {
+            put_u32(get(i));
+        }
+    }
+
+    std::vector<std::uint8_t> const& bytes() const { return _bytes; }
+
+private:
+    void patch_u32(std::size_t at, std::uint32_t u)
+    {
+        _bytes[at] = static_cast<std::uint8_t>(u);
+        _bytes[at + 1] = static_cast<std::uint8_t>(u >> 8);
+        _bytes[at + 2] = static_cast<std::uint8_t>(u >> 16);
+        _bytes[at + 3] = static_cast<std::uint8_t>(u >> 24);
+    }
+
+    std::vector<std::uint8_t> _bytes;
+};
+
+/// The raw bytes of a compiled level (a mapped file or an asset pack entry)
+struct byte_span {
+    std::uint8_t const* _data;
+    std::size_t _size;
+
+    std::uint8_t const* data() const { return _data; }
+    std::size_t size() const { return _size; }
+};
+
+/// Bounds-checked view of one section inside the mapping
+struct section_view {
+    std::uint8_t const* data;
+    std::uint32_t count;
+
+    std::uint32_t u32(std::size_t i) const { return read_u32(data + i * 4); }
+    float f32(std::size_t i) const { return read_f32(data + i * 4); }
+};
+
+section_view get_section(
+    byte_span const& file, level_section section, std::string const& filename)
+{
+    auto const entry = file.data()
+        + (fixed_header_words + 2 * static_cast<std::size_t>(section))
+            * sizeof(std::uint32_t);
+    auto const offset = read_u32(entry);
+    auto const count = read_u32(entry + sizeof(std::uint32_t));
+
+    if (offset % sizeof(std::uint32_t) != 0
+        || static_cast<std::size_t>(offset)
+                + static_cast<std::size_t>(count) * sizeof(std::uint32_t)
+            > file.size()) {
+        throw std::runtime_error{"Corrupt section table in "s + filename};
+    }
+
+    return section_view{file.data() + offset, count};
+}
+
+/// Read a CSR offsets section: `count + 1` ascending offsets, the last one
+/// being `total`
+///
+/// @param what Names the data for error messages
+std::vector<std::uint32_t> read_offsets(section_view const& section,
+    std::uint32_t count, std::uint32_t total, char const* what,
+    std::string const& filename)
+{
+    auto const corrupt = "Corrupt "s + what + " in " + filename;
+    if (section.count != count + 1) {
+        throw std::runtime_error{corrupt};
+    }
+    std::vector<std::uint32_t> offsets(section.count);
+    for (std::uint32_t i = 0; i < section.count; ++i) {
+        offsets[i] = section.u32(i);
+        if ((i == 0 && offsets[i] != 0)
+            || (i > 0 && offsets[i] < offsets[i - 1])) {
+            throw std::runtime_error{corrupt};
+        }
+    }
+    if (offsets.back() != total) {
+        throw std::runtime_error{corrupt};
+    }
+    return offsets;
+}
+
+/// Pack bytes into 4-byte words, zero padded
+std::vector<std::uint32_t> pack_bytes(std::vector<std::uint8_t> bytes)
+{
+    bytes.resize((bytes.size() + 3) / 4 * 4, 0);
+    std::vector<std::uint32_t> words(bytes.size() / 4);
+    for (std::size_t i = 0; i < words.size(); ++i) {
+        words[i] = read_u32(bytes.data() + i * 4);
+    }
+    return words;
+}
+
+void read_sectors(byte_span const& file, std::string const& filename,
+    std::uint32_t n_walls, sector_map& sectors)
+{
+    auto const point_offsets
+        = get_section(file, level_section::sector_point_offsets, filename);
+    if (point_offsets.count == 0) {
+        return;
+    }
+    auto const n_sectors = point_offsets.count - 1;
+
+    auto const px = get_section(file, level_section::sector_point_x, filename);
+    auto const py = get_section(file, level_section::sector_point_y, filename);
+    auto const neighbours
+        = get_section(file, level_section::sector_neighbours, filename);
+    if (py.count != px.count || neighbours.count != px.count) {
+        throw std::runtime_error{"Corrupt sectors in "s + filename};
+    }
+
+    sectors.point_offsets
+        = read_offsets(point_offsets, n_sectors, px.count, "sectors", filename);
+    sectors.points.resize(px.count);
+    sectors.neighbours.resize(px.count);
+    for (std::uint32_t i = 0; i < px.count; ++i) {
+        sectors.points[i] = point2f{px.f32(i), py.f32(i)};
+        sectors.neighbours[i] = neighbours.u32(i);
+        if (sectors.neighbours[i] != no_sector
+            && sectors.neighbours[i] >= n_sectors) {
+            throw std::runtime_error{"Corrupt sectors in "s + filename};
+        }
+    }
+
+    auto const wall_indices
+        = get_section(file, level_section::sector_wall_indices, filename);
+    sectors.wall_offsets = read_offsets(
+        get_section(file, level_section::sector_wall_offsets, filename),
+        n_sectors, wall_indices.count, "sectors", filename);
+    sectors.wall_indices.resize(wall_indices.count);
+    for (std::uint32_t i = 0; i < wall_indices.count; ++i) {
+        sectors.wall_indices[i] = wall_indices.u32(i);
+        if (sectors.wall_indices[i] >= n_walls) {
+            throw std::runtime_error{"Corrupt sectors in "s + filename};
+        }
+    }
+}
+
+void read_pvs(byte_span const& file, std::string const& filename,
+    std::uint32_t n_walls, std::uint32_t cell_count, pvs_table& pvs)
+{
+    auto const info = get_section(file, level_section::pvs_info, filename);
+    if (info.count == 0) {
+        return;
+    }
+    if (info.count != 3) {
+        throw std::runtime_error{"Corrupt PVS in "s + filename};
+    }
+
+    auto const read_runs = [&](level_section offsets_section,
+                               level_section runs_section,
+                               std::uint32_t byte_count,
+                               std::vector<std::uint32_t>& offsets,
+                               std::vector<std::uint8_t>& runs) {
+        auto const words = get_section(file, runs_section, filename);
+        if (byte_count > static_cast<std::size_t>(words.count) * 4) {
+            throw std::runtime_error{"Corrupt PVS in "s + filename};
+        }
+        offsets = read_offsets(get_section(file, offsets_section, filename),
+            cell_count, byte_count, "PVS", filename);
+        runs.assign(words.data, words.data + byte_count);
+    };
+
+    // Sets are decoded to this many bits every frame
+    pvs.wall_count = info.u32(0);
+    if (pvs.wall_count > n_walls) {
+        throw std::runtime_error{"Corrupt PVS in "s + filename};
+    }
+    read_runs(level_section::pvs_wall_offsets, level_section::pvs_wall_runs,
+        info.u32(1), pvs.wall_offsets, pvs.wall_runs);
+    read_runs(level_section::pvs_cell_offsets, level_section::pvs_cell_runs,
+        info.u32(2), pvs.cell_offsets, pvs.cell_runs);
+}
+
+} // namespace
+
+namespace raycaster {
+
+void save_level_binary(level const& lvl, std::string const& filename)
+{
+    if (lvl.textures_bound) {
+        throw std::runtime_error{
+            "Can't save a level whose textures are bound: "s + filename};
+    }
+
+    auto const& walls = lvl.walls;
+    auto const& sprites = lvl.sprites;
+    auto const& positions = sprites.get_positions();
+    auto const& grid = lvl.grid;
+
+    binary_writer out;
+    out.put_u32(read_u32(magic));
+    out.put_u32(level_binary_version);
+    out.put_u32(section_count);
+    out.put_f32(lvl.player_start.x);
+    out.put_f32(lvl.player_start.y);
+    out.put_f32(grid.origin.x);
+    out.put_f32(grid.origin.y);
+    out.put_f32(grid.cell_size);
+    out.put_u32(static_cast<std::uint32_t>(grid.width));
+    out.put_u32(static_cast<std::uint32_t>(grid.height));
+    // Placeholder section table, patched by put_section
+    for (std::uint32_t i = 0; i < 2 * section_count; ++i) {
+        out.put_u32(0);
+    }
+
+    // Dynamic walls are added by scripts at runtime and aren't in the grid's
+    // flat arrays, so only the static ones are saved
+    auto const n_walls = std::min(walls.size(), lvl.first_dynamic_wall);
+    out.put_section(level_section::wall_x1, n_walls,
+        [&](std::size_t i) { return float_bits(walls[i].data.start.x); });
+    out.put_section(level_section::wall_y1, n_walls,
+        [&](std::size_t i) { return float_bits(walls[i].data.start.y); });
+    out.put_section(level_section::wall_x2, n_walls,
+        [&](std::size_t i) { return float_bits(walls[i].data.end.x); });
+    out.put_section(level_section::wall_y2, n_walls,
+        [&](std::size_t i) { return float_bits(walls[i].data.end.y); });
+    out.put_section(level_section::wall_texture, n_walls,
+        [&](std::size_t i) { return walls[i].texture; });
+    out.put_section(level_section::wall_length, n_walls,
+        [&](std::size_t i) { return float_bits(walls[i].length); });
+    out.put_section(level_section::wall_normal_x, n_walls,
+        [&](std::size_t i) { return float_bits(walls[i].normal.x); });
+    out.put_section(level_section::wall_normal_y, n_walls,
+        [&](std::size_t i) { return float_bits(walls[i].normal.y); });
+
+    auto const n_sprites = sprites.size();
+    out.put_section(level_section::sprite_x, n_sprites,
+        [&](std::size_t i) { return float_bits(positions[i].x); });
+    out.put_section(level_section::sprite_y, n_sprites,
+        [&](std::size_t i) { return float_bits(positions[i].y); });
+    out.put_section(level_section::sprite_texture, n_sprites,
+        [&](std::size_t i) { return sprites.get_textures()[i]; });
+
+    out.put_section(level_section::grid_cell_offsets, grid.cell_offsets.size(),
+        [&](std::size_t i) { return grid.cell_offsets[i]; });
+    out.put_section(level_section::grid_wall_indices, grid.wall_indices.size(),
+        [&](std::size_t i) { return grid.wall_indices[i]; });
+
+    // Name count, then the names
+    std::vector<std::uint8_t> names(4, 0);
+    auto const name_count = static_cast<std::uint32_t>(lvl.texture_names.size());
+    for (auto i = 0; i < 4; ++i) {
+        names[i] = static_cast<std::uint8_t>(name_count >> (8 * i));
+    }
+    for (auto const& name : lvl.texture_names) {
+        names.insert(names.end(), name.begin(), name.end());
+        names.push_back('\0');
+    }
+    names.resize((names.size() + 3) / 4 * 4, '\0');
+    out.put_section(
+        level_section::texture_names, names.size() / 4, [&](std::size_t i) {
+            return read_u32(names.data() + i * 4);
+        });
+
+    unsigned const floor_ceiling[] = {lvl.floor_texture, lvl.ceiling_texture};
+    out.put_section(level_section::floor_ceiling_texture, 2,
+        [&](std::size_t i) { return floor_ceiling[i]; });
+
+    auto const& sectors = lvl.sectors;
+    out.put_section(level_section::sector_point_offsets,
+        sectors.point_offsets.size(),
+        [&](std::size_t i) { return sectors.point_offsets[i]; });
+    out.put_section(level_section::sector_point_x, sectors.points.size(),
+        [&](std::size_t i) { return float_bits(sectors.points[i].x); });
+    out.put_section(level_section::sector_point_y, sectors.points.size(),
+        [&](std::size_t i) { return float_bits(sectors.points[i].y); });
+    out.put_section(level_section::sector_neighbours,
+        sectors.neighbours.size(),
+        [&](std::size_t i) { return sectors.neighbours[i]; });
+    out.put_section(level_section::sector_wall_offsets,
+        sectors.wall_offsets.size(),
+        [&](std::size_t i) { return sectors.wall_offsets[i]; });
+    out.put_section(level_section::sector_wall_indices,
+        sectors.wall_indices.size(),
+        [&](std::size_t i) { return sectors.wall_indices[i]; });
+
+    auto const& pvs = lvl.pvs;
+    if (!pvs.empty()) {
+        std::uint32_t const info[] = {pvs.wall_count,
+            static_cast<std::uint32_t>(pvs.wall_runs.size()),
+            static_cast<std::uint32_t>(pvs.cell_runs.size())};
+        out.put_section(level_section::pvs_info, 3,
+            [&](std::size_t i) { return info[i]; });
+    }
+    out.put_section(level_section::pvs_wall_offsets, pvs.wall_offsets.size(),
+        [&](std::size_t i) { return pvs.wall_offsets[i]; });
+    auto const wall_runs = pack_bytes(pvs.wall_runs);
+    out.put_section(level_section::pvs_wall_runs, wall_runs.size(),
+        [&](std::size_t i) { return wall_runs[i]; });
+    out.put_section(level_section::pvs_cell_offsets, pvs.cell_offsets.size(),
+        [&](std::size_t i) { return pvs.cell_offsets[i]; });
+    auto const cell_runs = pack_bytes(pvs.cell_runs);
+    out.put_section(level_section::pvs_cell_runs, cell_runs.size(),
+        [&](std::size_t i) { return cell_runs[i]; });
+
+    auto file = std::fopen(filename.c_str(), "wb");
+    if (!file) {
+        throw std::runtime_error{"Couldn't open for writing: "s + filename};
+    }
+    auto const& bytes = out.bytes();
+    auto const written = std::fwrite(bytes.data(), 1, bytes.size(), file);
+    auto const closed = std::fclose(file) == 0;
+    if (written != bytes.size() || !closed) {
+        throw std::runtime_error{"Failed writing "s + filename};
+    }
+}
+
+std::unique_ptr<level> load_level_binary(std::string const& filename)
+{
+    sdl_app::mapped_file const mapping{filename};
+    return load_level_binary(mapping.data(), mapping.size(), filename);
+}
+
+std::unique_ptr<level> load_level_binary(
+    std::uint8_t const* data, std::size_t size, std::string const& filename)
+{
+    auto const file = byte_span{data, size};
+
+    if (file.size() < header_size
+        || std::memcmp(file.data(), magic, sizeof(magic)) != 0) {
+        throw std::runtime_error{"Not a compiled level: "s + filename};
+    }
+
+    auto const header = [&file](std::size_t word) {
+        return file.data() + word * sizeof(std::uint32_t);
+    };
+
+    auto const version = read_u32(header(1));
+    if (version != level_binary_version) {
+        throw std::runtime_error{"Unsupported level version "s
+            + std::to_string(version) + " in " + filename};
+    }
+    if (read_u32(header(2)) != section_count) {
+        throw std::runtime_error{"Unexpected section count in "s + filename};
+    }
+
+    auto new_level = std::make_unique<level>();
+    new_level->player_start
+        = point2f{read_f32(header(3)), read_f32(header(4))};
+
+    //
+    // walls
+    //
+
+    auto const x1 = get_section(file, level_section::wall_x1, filename);
+    auto const y1 = get_section(file, level_section::wall_y1, filename);
+    auto const x2 = get_section(file, level_section::wall_x2, filename);
+    auto const y2 = get_section(file, level_section::wall_y2, filename);
+    auto const texture
+        = get_section(file, level_section::wall_texture, filename);
+    auto const length = get_section(file, level_section::wall_length, filename);
+    auto const nx = get_section(file, level_section::wall_normal_x, filename);
+    auto const ny = get_section(file, level_section::wall_normal_y, filename);
+
+    auto const n_walls = x1.count;
+    for (auto const& s : {y1, x2, y2, texture, length, nx, ny}) {
+        if (s.count != n_walls) {
+            throw std::runtime_error{"Mismatched wall arrays in "s + filename};
+        }
+    }
+
+    new_level->walls.resize(n_walls);
+    for (std::uint32_t i = 0; i < n_walls; ++i) {
+        auto& w = new_level->walls[i];
+        w.data = line2f{{x1.f32(i), y1.f32(i)}, {x2.f32(i), y2.f32(i)}};
+        w.texture = texture.u32(i);
+        w.length = length.f32(i);
+        w.normal = point2f{nx.f32(i), ny.f32(i)};
+    }
+
+    //
+    // sprites
+    //
+
+    auto const sx = get_section(file, level_section::sprite_x, filename);
+    auto const sy = get_section(file, level_section::sprite_y, filename);
+    auto const stex
+        = get_section(file, level_section::sprite_texture, filename);
+    if (sy.count != sx.count || stex.count != sx.count) {
+        throw std::runtime_error{"Mismatched sprite arrays in "s + filename};
+    }
+
+    new_level->sprites.reserve(sx.count);
+    for (std::uint32_t i = 0; i < sx.count; ++i) {
+        new_level->sprites.spawn({sx.f32(i), sy.f32(i)}, stex.u32(i));
+    }
+
+    //
+    // grid
+    //
+
+    auto& grid = new_level->grid;
+    grid.origin = point2f{read_f32(header(5)), read_f32(header(6))};
+    grid.cell_size = read_f32(header(7));
+    // Checked as 64-bit before anything is an int, so the cell count can't
+    // wrap around
+    auto const width = read_u32(header(8));
+    auto const height = read_u32(header(9));
+    auto const cell_count = std::uint64_t{width} * height;
+
+    auto const offsets
+        = get_section(file, level_section::grid_cell_offsets, filename);
+    auto const indices
+        = get_section(file, level_section::grid_wall_indices, filename);
+    auto const max_cells = static_cast<std::uint64_t>(wall_grid::max_cells);
+    if (width > max_cells || height > max_cells || cell_count > max_cells
+        || !(grid.cell_size > 0.f) || offsets.count != cell_count + 1) {
+        throw std::runtime_error{"Corrupt wall grid in "s + filename};
+    }
+    grid.width = static_cast<int>(width);
+    grid.height = static_cast<int>(height);
+
+    grid.cell_offsets.resize(offsets.count);
+    for (std::uint32_t i = 0; i < offsets.count; ++i) {
+        grid.cell_offsets[i] = offsets.u32(i);
+        if (grid.cell_offsets[i] > indices.count
+            || (i > 0 && grid.cell_offsets[i] < grid.cell_offsets[i - 1])) {
+            throw std::runtime_error{"Corrupt wall grid in "s + filename};
+        }
+    }
+    grid.wall_indices.resize(indices.count);
+    for (std::uint32_t i = 0; i < indices.count; ++i) {
+        grid.wall_indices[i] = indices.u32(i);
+        if (grid.wall_indices[i] >= n_walls) {
+            throw std::runtime_error{"Corrupt wall grid in "s + filename};
+        }
+    }
+    if (grid.cell_offsets.back() != indices.count) {
+        throw std::runtime_error{"Corrupt wall grid in "s + filename};
+    }
+
+    //
+    // textures
+    //
+
+    auto const names
+        = get_section(file, level_section::texture_names, filename);
+    if (names.count < 1) {
+        throw std::runtime_error{"Corrupt texture table in "s + filename};
+    }
+    auto const name_count = names.u32(0);
+    auto name = reinterpret_cast<char const*>(names.data) + 4;
+    auto const names_end = reinterpret_cast<char const*>(names.data)
+        + static_cast<std::size_t>(names.count) * 4;
+    for (std::uint32_t i = 0; i < name_count; ++i) {
+        auto const terminator = std::find(name, names_end, '\0');
+        if (terminator == names_end) {
+            throw std::runtime_error{"Corrupt texture table in "s + filename};
+        }
+        new_level->texture_names.emplace_back(name, terminator);
+        name = terminator + 1;
+    }
+
+    auto const floor_ceiling
+        = get_section(file, level_section::floor_ceiling_texture, filename);
+    if (floor_ceiling.count != 2) {
+        throw std::runtime_error{"Corrupt texture table in "s + filename};
+    }
+    new_level->floor_texture = floor_ceiling.u32(0);
+    new_level->ceiling_texture = floor_ceiling.u32(1);
+
+    //
+    // sectors
+    //
+
+    read_sectors(file, filename, n_walls, new_level->sectors);
+
+    //
+    // PVS
+    //
+
+    // The cell count was checked against max_cells with the grid
+    read_pvs(file, filename, n_walls, static_cast<std::uint32_t>(cell_count),
+        new_level->pvs);
+
+    return new_level;
+}
+
+} // namespace raycaster
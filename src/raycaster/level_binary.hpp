@@ -0,0 +1,100 @@
+/// @file level_binary.hpp
+/// @brief Compiled binary levels.
+///
+/// Running a level script and walking its tables is slow for big maps and
+/// needs a Lua state. The level compiler (see src/level_compiler) does that
+/// once, offline, and writes the result in a form that can be memory-mapped
+/// and read directly.
+///
+/// Layout (every field is 4 bytes, little-endian):
+///
+///     magic           "RCLV"
+///     version         level_binary_version
+///     section_count   number of entries in the section table
+///     player_start    x, y (float)
+///     grid            origin x, origin y, cell size (float), width, height
+///     section table   {offset, count} per level_section, in enum order
+///     ...sections...
+///
+/// Each section is a flat array of `count` 4-byte elements starting at
+/// `offset` bytes from the start of the file. Walls and sprites are stored
+/// as structure-of-arrays, one section per field. The wall grid is stored
+/// in its CSR form, so it doesn't need to be rebuilt on load.
+///
+/// The `texture_names` section starts with the number of names, followed by
+/// that many NUL-terminated strings in texid order, packed into its 4-byte
+/// elements (and padded with zeros). The floor and ceiling texids are the two elements of
+/// `floor_ceiling_texture`.
+///
+/// Sectors are stored like sector_map: `sector_point_offsets` has one more
+/// element than there are sectors (none if the level has no sectors), and
+/// the points, neighbours and wall lists are indexed through the offsets.
+///
+/// The PVS (see pvs.hpp), if there is one, has one more wall and cell offset
+/// than the grid has cells. The run-length coded sets are bytes, packed into
+/// the 4-byte elements of `pvs_wall_runs`/`pvs_cell_runs` like the texture
+/// names; `pvs_info` holds the number of walls the sets cover and the byte
+/// lengths of the two run arrays. Levels without a PVS have empty sections.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace raycaster {
+
+struct level;
+
+constexpr auto level_binary_extension = ".rclv";
+constexpr std::uint32_t level_binary_version = 4;
+
+enum class level_section : std::uint32_t {
+    wall_x1,
+    wall_y1,
+    wall_x2,
+    wall_y2,
+    wall_texture,
+    wall_length,
+    wall_normal_x,
+    wall_normal_y,
+    sprite_x,
+    sprite_y,
+    sprite_texture,
+    grid_cell_offsets,
+    grid_wall_indices,
+    texture_names,
+    floor_ceiling_texture,
+    sector_point_offsets,
+    sector_point_x,
+    sector_point_y,
+    sector_neighbours,
+    sector_wall_offsets,
+    sector_wall_indices,
+    pvs_info,
+    pvs_wall_offsets,
+    pvs_wall_runs,
+    pvs_cell_offsets,
+    pvs_cell_runs,
+    count,
+};
+
+/// Serialize a level (including its wall grid) to `filename`. The level's
+/// textures must not be bound yet.
+///
+/// @throws std::runtime_error on I/O failure
+void save_level_binary(level const& lvl, std::string const& filename);
+
+/// Memory-map and load a compiled level.
+///
+/// @throws std::runtime_error if the file is missing, truncated, or from an
+/// unsupported version
+std::unique_ptr<level> load_level_binary(std::string const& filename);
+
+/// Load a compiled level that's already in memory (e.g. in an asset pack).
+/// `filename` is only used for error messages.
+std::unique_ptr<level> load_level_binary(
+    std::uint8_t const* data, std::size_t size, std::string const& filename);
+
+} // namespace raycaster
@@ -0,0 +1,200 @@
+#include "level_loader.hpp"
+
+#include <lua_raii/lua_raii.hpp>
+
+#include <SDL.h>
+
+#include <algorithm>
+#include <exception>
+
+namespace raycaster {
+
+level_loader::level_loader(texture_registry& textures,
+    std::shared_ptr<sdl_app::asset_pack const> pack, std::size_t cache_capacity)
+: _textures{textures}
+, _pack{std::move(pack)}
+, _cache_capacity{std::max<std::size_t>(cache_capacity, 1)}
+{
+    _worker = std::thread([this] { worker_main(); });
+}
+
+level_loader::~level_loader()
+{
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        _stopping = true;
+    }
+    _wake_worker.notify_one();
+    _worker.join();
+}
+
+void level_loader::preload(std::string const& filename)
+{
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        auto existing = find(filename);
+        if (existing && existing->state != status::failed) {
+            return;
+        }
+
+        if (existing) {
+            existing->state = status::loading;
+            existing->error.clear();
+        } else {
+            _cache.push_front(entry{filename, status::loading, nullptr, {}});
+            evict();
+        }
+        _requests.push_back(request{filename, false, {}});
+    }
+    _wake_worker.notify_one();
+}
+
+level_loader::status level_loader::get_status(std::string const& filename)
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+    auto existing = find(filename);
+    return existing ? existing->state : status::unknown;
+}
+
+std::string level_loader::get_error(std::string const& filename)
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+    auto existing = find(filename);
+    return existing ? existing->error : std::string{};
+}
+
+std::unique_ptr<level> level_loader::take(std::string const& filename)
+{
+    std::shared_ptr<level const> loaded;
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        auto existing = find(filename);
+        if (!existing || existing->state != status::ready) {
+            return nullptr;
+        }
+        if (existing->copy) {
+            return std::move(existing->copy);
+        }
+        if (existing->copying) {
+            return nullptr;
+        }
+        existing->copying = true;
+        loaded = existing->loaded;
+    }
+
+    // The textures were staged while loading, so this doesn't touch the
+    // disk. The cached level is never modified, so no need for the lock.
+    auto handles = acquire_textures(*loaded, _textures);
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        _requests.push_back(request{filename, true, std::move(handles)});
+    }
+    _wake_worker.notify_one();
+    return nullptr;
+}
+
+level_loader::entry* level_loader::find(std::string const& filename)
+{
+    auto it = std::find_if(_cache.begin(), _cache.end(),
+        [&filename](entry const& e) { return e.filename == filename; });
+    if (it == _cache.end()) {
+        return nullptr;
+    }
+    _cache.splice(_cache.begin(), _cache, it);
+    return &_cache.front();
+}
+
+void level_loader::evict()
+{
+    // Never evict something that's still loading; the worker will look for it
+    auto it = _cache.end();
+    while (_cache.size() > _cache_capacity && it != _cache.begin()) {
+        --it;
+        if (it->state != status::loading) {
+            SDL_Log("level_loader: evicting %s", it->filename.c_str());
+            it = _cache.erase(it);
+        }
+    }
+}
+
+void level_loader::worker_main()
+{
+    // Lua states aren't thread safe, so the worker gets its own
+    auto L = lua::make_state();
+
+    while (true) {
+        request job;
+        {
+            std::unique_lock<std::mutex> lock{_mutex};
+            _wake_worker.wait(
+                lock, [this] { return _stopping || !_requests.empty(); });
+            if (_stopping) {
+                break;
+            }
+            job = std::move(_requests.front());
+            _requests.pop_front();
+        }
+
+        if (job.copy) {
+            copy(job);
+        } else {
+            load(job.filename, L.get());
+        }
+    }
+}
+
+void level_loader::load(std::string const& filename, lua_State* L)
+{
+    std::shared_ptr<level const> loaded;
+    std::string error;
+    try {
+        auto new_level = load_level(filename, L, _pack.get());
+        _textures.stage_all(new_level->texture_names, _decode_pool);
+        loaded = std::move(new_level);
+    } catch (std::exception const& e) {
+        error = e.what();
+        SDL_Log("level_loader: failed to load %s: %s", filename.c_str(),
+            e.what());
+    }
+    // Don't let a failed script leave junk behind for the next one
+    lua_settop(L, 0);
+
+    std::lock_guard<std::mutex> lock{_mutex};
+    auto existing = find(filename);
+    if (!existing) {
+        // Evicted while loading (shouldn't happen, see evict)
+        return;
+    }
+    existing->state = loaded ? status::ready : status::failed;
+    existing->loaded = std::move(loaded);
+    existing->error = std::move(error);
+    existing->copy.reset();
+    existing->copying = false;
+    evict();
+}
+
+void level_loader::copy(request const& job)
+{
+    std::shared_ptr<level const> loaded;
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        auto existing = find(job.filename);
+        if (!existing || !existing->copying) {
+            return;
+        }
+        loaded = existing->loaded;
+    }
+
+    auto copy = std::make_unique<level>(*loaded);
+    bind_textures(*copy, job.handles);
+
+    std::lock_guard<std::mutex> lock{_mutex};
+    auto existing = find(job.filename);
+    // Unless it was evicted, or loaded again, in the meantime
+    if (existing && existing->copying && existing->loaded == loaded) {
+        existing->copy = std::move(copy);
+        existing->copying = false;
+    }
+}
+
+} // namespace raycaster
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "level.hpp"
+#include "texture_registry.hpp"
+
+#include <sdl_application/asset_pack.hpp>
+#include <sdl_application/thread_pool.hpp>
+
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace raycaster {
+
+/// Loads levels on a worker thread so switching maps doesn't freeze the game.
+///
+/// The level's textures are decoded on the worker too, in parallel (see
+/// texture_registry::stage_all), so the switch itself doesn't hit the disk.
+///
+/// Finished levels are kept in a small LRU cache. Handing one out makes a
+/// copy (sprites are mutated during play), so going back to a recently played
+/// map starts it fresh without parsing it again. The copy is made, and its
+/// textures bound, on the worker too, so the switch only moves it into play.
+class level_loader {
+public:
+    enum class status {
+        unknown,
+        loading,
+        ready,
+        failed,
+    };
+
+    explicit level_loader(texture_registry& textures,
+        std::shared_ptr<sdl_app::asset_pack const> pack = nullptr,
+        std::size_t cache_capacity = 4);
+    ~level_loader();
+
+    level_loader(level_loader const& other) = delete;
+    level_loader(level_loader&& other) = delete;
+    level_loader& operator=(level_loader const& other) = delete;
+    level_loader& operator=(level_loader&& other) = delete;
+
+    /// Start loading `filename` in the background. Does nothing if it's
+    /// already loaded or loading. Failed loads are retried.
+    void preload(std::string const& filename);
+
+    status get_status(std::string const& filename);
+
+    /// @return Why `filename` failed to load, or an empty string
+    std::string get_error(std::string const& filename);
+
+    /// Take a copy of a loaded level, with its textures bound. The first
+    /// call for a level that's ready starts making the copy on the worker,
+    /// and returns nullptr; call again on a later frame. Main thread only.
+    ///
+    /// @return The copy, or nullptr if it isn't made yet
+    std::unique_ptr<level> take(std::string const& filename);
+
+private:
+    struct entry {
+        std::string filename;
+        status state;
+        std::shared_ptr<level const> loaded;
+        std::string error;
+        /// A copy of `loaded` for take() to hand out, once the worker made
+        /// it
+        std::unique_ptr<level> copy;
+        bool copying = false;
+    };
+
+    /// A job for the worker
+    struct request {
+        std::string filename;
+        /// Copy the loaded level, instead of loading it
+        bool copy;
+        /// For the copy's textures
+        std::vector<texture_handle> handles;
+    };
+
+    /// Must hold _mutex. Moves the entry to the front (most recently used).
+    entry* find(std::string const& filename);
+    /// Must hold _mutex.
+    void evict();
+    void worker_main();
+    void load(std::string const& filename, lua_State* L);
+    void copy(request const& job);
+
+    texture_registry& _textures;
+    std::shared_ptr<sdl_app::asset_pack const> const _pack;
+    sdl_app::thread_pool _decode_pool;
+    std::size_t const _cache_capacity;
+
+    std::mutex _mutex;
+    std::condition_variable _wake_worker;
+    std::deque<request> _requests;
+    /// Most recently used first
+    std::list<entry> _cache;
+    bool _stopping = false;
+
+    std::thread _worker;
+};
+
+} // namespace raycaster
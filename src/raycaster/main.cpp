@@ -2,28 +2,114 @@
 #include "level.hpp"
 #include "pipeline.hpp"
 #include "raycaster_app.hpp"
-#include "texture_cache.hpp"
+#include "texture_registry.hpp"
 
 #include <lua_raii/lua_raii.hpp>
 #include <mymath/mymath.hpp>
+#include <sdl_application/asset_pack.hpp>
 #include <sdl_application/asset_store.hpp>
+#include <sdl_application/input_recording.hpp>
 #include <sdl_application/sdl_mymath.hpp>
 #include <sdl_raii/sdl_raii.hpp>
 
 #include <SDL.h>
 
 #include <cstdint>
+#include <cstdio>
 #include <iostream>
 #include <stdexcept>
+#include <string>
 #include <vector>
 
 using namespace mymath;
 using namespace raycaster;
 using namespace sdl_app;
 
+namespace {
+
+constexpr auto assets_dir = "../assets";
+constexpr auto main_script = "lua/main.lua";
+
+double elapsed_ms(Uint64 since)
+{
+    return (SDL_GetPerformanceCounter() - since) * 1000.0
+        / SDL_GetPerformanceFrequency();
+}
+
+/// @return The value given for `--name` on the command line, or an empty
+/// string
+std::string get_option(int argc, char** argv, std::string const& name)
+{
+    std::string value;
+    for (auto i = 1; i + 1 < argc; ++i) {
+        if (argv[i] == name) {
+            value = argv[i + 1];
+        }
+    }
+    return value;
+}
+
+/// Open and validate the pack given with `--pack`, if any.
+std::shared_ptr<asset_pack const> open_asset_pack(int argc, char** argv)
+{
+    auto const pack_path = get_option(argc, argv, "--pack");
+    if (pack_path.empty()) {
+        return nullptr;
+    }
+
+    auto const start = SDL_GetPerformanceCounter();
+    auto pack = std::make_shared<asset_pack const>(pack_path, assets_dir);
+
+    thread_pool pool;
+    auto const failed = pack->validate(pool);
+    for (auto const& name : failed) {
+        SDL_Log("Corrupt entry in %s: %s", pack_path.c_str(), name.c_str());
+    }
+    if (!failed.empty()) {
+        throw std::runtime_error{"Corrupt asset pack: " + pack_path};
+    }
+
+    SDL_Log("Validated %u assets in %s on %u threads in %.3f ms",
+        static_cast<unsigned>(pack->entries().size()), pack_path.c_str(),
+        pool.size(), elapsed_ms(start));
+    return pack;
+}
+
+/// Seed `math.random`, so a recorded run can be replayed with the same
+/// random numbers.
+void seed_lua_random(lua_State* L, std::uint32_t seed)
+{
+    lua_getglobal(L, "math");
+    lua_getfield(L, -1, "randomseed");
+    lua_pushinteger(L, static_cast<lua_Integer>(seed));
+    if (lua_pcall(L, 1, 0, 0)) {
+        SDL_Log("Failed to seed math.random!");
+        throw std::runtime_error{lua::to<std::string>(L)};
+    }
+    lua_pop(L, 1); // math
+}
+
+/// Run main.lua, from the pack if it has it.
+void run_main_script(lua_State* L, asset_pack const* pack)
+{
+    auto const packed = pack ? pack->find(main_script) : nullptr;
+    auto const failed = packed
+        ? luaL_loadbuffer(L, reinterpret_cast<char const*>(packed->data),
+              packed->size, main_script)
+            || lua_pcall(L, 0, LUA_MULTRET, 0)
+        : luaL_dofile(L, (std::string{assets_dir} + "/" + main_script).c_str());
+    if (failed) {
+        SDL_Log("Failed to load main.lua!");
+        throw std::runtime_error{lua::to<std::string>(L)};
+    }
+}
+
+} // namespace
+
 int main(int argc, char** argv)
 {
     SDL_Log("Starting application main...");
+    auto const startup_begin = SDL_GetPerformanceCounter();
     auto sdl = std::make_shared<sdl::sdl_init>();
 
     // Text input, for some reason, might be active right after init. Bad! Turn
@@ -33,12 +119,26 @@ int main(int argc, char** argv)
         SDL_Log("Text input was active on init, turn off");
     }
 
+    // `--window WxH` for the starting size. The window can be resized after.
     auto const window_title = "Raycaster";
-    SDL_Point const window_bounds{640, 360};
-    auto window = sdl::make_window(window_title, window_bounds);
+    SDL_Point window_bounds{640, 360};
+    auto const window_size = get_option(argc, argv, "--window");
+    if (!window_size.empty()) {
+        auto const parsed = std::sscanf(window_size.c_str(), "%dx%d",
+            &window_bounds.x, &window_bounds.y);
+        if (parsed != 2 || window_bounds.x <= 0 || window_bounds.y <= 0) {
+            SDL_Log("--window takes a size like 1920x1080, got %s",
+                window_size.c_str());
+            return 1;
+        }
+    }
+    auto window = sdl::make_window(
+        window_title, window_bounds, SDL_WINDOW_RESIZABLE);
 
     // Create asset manager and preload assets
-    auto assets = std::make_unique<asset_store>("../assets");
+    auto const pack = open_asset_pack(argc, argv);
+    auto assets = std::make_unique<asset_store>(assets_dir);
+    assets->mount(pack);
 
     auto L = lua::make_state();
 
@@ -52,17 +152,46 @@ int main(int argc, char** argv)
 
     auto input = std::make_unique<sdl_app::input_buffer>();
 
-    auto pipeline = std::make_unique<raycaster::render_pipeline>(
-        make_texture_cache(*assets));
+    auto textures = std::make_unique<texture_registry>(assets_dir, pack);
 
-    if (luaL_dofile(L.get(), "../assets/lua/main.lua")) {
-        SDL_Log("Failed to load main.lua!");
-        throw std::runtime_error{lua::to<std::string>(L.get())};
+    auto pipeline = std::make_unique<raycaster::render_pipeline>(*textures);
+
+    // `--timedemo` replays as fast as possible and reports the frame times
+    auto const record_path = get_option(argc, argv, "--record");
+    auto const timedemo_path = get_option(argc, argv, "--timedemo");
+    auto const replay_path = timedemo_path.empty()
+        ? get_option(argc, argv, "--replay")
+        : timedemo_path;
+    if (!record_path.empty() && !replay_path.empty()) {
+        SDL_Log("Can't record and replay input at the same time");
+        return 1;
     }
+    std::unique_ptr<input_recorder> recorder;
+    std::unique_ptr<input_player> player;
+    if (!record_path.empty()) {
+        recorder = std::make_unique<input_recorder>(record_path,
+            static_cast<std::uint32_t>(SDL_GetPerformanceCounter()));
+        seed_lua_random(L.get(), recorder->get_seed());
+    } else if (!replay_path.empty()) {
+        player = std::make_unique<input_player>(replay_path);
+        seed_lua_random(L.get(), player->get_seed());
+    }
+
+    run_main_script(L.get(), pack.get());
 
     SDL_Log("Creating raycaster_app...");
     raycaster_app app{std::move(sdl), std::move(window), std::move(input),
-        std::move(assets), std::move(pipeline), std::move(L), cam};
+        std::move(assets), std::move(textures), std::move(pipeline),
+        std::move(L), cam};
+    if (recorder) {
+        SDL_Log("Recording input to %s", record_path.c_str());
+        app.record_input(std::move(recorder));
+    }
+    if (player) {
+        SDL_Log("Replaying input from %s", replay_path.c_str());
+        app.replay_input(std::move(player), !timedemo_path.empty());
+    }
+    SDL_Log("Startup took %.3f ms", elapsed_ms(startup_begin));
     SDL_Log("Running app...");
     try {
         app.exec();
@@ -0,0 +1,244 @@
+#include "palette.hpp"
+
+#include <SDL.h>
+
+#include <limits>
+
+using namespace mycolor;
+
+namespace {
+
+using namespace raycaster;
+
+constexpr auto max_opaque_colors = palette_size - 1;
+/// Bits kept per channel by the histogram and the inverse table
+constexpr auto key_bits = 5;
+constexpr auto key_count = 1 << (3 * key_bits);
+constexpr auto channel_levels = 1 << key_bits;
+
+constexpr packed_color transparent_color = pack(color{255, 0, 255});
+constexpr packed_color black = pack(constants::black);
+
+std::uint32_t make_key(std::uint8_t r, std::uint8_t g, std::uint8_t b)
+{
+    constexpr auto shift = 8 - key_bits;
+    return static_cast<std::uint32_t>(r >> shift) << (2 * key_bits)
+        | static_cast<std::uint32_t>(g >> shift) << key_bits | (b >> shift);
+}
+
+/// Calls `visit(r, g, b)` for every opaque texel of a BGR24 surface
+template <typename Visitor>
+void for_each_opaque_texel(SDL_Surface* surf, Visitor&& visit)
+{
+    for (auto y = 0; y < surf->h; ++y) {
+        auto const row
+            = static_cast<std::uint8_t const*>(surf->pixels) + y * surf->pitch;
+        for (auto x = 0; x < surf->w; ++x) {
+            auto const texel = row + x * 3;
+            if (!same_rgb(pack(color{texel[2], texel[1], texel[0]}),
+                    transparent_color)) {
+                visit(texel[2], texel[1], texel[0]);
+            }
+        }
+    }
+}
+
+/// Every texel that fell in one histogram bin
+struct color_bin {
+    std::uint8_t channels[3];
+    std::uint32_t count = 0;
+    std::uint64_t sums[3] = {0, 0, 0};
+};
+
+/// A range of bins that becomes one palette entry
+struct color_box {
+    std::size_t begin;
+    std::size_t end;
+    int axis = 0;
+    int extent = 0;
+};
+
+void measure(std::vector<color_bin> const& bins, color_box& box)
+{
+    box.extent = -1;
+    for (auto axis = 0; axis < 3; ++axis) {
+        auto lowest = channel_levels;
+        auto highest = -1;
+        for (auto i = box.begin; i < box.end; ++i) {
+            lowest = std::min<int>(lowest, bins[i].channels[axis]);
+            highest = std::max<int>(highest, bins[i].channels[axis]);
+        }
+        if (highest - lowest > box.extent) {
+            box.extent = highest - lowest;
+            box.axis = axis;
+        }
+    }
+}
+
+} // namespace
+
+namespace raycaster {
+
+palette::palette(std::vector<packed_color> const& colors)
+{
+    _colors.fill(black);
+    _colors[transparent_index] = transparent_color;
+    auto const count = std::min<std::size_t>(colors.size(), max_opaque_colors);
+    std::copy(colors.begin(), colors.begin() + count, _colors.begin() + 1);
+    // Black rather than nothing at all
+    auto const last = std::max<std::size_t>(count, 1);
+
+    _inverse.resize(key_count);
+    for (std::uint32_t key = 0; key < key_count; ++key) {
+        // The middle of the bin
+        auto const r
+            = static_cast<int>(((key >> (2 * key_bits)) << 3) | 4);
+        auto const g
+            = static_cast<int>((((key >> key_bits) & (channel_levels - 1)) << 3)
+                | 4);
+        auto const b
+            = static_cast<int>(((key & (channel_levels - 1)) << 3) | 4);
+
+        auto best = std::numeric_limits<int>::max();
+        for (std::size_t i = 1; i <= last; ++i) {
+            auto const c = unpack(_colors[i]);
+            auto const dr = r - c.r;
+            auto const dg = g - c.g;
+            auto const db = b - c.b;
+            auto const distance = dr * dr + dg * dg + db * db;
+            if (distance < best) {
+                best = distance;
+                _inverse[key] = static_cast<std::uint8_t>(i);
+            }
+        }
+    }
+
+    _shades.resize(shade_levels * palette_size);
+    for (auto level = 0; level < shade_levels; ++level) {
+        auto const weight = level * weight_one / (shade_levels - 1);
+        for (auto i = 0; i < palette_size; ++i) {
+            _shades[level * palette_size + i]
+                = linear_interpolate(_colors[i], black, weight);
+        }
+    }
+}
+
+std::uint8_t palette::find_nearest(packed_color c) const
+{
+    auto const rgb = unpack(c);
+    return _inverse[make_key(rgb.r, rgb.g, rgb.b)];
+}
+
+std::size_t palette::memory_usage() const
+{
+    return sizeof(*this) + _inverse.size()
+        + _shades.size() * sizeof(packed_color);
+}
+
+palette build_palette(std::vector<SDL_Surface*> const& textures)
+{
+    std::vector<color_bin> histogram(key_count);
+    for (auto const surf : textures) {
+        for_each_opaque_texel(surf, [&](std::uint8_t r, std::uint8_t g,
+                                        std::uint8_t b) {
+            auto& bin = histogram[make_key(r, g, b)];
+            ++bin.count;
+            bin.sums[0] += r;
+            bin.sums[1] += g;
+            bin.sums[2] += b;
+        });
+    }
+
+    std::vector<color_bin> bins;
+    for (std::uint32_t key = 0; key < key_count; ++key) {
+        if (histogram[key].count == 0) {
+            continue;
+        }
+        auto bin = histogram[key];
+        bin.channels[0] = static_cast<std::uint8_t>(key >> (2 * key_bits));
+        bin.channels[1]
+            = static_cast<std::uint8_t>((key >> key_bits) & (channel_levels - 1));
+        bin.channels[2] = static_cast<std::uint8_t>(key & (channel_levels - 1));
+        bins.push_back(bin);
+    }
+
+    // Keep splitting the box that spans the most along some channel, at the
+    // median texel along it
+    std::vector<color_box> boxes;
+    if (!bins.empty()) {
+        boxes.push_back(color_box{0, bins.size()});
+        measure(bins, boxes.back());
+    }
+    while (boxes.size() < max_opaque_colors) {
+        auto widest = boxes.end();
+        for (auto it = boxes.begin(); it != boxes.end(); ++it) {
+            if (it->end - it->begin > 1
+                && (widest == boxes.end() || it->extent > widest->extent)) {
+                widest = it;
+            }
+        }
+        if (widest == boxes.end()) {
+            break;
+        }
+
+        auto const axis = widest->axis;
+        std::sort(bins.begin() + widest->begin, bins.begin() + widest->end,
+            [axis](color_bin const& a, color_bin const& b) {
+                return a.channels[axis] < b.channels[axis];
+            });
+        std::uint64_t total = 0;
+        for (auto i = widest->begin; i < widest->end; ++i) {
+            total += bins[i].count;
+        }
+        auto split = widest->begin + 1;
+        for (std::uint64_t below = bins[widest->begin].count;
+             split < widest->end - 1 && below * 2 < total; ++split) {
+            below += bins[split].count;
+        }
+
+        auto upper = color_box{split, widest->end};
+        widest->end = split;
+        measure(bins, *widest);
+        measure(bins, upper);
+        boxes.push_back(upper);
+    }
+
+    std::vector<packed_color> colors;
+    for (auto const& box : boxes) {
+        std::uint64_t count = 0;
+        std::uint64_t sums[3] = {0, 0, 0};
+        for (auto i = box.begin; i < box.end; ++i) {
+            count += bins[i].count;
+            for (auto axis = 0; axis < 3; ++axis) {
+                sums[axis] += bins[i].sums[axis];
+            }
+        }
+        colors.push_back(pack(color{static_cast<std::uint8_t>(sums[0] / count),
+            static_cast<std::uint8_t>(sums[1] / count),
+            static_cast<std::uint8_t>(sums[2] / count)}));
+    }
+    return palette{colors};
+}
+
+indexed_texture quantize(SDL_Surface* surf, palette const& pal)
+{
+    indexed_texture texture;
+    texture.width = surf->w;
+    texture.height = surf->h;
+    texture.texels.resize(static_cast<std::size_t>(surf->w) * surf->h);
+
+    for (auto y = 0; y < surf->h; ++y) {
+        auto const row
+            = static_cast<std::uint8_t const*>(surf->pixels) + y * surf->pitch;
+        for (auto x = 0; x < surf->w; ++x) {
+            auto const texel = row + x * 3;
+            auto const c = pack(color{texel[2], texel[1], texel[0]});
+            texture.texels[x * surf->h + y] = same_rgb(c, transparent_color)
+                ? transparent_index
+                : pal.find_nearest(c);
+        }
+    }
+    return texture;
+}
+
+} // namespace raycaster
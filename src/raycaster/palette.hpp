@@ -0,0 +1,98 @@
+/// @file palette.hpp
+/// @brief 8-bit indexed textures sharing one palette.
+///
+/// Truecolor textures take 3 bytes a texel, while the art only uses a few
+/// hundred colors between all of it. Indexed textures take 1 byte a texel,
+/// so three times as many fit in the cache, and index 0 marks transparent
+/// texels instead of comparing every texel against magenta.
+///
+/// Fog is a lookup too: the palette keeps every color pre-blended towards
+/// black at `shade_levels` distances, so shading a texel is one table read
+/// rather than a blend.
+
+#pragma once
+
+#include <mycolor/packed_color.hpp>
+#include <mymath/mymath.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct SDL_Surface;
+
+namespace raycaster {
+
+/// Palette index of transparent texels. Its color is magenta, like the
+/// truecolor textures' transparent color.
+constexpr std::uint8_t transparent_index = 0;
+constexpr auto palette_size = 256;
+/// Fog levels in the shading table, from none to black
+constexpr auto shade_levels = 32;
+
+/// @return The shading table level for a fog weight (see
+/// mycolor::to_weight(), 0 is no fog)
+constexpr unsigned shade_level(std::uint32_t fog_weight)
+{
+    return (std::min(fog_weight, mycolor::weight_one) * (shade_levels - 1)
+               + mycolor::weight_one / 2)
+        / mycolor::weight_one;
+}
+
+class palette {
+public:
+    /// @param colors The colors of indices 1 and up; at most 255 are used
+    explicit palette(std::vector<mycolor::packed_color> const& colors);
+
+    mycolor::packed_color get_color(std::uint8_t index) const
+    {
+        return _colors[index];
+    }
+
+    /// `get_color(index)` fogged to `level` (see shade_level())
+    mycolor::packed_color get_shaded(unsigned level, std::uint8_t index) const
+    {
+        return _shades[level * palette_size + index];
+    }
+
+    /// @return The opaque index closest to `c`, never transparent_index
+    std::uint8_t find_nearest(mycolor::packed_color c) const;
+
+    /// @return Bytes taken by the colors and lookup tables
+    std::size_t memory_usage() const;
+
+private:
+    std::array<mycolor::packed_color, palette_size> _colors;
+    /// Nearest index for every color at 5 bits per channel
+    std::vector<std::uint8_t> _inverse;
+    /// `shade_levels` rows of `palette_size` colors
+    std::vector<mycolor::packed_color> _shades;
+};
+
+/// A texture as palette indices.
+struct indexed_texture {
+    int width = 0;
+    int height = 0;
+    /// Column-major, so drawing a wall column reads one contiguous run
+    std::vector<std::uint8_t> texels;
+
+    /// Same addressing as sdl_app::get_packed_pixel()
+    std::uint8_t get(mymath::point2f const& uv) const
+    {
+        auto const x = static_cast<int>(uv.x * width);
+        auto const y = static_cast<int>(uv.y * height);
+        return texels[x * height + y];
+    }
+};
+
+/// Median cut over the opaque texels of `textures`, so colors used over
+/// more texels get more palette entries. The textures must be BGR24.
+palette build_palette(std::vector<SDL_Surface*> const& textures);
+
+/// Map every texel of `surf` (BGR24) to its nearest color in `pal`, and
+/// magenta to transparent_index.
+indexed_texture quantize(SDL_Surface* surf, palette const& pal);
+
+} // namespace raycaster
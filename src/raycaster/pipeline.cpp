@@ -5,85 +5,657 @@
 #include "level.hpp"
 
 #include <mycolor/mycolor.hpp>
+#include <mycolor/packed_color.hpp>
 #include <sdl_application/surface_manipulation.hpp>
 
 #include <SDL.h>
 
+#include <algorithm>
 #include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
 
 using namespace mymath;
 using namespace sdl_app;
-using namespace std::chrono_literals;
 
 namespace {
 
 constexpr float F_PI = static_cast<float>(M_PI);
-constexpr float PI_OVER_2 = M_PI / 2.f;
+
+/// Sprites always take up 1 unit, which means 0.5 on either side
+constexpr float sprite_half_width = 0.5f;
+
+/// Portals are clipped to this depth in front of the camera before they're
+/// projected, so ones right next to it still cover the right columns
+constexpr float min_portal_depth = 0.001f;
+/// The camera counts as standing in a portal when it's this close to it
+constexpr float portal_epsilon = 0.001f;
+/// Limits for levels with portal loops that never narrow the view
+constexpr unsigned max_portal_depth = 64;
+constexpr std::size_t max_visible_sectors = 4096;
 
 using namespace mycolor;
 
+/// HACK! Magenta is hardcoded as the translucent pixel.
+constexpr packed_color transparent = pack(color{255, 0, 255});
+constexpr packed_color black = pack(constants::black);
+
 // This function is only confirmed to work if the surface has a pixel format
-// that is in desired_framebuffer_formats.
-void set_surface_pixel(SDL_Surface& surf, int x, int y, color const& c)
+// that is in desired_framebuffer_formats. Both of those store a packed_color
+// as is, so this is one 32-bit store.
+void set_surface_pixel(SDL_Surface& surf, int x, int y, packed_color c)
+{
+    auto const index = y * surf.pitch + x * 4;
+    std::memcpy(static_cast<Uint8*>(surf.pixels) + index, &c.value, 4);
+}
+
+/// Look up the texel of `texture` at `uv` and fog it by `fog_weight`, going
+/// through the palette's shading table if textures are indexed.
+///
+/// @return false if the texel is transparent, in which case `out` is unset
+bool shade_texel(raycaster::texture_registry const& textures,
+    raycaster::palette const* pal, raycaster::texture_handle texture,
+    point2f const& uv, std::uint32_t fog_weight, packed_color& out)
+{
+    if (pal) {
+        auto const index = textures.get_indexed(texture).get(uv);
+        if (index == raycaster::transparent_index) {
+            return false;
+        }
+        out = pal->get_shaded(raycaster::shade_level(fog_weight), index);
+        return true;
+    }
+
+    auto const texel = get_packed_pixel(textures.get(texture), uv);
+    if (same_rgb(texel, transparent)) {
+        return false;
+    }
+    out = linear_interpolate(texel, black, fog_weight);
+    return true;
+}
+
+packed_color get_surface_pixel(SDL_Surface const& surf, int x, int y)
+{
+    packed_color c;
+    std::memcpy(&c.value,
+        static_cast<Uint8 const*>(surf.pixels) + y * surf.pitch + x * 4, 4);
+    return c;
+}
+
+void copy_surface_pixel(
+    SDL_Surface& surf, int from_x, int from_y, int x, int y)
 {
-    auto const index = y * surf.pitch + x * surf.format->BytesPerPixel;
-    auto const pixel = static_cast<Uint8*>(surf.pixels) + index;
-    pixel[2] = c.r;
-    pixel[1] = c.g;
-    pixel[0] = c.b;
+    auto const pixels = static_cast<Uint8*>(surf.pixels);
+    std::memcpy(pixels + y * surf.pitch + x * 4,
+        pixels + from_y * surf.pitch + from_x * 4, 4);
+}
+
+/// The world space direction of the ray through the projection plane at
+/// `plane_t` (0 is the plane's start, column 0).
+///
+/// Keeping it as a unit vector (rather than an angle) means no trig is needed
+/// anywhere else. It's built from the point's offset in view space rather
+/// than from `proj_point_ws - position`, which would lose most of its
+/// precision since the plane is so close to the camera.
+vec2f ray_direction(raycaster::camera const& cam, float plane_t)
+{
+    auto const forward = cam.get_forward();
+    auto const plane_side
+        = cam.get_right() - (cam.get_right() + cam.get_left()) * plane_t;
+    return normalize(forward * cam.get_near() + perp(forward) * plane_side);
+}
+
+/// Depths of neighbouring columns this close (relative) are the same surface
+constexpr auto depth_tolerance = 0.05f;
+/// Plus this much (absolute), for surfaces right in front of the camera
+constexpr auto depth_slack = 0.02f;
+/// Columns with nothing in them
+constexpr auto no_depth = std::numeric_limits<float>::max();
+
+bool similar_depth(float a, float b)
+{
+    if (a == no_depth || b == no_depth) {
+        return a == b;
+    }
+    return std::abs(a - b) <= depth_tolerance * std::min(a, b) + depth_slack;
+}
+
+/// @return `c` with each channel clamped to the range `a` and `b` span in
+/// it, so a reprojected texel can't bring in a color that's nowhere near
+/// the texels shaded around it this frame
+packed_color clamp_between(packed_color c, packed_color a, packed_color b)
+{
+    auto const x = unpack(c);
+    auto const y = unpack(a);
+    auto const z = unpack(b);
+    auto const channel = [](std::uint8_t v, std::uint8_t p, std::uint8_t q) {
+        return std::min(std::max(v, std::min(p, q)), std::max(p, q));
+    };
+    return pack(color{channel(x.r, y.r, z.r), channel(x.g, y.g, z.g),
+        channel(x.b, y.b, z.b)});
+}
+
+/// Weight of each new frame in the running averages of the stats
+constexpr auto stats_smoothing = 0.1f;
+
+void blend_stat(float& average, float sample)
+{
+    average += (sample - average) * stats_smoothing;
+}
+
+bool inside_grid(raycaster::wall_grid const& grid, point2f const& p)
+{
+    return p.x >= grid.origin.x && p.y >= grid.origin.y
+        && p.x < grid.origin.x + grid.width * grid.cell_size
+        && p.y < grid.origin.y + grid.height * grid.cell_size;
+}
+
+/// Add `index` to the bin of each worker whose columns overlap `first_column`
+/// to `last_column` (inclusive). Same partitioning as do_work().
+template <typename Bins>
+void bin_by_columns(Bins& bins, std::uint32_t index, int first_column,
+    int last_column, int width)
+{
+    for (auto t = 0; t < static_cast<int>(bins.size()); ++t) {
+        auto const start_column = t * width / static_cast<int>(bins.size());
+        auto const end_column = (t + 1) * width / static_cast<int>(bins.size());
+        if (first_column < end_column && last_column >= start_column) {
+            bins[t].push_back(index);
+        }
+    }
 }
 
 } // namespace
 
 namespace raycaster {
 
-render_pipeline::render_pipeline(texture_cache cache)
-: _texture_cache{std::move(cache)}
+render_pipeline::render_pipeline(texture_registry const& textures)
+: _textures{textures}
+{
+    set_render_settings(_settings);
+}
+
+void render_pipeline::render(level const& lvl, camera const& given_camera,
+    SDL_Surface& framebuffer, float sprite_alpha)
 {
-    for (int i = 0; i < detail::num_threads; ++i) {
-        auto& context = _contexts[i];
-        auto& thread = _threads[i];
+    auto cam = given_camera;
+    if (_camera_latch) {
+        _camera_latch(cam);
+    }
+    if (_settings.far_plane > 0.f) {
+        cam.set_far(_settings.far_plane);
+    }
 
-        context.id = i;
-        thread = std::thread(
-            [this](rendering_context* context) {
-                while (true) {
-                    // Spin, because I'm too lazy to figure out a CV solution
-                    while (!context->can_start.exchange(false)) {
-                        std::this_thread::sleep_for(1ms);
-                    }
+    // Everything below works on `target`, which is only scaled up to the
+    // framebuffer at the end
+    prepare_target(framebuffer);
+    auto& target = _target ? *_target : framebuffer;
+    prepare_column_rays(cam, target.w);
 
-                    context->work(context->id);
+    find_camera_pvs(lvl, cam);
+    cull_sprites(lvl, cam, target.w, sprite_alpha);
+    find_visible_sectors(lvl, cam, target.w);
 
-                    context->done.store(true);
-                }
-            },
-            &context);
-        thread.detach();
+    if (_checkerboard) {
+        _frame_parity ^= 1;
+        _use_history = _use_history && _history.lvl == &lvl
+            && _history.width == target.w && _history.height == target.h;
+
+        prepare_history(target);
+        _next_history.viewpoint = view{cam.get_position(), cam.get_forward(),
+            cam.get_near(), cam.get_right(), cam.get_left()};
+        _next_history.lvl = &lvl;
+    } else {
+        _use_history = false;
+    }
+
+    for_each_workset([&](std::size_t id) {
+        do_work(static_cast<unsigned>(id), lvl, cam, target);
+    });
+
+    if (_target) {
+        scale_target(framebuffer);
+    }
+
+    if (_checkerboard) {
+        std::swap(_history, _next_history);
+        _use_history = true;
+
+        // The workers run in parallel, so the slowest one is what counts
+        auto const shade_ms
+            = *std::max_element(_shade_ms.begin(), _shade_ms.end());
+        auto const reconstruct_ms = *std::max_element(
+            _reconstruct_ms.begin(), _reconstruct_ms.end());
+        unsigned reprojected = 0;
+        for (auto const n : _reprojected_columns) {
+            reprojected += n;
+        }
+        auto const missing = (target.w + 1 - _frame_parity) / 2;
+
+        blend_stat(_checkerboard_stats.shade_ms, shade_ms);
+        blend_stat(_checkerboard_stats.reconstruct_ms, reconstruct_ms);
+        blend_stat(_checkerboard_stats.saved_ms, shade_ms - reconstruct_ms);
+        blend_stat(_checkerboard_stats.reprojected,
+            missing > 0 ? reprojected / static_cast<float>(missing) : 0.f);
+    }
+}
+
+sprite_stats render_pipeline::get_sprite_stats() const
+{
+    return _sprite_stats;
+}
+
+void render_pipeline::prepare(camera const& cam, SDL_Surface const& framebuffer)
+{
+    prepare_target(framebuffer);
+    auto const& target = _target ? *_target : framebuffer;
+    prepare_column_rays(cam, target.w);
+    if (_checkerboard) {
+        prepare_history(target);
+    }
+}
+
+void render_pipeline::set_render_settings(render_settings const& settings)
+{
+    if (settings.threads < 1
+        || settings.threads > render_settings::max_threads) {
+        throw std::invalid_argument{"The thread count must be from 1 to "
+            + std::to_string(render_settings::max_threads)};
+    }
+    if (settings.resolution.w < 0 || settings.resolution.h < 0
+        || (settings.resolution.w == 0) != (settings.resolution.h == 0)) {
+        throw std::invalid_argument{
+            "The resolution must be positive, or 0 by 0"};
+    }
+    if (settings.resolution.w > render_settings::max_resolution
+        || settings.resolution.h > render_settings::max_resolution) {
+        throw std::invalid_argument{"The resolution can't be more than "
+            + std::to_string(render_settings::max_resolution) + " a side"};
+    }
+    if (!(settings.far_plane >= 0.f)
+        || settings.far_plane == std::numeric_limits<float>::infinity()) {
+        throw std::invalid_argument{
+            "The far plane must be finite and not negative"};
+    }
+
+    // Before anything else changes, so the old settings stay if it throws
+    if (settings.resolution.w != 0) {
+        allocate_target(settings.resolution);
     }
+
+    // Only restart the workers for a different number of them, since the
+    // old ones all have to be joined first
+    auto const workers = _pool ? _pool->size() : 1u;
+    if (workers != settings.threads) {
+        _pool.reset();
+        if (settings.threads > 1) {
+            _pool = std::make_unique<thread_pool>(settings.threads);
+        }
+    }
+    _shade_ms.assign(settings.threads, 0.f);
+    _reconstruct_ms.assign(settings.threads, 0.f);
+    _reprojected_columns.assign(settings.threads, 0u);
+    _sprite_bins.resize(settings.threads);
+    _sector_bins.resize(settings.threads);
+    _tested_walls.resize(settings.threads);
+
+    if (settings.resolution.w == 0) {
+        _target.reset();
+        _scaled_columns.clear();
+    }
+
+    _settings = settings;
+}
+
+render_settings const& render_pipeline::get_render_settings() const
+{
+    return _settings;
 }
 
-void render_pipeline::render(
-    level const& lvl, camera const& cam, SDL_Surface& framebuffer)
+void render_pipeline::for_each_workset(
+    std::function<void(std::size_t)> const& fn)
 {
-    for (auto& context : _contexts) {
-        // tell what the thread should do
-        context.work = [&lvl, &cam, &framebuffer, this](
-                           unsigned id) { do_work(id, lvl, cam, framebuffer); };
+    if (_pool) {
+        _pool->parallel_for(_settings.threads, fn);
+    } else {
+        fn(0);
+    }
+}
 
-        // start thread
-        context.can_start.store(true);
+void render_pipeline::prepare_target(SDL_Surface const& framebuffer)
+{
+    auto const size = _settings.resolution;
+    _target_format = framebuffer.format->format;
+    if (size.w == 0 || (size.w == framebuffer.w && size.h == framebuffer.h)) {
+        _target.reset();
+        return;
     }
 
-    // wait for results before returning
-    for (auto& context : _contexts) {
-        // Spin, because I'm too lazy to figure out a CV solution
-        while (!context.done.exchange(false)) {
-            std::this_thread::sleep_for(1ms);
+    allocate_target(size);
+
+    if (_scaled_columns.size() != static_cast<std::size_t>(framebuffer.w)) {
+        _scaled_columns.resize(framebuffer.w);
+        for (auto x = 0; x < framebuffer.w; ++x) {
+            _scaled_columns[x] = x * size.w / framebuffer.w;
         }
     }
 }
 
+void render_pipeline::allocate_target(extent2i size)
+{
+    if (!_target || _target->w != size.w || _target->h != size.h
+        || _target->format->format != _target_format) {
+        _target = sdl::make_surface(SDL_CreateRGBSurfaceWithFormat(
+            0, size.w, size.h, 32, _target_format));
+        _scaled_columns.clear();
+    }
+}
+
+void render_pipeline::scale_target(SDL_Surface& framebuffer)
+{
+    auto const& target = *_target;
+    auto const bands = static_cast<int>(_settings.threads);
+
+    for_each_workset([&](std::size_t id) {
+        auto const band = static_cast<int>(id);
+        auto const first_row = band * framebuffer.h / bands;
+        auto const end_row = (band + 1) * framebuffer.h / bands;
+        auto const bytes = static_cast<std::size_t>(framebuffer.w) * 4;
+
+        auto previous_from = -1;
+        for (auto row = first_row; row < end_row; ++row) {
+            auto const dest = static_cast<Uint8*>(framebuffer.pixels)
+                + row * framebuffer.pitch;
+
+            // Scaling up, most rows are the same as the one above
+            auto const from = row * target.h / framebuffer.h;
+            if (from == previous_from) {
+                std::memcpy(dest, dest - framebuffer.pitch, bytes);
+                continue;
+            }
+            previous_from = from;
+
+            auto const source = static_cast<Uint8 const*>(target.pixels)
+                + from * target.pitch;
+            for (auto x = 0; x < framebuffer.w; ++x) {
+                std::memcpy(dest + x * 4, source + _scaled_columns[x] * 4, 4);
+            }
+        }
+    });
+}
+
+void render_pipeline::prepare_column_rays(camera const& cam, int width)
+{
+    auto const& plane = _column_rays_plane;
+    if (plane.width == width && plane.near == cam.get_near()
+        && plane.right == cam.get_right() && plane.left == cam.get_left()) {
+        return;
+    }
+    _column_rays_plane = view_plane{
+        width, cam.get_near(), cam.get_right(), cam.get_left()};
+
+    // Same as ray_direction(), before it's turned to face the camera's way
+    _column_rays.resize(width);
+    for (auto column = 0; column < width; ++column) {
+        auto const plane_t = column / static_cast<float>(width);
+        auto const side = cam.get_right()
+            - (cam.get_right() + cam.get_left()) * plane_t;
+        _column_rays[column] = normalize(vec2f{cam.get_near(), side});
+    }
+}
+
+void render_pipeline::prepare_history(SDL_Surface const& target)
+{
+    _next_history.pixels.resize(static_cast<std::size_t>(target.w) * target.h);
+    _next_history.depths.resize(target.w);
+    _next_history.width = target.w;
+    _next_history.height = target.h;
+}
+
+void render_pipeline::set_camera_latch(camera_latch latch)
+{
+    _camera_latch = std::move(latch);
+}
+
+void render_pipeline::set_checkerboard(bool enabled)
+{
+    _checkerboard = enabled;
+    if (!enabled) {
+        _checkerboard_stats = {};
+    }
+}
+
+bool render_pipeline::get_checkerboard() const { return _checkerboard; }
+
+checkerboard_stats render_pipeline::get_checkerboard_stats() const
+{
+    return _checkerboard_stats;
+}
+
+void render_pipeline::set_shading_rates(shading_rates const& rates)
+{
+    _shading_rates = rates;
+}
+
+shading_rates const& render_pipeline::get_shading_rates() const
+{
+    return _shading_rates;
+}
+
+void render_pipeline::find_camera_pvs(level const& lvl, camera const& cam)
+{
+    auto const& grid = lvl.grid;
+    _use_pvs = !lvl.pvs.empty() && inside_grid(grid, cam.get_position());
+    if (!_use_pvs) {
+        return;
+    }
+
+    // Decoding touches one bit per wall and cell, which is cheap enough to
+    // redo every frame
+    auto const cell = grid.cell_of(cam.get_position());
+    auto const index = cell.y * grid.width + cell.x;
+    lvl.pvs.get_walls(index, _pvs_walls);
+    lvl.pvs.get_cells(index, _pvs_cells);
+}
+
+void render_pipeline::cull_sprites(
+    level const& lvl, camera const& cam, int width, float alpha)
+{
+    _visible_sprites.clear();
+    for (auto& bin : _sprite_bins) {
+        bin.clear();
+    }
+
+    // View space: `depth` along the camera's forward axis, `side` along the
+    // projection plane (positive towards its start, which is column 0).
+    auto const forward = cam.get_forward();
+    auto const left = perp(forward);
+    // Sprite planes are perpendicular to `forward`, so they're the same for
+    // every sprite up to a translation
+    auto const half_plane = left * sprite_half_width;
+    // Maps `side / depth` to a column
+    auto const half_width = width / 2.f;
+    auto const column_scale = half_width * cam.get_near() / cam.get_right();
+
+    auto const& positions = lvl.sprites.get_positions();
+    auto const& previous_positions = lvl.sprites.get_previous_positions();
+    auto const& textures = lvl.sprites.get_textures();
+    for (std::size_t i = 0; i < positions.size(); ++i) {
+        auto const position = alpha < 1.f
+            ? linear_interpolate(previous_positions[i], positions[i], alpha)
+            : positions[i];
+        auto const offset = displacement(cam.get_position(), position);
+        auto const depth = dot(offset, forward);
+        // Rays start at the projection plane and go `far` deeper than that,
+        // and a sprite's plane is all at the same depth
+        if (depth < cam.get_near() || depth > cam.get_near() + cam.get_far()) {
+            continue;
+        }
+
+        // The PVS doesn't know about anything outside the grid
+        if (_use_pvs && inside_grid(lvl.grid, position)) {
+            auto const cell = lvl.grid.cell_of(position);
+            if (!_pvs_cells.test(static_cast<std::size_t>(
+                    cell.y * lvl.grid.width + cell.x))) {
+                continue;
+            }
+        }
+
+        auto const side = dot(offset, left);
+        auto const scale = column_scale / depth;
+        // Pad by a column so rounding never drops an edge
+        auto const first = static_cast<int>(
+            std::floor(half_width - (side + sprite_half_width) * scale)) - 1;
+        auto const last = static_cast<int>(
+            std::ceil(half_width - (side - sprite_half_width) * scale)) + 1;
+        if (last < 0 || first >= width) {
+            continue;
+        }
+
+        auto const index = static_cast<std::uint32_t>(_visible_sprites.size());
+        _visible_sprites.push_back(visible_sprite{
+            {position + half_plane, position - half_plane},
+            textures[i], std::max(first, 0), std::min(last, width - 1)});
+
+        auto const& sprite = _visible_sprites.back();
+        bin_by_columns(_sprite_bins, index, sprite.first_column,
+            sprite.last_column, width);
+    }
+
+    _sprite_stats.visible = static_cast<unsigned>(_visible_sprites.size());
+    _sprite_stats.culled
+        = static_cast<unsigned>(positions.size() - _visible_sprites.size());
+}
+
+void render_pipeline::find_visible_sectors(
+    level const& lvl, camera const& cam, int width)
+{
+    _visible_sectors.clear();
+    for (auto& bin : _sector_bins) {
+        bin.clear();
+    }
+
+    auto const& sectors = lvl.sectors;
+    auto const position = cam.get_position();
+    _camera_sector = sectors.find(position, _camera_sector);
+    _use_sectors = _camera_sector != no_sector;
+    if (!_use_sectors) {
+        return;
+    }
+
+    // Same view space as cull_sprites()
+    auto const forward = cam.get_forward();
+    auto const left = perp(forward);
+    auto const half_width = width / 2.f;
+    auto const column_scale = half_width * cam.get_near() / cam.get_right();
+    auto const max_depth = cam.get_near() + cam.get_far();
+
+    _open_sectors.clear();
+    _open_sectors.push_back(visible_sector{_camera_sector, 0, width - 1, 0});
+    while (!_open_sectors.empty()) {
+        auto const current = _open_sectors.back();
+        _open_sectors.pop_back();
+
+        auto const index = static_cast<std::uint32_t>(_visible_sectors.size());
+        _visible_sectors.push_back(current);
+        bin_by_columns(_sector_bins, index, current.first_column,
+            current.last_column, width);
+
+        if (current.portal_depth >= max_portal_depth
+            || _visible_sectors.size() >= max_visible_sectors) {
+            continue;
+        }
+
+        for (auto j = sectors.point_offsets[current.sector];
+             j < sectors.point_offsets[current.sector + 1]; ++j) {
+            auto const next = sectors.neighbours[j];
+            if (next == no_sector) {
+                continue;
+            }
+
+            // Only look through portals from the front (the inside of
+            // `current`), which also keeps the search from going straight
+            // back where it came from
+            auto const portal = sectors.edge(current.sector, j);
+            auto const along = displacement(portal.start, portal.end);
+            auto const facing = dot(
+                displacement(portal.start, position), normalize(perp(along)));
+            if (facing < -portal_epsilon) {
+                continue;
+            }
+
+            auto first_column = current.first_column;
+            auto last_column = current.last_column;
+            if (facing > portal_epsilon) {
+                // Project the portal into view space and clip it to just in
+                // front of the camera
+                auto const a = displacement(position, portal.start);
+                auto const b = displacement(position, portal.end);
+                auto depth_a = dot(a, forward);
+                auto depth_b = dot(b, forward);
+                auto side_a = dot(a, left);
+                auto side_b = dot(b, left);
+                if ((depth_a < min_portal_depth && depth_b < min_portal_depth)
+                    || (depth_a > max_depth && depth_b > max_depth)) {
+                    continue;
+                }
+                if (depth_a < min_portal_depth) {
+                    auto const t
+                        = (min_portal_depth - depth_a) / (depth_b - depth_a);
+                    side_a += (side_b - side_a) * t;
+                    depth_a = min_portal_depth;
+                } else if (depth_b < min_portal_depth) {
+                    auto const t
+                        = (min_portal_depth - depth_b) / (depth_a - depth_b);
+                    side_b += (side_a - side_b) * t;
+                    depth_b = min_portal_depth;
+                }
+
+                auto const column_a
+                    = half_width - side_a / depth_a * column_scale;
+                auto const column_b
+                    = half_width - side_b / depth_b * column_scale;
+                // Pad by a column so rounding never drops an edge, and clamp
+                // before converting since portals near the camera project
+                // far off screen
+                auto const limit = static_cast<float>(width);
+                first_column = std::max(first_column,
+                    static_cast<int>(clamp(
+                        std::floor(std::min(column_a, column_b)) - 1.f, -1.f,
+                        limit)));
+                last_column = std::min(last_column,
+                    static_cast<int>(clamp(
+                        std::ceil(std::max(column_a, column_b)) + 1.f, -1.f,
+                        limit)));
+            }
+            // Otherwise the camera is standing in the portal, and can see
+            // through it wherever it could see `current`
+
+            if (first_column > last_column) {
+                continue;
+            }
+            _open_sectors.push_back(visible_sector{
+                next, first_column, last_column, current.portal_depth + 1});
+        }
+    }
+}
+
+void render_pipeline::tested_walls::next_column(std::size_t wall_count)
+{
+    // Only grows: stamps left over from a level with more walls are all
+    // older than the next one
+    if (stamps.size() < wall_count) {
+        stamps.resize(wall_count, 0u);
+    }
+    if (++stamp == 0u) {
+        std::fill(stamps.begin(), stamps.end(), 0u);
+        stamp = 1u;
+    }
+}
+
 void render_pipeline::do_work(
     unsigned thread_id, level const& lvl, camera const& cam, SDL_Surface& fb)
 {
@@ -93,9 +665,46 @@ void render_pipeline::do_work(
     // We can nicely partition the rectangular framebuffer into sets of
     // contiguous, non-overlapping columns; this thread will only be responsible
     // for rendering one of those sets (here called a workset)
-    int start_column = thread_id * fb.w / detail::num_threads;
-    int end_column = (thread_id + 1) * fb.w / detail::num_threads;
+    auto const worksets = static_cast<int>(_settings.threads);
+    int start_column = thread_id * fb.w / worksets;
+    int end_column = (thread_id + 1) * fb.w / worksets;
+
+    auto& tested = _tested_walls[thread_id];
+
+    // For variable-rate shading: which rows of this column and the one
+    // before it were floor or ceiling, and how far the nearest wall or
+    // sprite of the one before it was
+    auto const& rates = _shading_rates;
+    std::vector<std::uint8_t> floor_rows;
+    std::vector<std::uint8_t> previous_floor_rows;
+    auto previous_nearest = 0.f;
+
+    auto const projection_plane = cam.get_projection_plane();
+    auto const forward = cam.get_forward();
+
+    // Textures are drawn through the palette if they've been quantized
+    auto const* const pal = _textures.get_palette();
+
+    auto const is_hidden_cell = [this](int cell) {
+        return _use_pvs && !_pvs_cells.test(static_cast<std::size_t>(cell));
+    };
+
+    // Without fog everything is drawn as if it were right in front
+    auto const fog_weight = [this, &cam](float distance) {
+        return _settings.fog ? to_weight(distance / cam.get_far()) : 0u;
+    };
+    // Without textures, what's opaque is drawn in the color at the middle
+    // of its texture
+    auto const flat_uv = point2f{0.5f, 0.5f};
+
+    auto const shade_start = std::chrono::steady_clock::now();
+
     for (auto column = start_column; column < end_column; ++column) {
+        // In checkerboard mode, the other half is filled in afterwards
+        if (_checkerboard && column % 2 != _frame_parity) {
+            continue;
+        }
+
         // This loop can be split roughly in two:
         //
         // 1. Figure out which things to draw
@@ -111,29 +720,40 @@ void render_pipeline::do_work(
         // We shoot rays through a projection plane, so find the plane point
         // corresponding to the screen column. (This is a transformation from
         // one space to another [framebuffer space to world space])
-        auto const proj_point_ws = linear_interpolate(
-            cam.get_projection_plane(), column / static_cast<float>(fb.w));
+        auto const plane_t = column / static_cast<float>(fb.w);
+        auto const proj_point_ws
+            = linear_interpolate(projection_plane, plane_t);
 
-        // Determine the world space angle that this represents. The angle does
-        // not increase linearly across the plane, hence why the trig is
-        // necessary (although a sufficient approximation might speed this up)
-        auto const diff = proj_point_ws - cam.get_position();
-        auto const ray_radians_ws = atan2(diff.y, diff.x);
+        // Determine the world space direction that this represents, by
+        // turning the column's view space direction to face the camera's way
+        // (see ray_direction()).
+        auto const& ray_dir_vs = _column_rays[column];
+        auto const ray_dir_ws
+            = forward * ray_dir_vs.x + perp(forward) * ray_dir_vs.y;
 
         // Calculate fish eye distortion correction. This value translates
-        // euclidean to projected-on-the-projection-plane distance using trig.
-        // This is precalculated and used throughout both steps.
-        auto const ray_radians_vs = cam.get_rotation() - ray_radians_ws;
-        auto const euclidean_to_projected_correction
-            = std::sin(PI_OVER_2 - std::abs(ray_radians_vs));
+        // euclidean to projected-on-the-projection-plane distance. It's the
+        // cosine of the angle between the ray and the camera's forward axis,
+        // which for unit vectors is just their dot product, and so the view
+        // space direction's forward part. This is used throughout both
+        // steps.
+        auto const euclidean_to_projected_correction = ray_dir_vs.x;
 
-        // Now that we have a point and an angle, we can define a line to
+        // Now that we have a point and a direction, we can define a line to
         // represent the ray in worldspace. To account for the fish-eye
         // correction later, we premultiply the length of the vector.
-        auto const ray_vector_ws = vector2f{
-            ray_radians_ws, cam.get_far() / euclidean_to_projected_correction};
+        auto const ray_length
+            = cam.get_far() / euclidean_to_projected_correction;
         auto const ray_line_ws
-            = line2f{proj_point_ws, proj_point_ws + ray_vector_ws};
+            = line2f{proj_point_ws, proj_point_ws + ray_dir_ws * ray_length};
+
+        // With variable-rate shading, every other column can be mostly
+        // copied from the one to its left
+        auto const second_of_pair = rates.enabled && !_checkerboard
+            && (column - start_column) % 2 == 1;
+        auto const copy_hits
+            = second_of_pair && previous_nearest > rates.wall_2x1_distance;
+        floor_rows.assign(fb.h, 0);
 
         // Now that we have a ray, we can start testing it against level
         // geometry to find hits (which we will later render). We can't render
@@ -153,7 +773,20 @@ void render_pipeline::do_work(
         };
         std::vector<ray_hit> candidates;
 
-        for (auto const& wall : lvl.walls) {
+        // A wall can be listed in several grid cells or sectors, so remember
+        // which ones were tested.
+        tested.next_column(lvl.walls.size());
+        auto const test_wall = [&](std::uint32_t wall_index) {
+            if (tested.stamps[wall_index] == tested.stamp) {
+                return;
+            }
+            tested.stamps[wall_index] = tested.stamp;
+            if (_use_pvs && !_pvs_walls.test(wall_index)) {
+                return;
+            }
+
+            auto const& wall = lvl.walls[wall_index];
+
             // Walls are lines in worldspace, and the ray is a line in
             // worldspace, so finding the candidate is as easy as finding the
             // algrebraic intersection between them
@@ -164,24 +797,63 @@ void render_pipeline::do_work(
                 // HACK! For walls, we want the texture to repeat across the
                 // length, but the `t` we get normalizes across the line and
                 // causes the texture to stretch. So correct for that here.
-                t *= wall.data.length();
+                t *= wall.length;
                 t -= std::floor(t);
                 candidates.push_back(
                     ray_hit{exact_line.length(), cross_point, wall.texture, t});
             }
+        };
+
+        if (copy_hits) {
+            // The walls and sprites are copied from the column to the left
+        } else if (_use_sectors) {
+            // Only test the walls of sectors that find_visible_sectors() saw
+            // in this column. Dynamic walls aren't in any sector, so they
+            // still come from the grid.
+            for (auto const index : _sector_bins[thread_id]) {
+                auto const& visible = _visible_sectors[index];
+                if (column >= visible.first_column
+                    && column <= visible.last_column) {
+                    lvl.sectors.for_each_wall(visible.sector, test_wall);
+                }
+            }
+            if (lvl.grid.has_dynamic_walls()) {
+                lvl.grid.traverse(ray_line_ws, [&](int cell, float) {
+                    if (is_hidden_cell(cell)) {
+                        return false;
+                    }
+                    lvl.grid.for_each_dynamic_wall(cell, test_wall);
+                    return true;
+                });
+            }
+        } else {
+            // Only test the walls in the grid cells that the ray passes
+            // through. Once it reaches a cell that can't be seen from the
+            // camera's, it must have hit an opaque wall already.
+            lvl.grid.traverse(ray_line_ws, [&](int cell, float) {
+                if (is_hidden_cell(cell)) {
+                    return false;
+                }
+                lvl.grid.for_each_wall(cell, test_wall);
+                return true;
+            });
         }
 
-        for (auto const& sprite : lvl.sprites) {
-            // Sprites, unlike lines, rotate to face the camera. As such, they
-            // are modeled as points that we turn into lines in order to work
-            // with. Sprites always take up 1 unit, which means 0.5 on either
-            // side.
-            auto const sprite_plane = line2f{
-                sprite.data + vector2f{cam.get_rotation() + PI_OVER_2, 0.5f},
-                sprite.data + vector2f{cam.get_rotation() - PI_OVER_2, 0.5f}};
+        // Sprites, unlike lines, rotate to face the camera. As such, they
+        // are modeled as points that we turn into lines in order to work
+        // with. cull_sprites() already did that, and left us only the ones
+        // that can show up in this thread's columns.
+        for (auto const index : _sprite_bins[thread_id]) {
+            if (copy_hits) {
+                break;
+            }
+            auto const& sprite = _visible_sprites[index];
+            if (column < sprite.first_column || column > sprite.last_column) {
+                continue;
+            }
             point2f cross_point{0.f, 0.f};
             float t = 0.f;
-            if (find_intersection(ray_line_ws, sprite_plane, cross_point, t)) {
+            if (find_intersection(ray_line_ws, sprite.plane, cross_point, t)) {
                 auto const exact_line = line2f{proj_point_ws, cross_point};
                 candidates.push_back(ray_hit{
                     exact_line.length(), cross_point, sprite.texture, t});
@@ -194,6 +866,17 @@ void render_pipeline::do_work(
         // Depth-sort the hits. This way, we can traverse the vector from front
         // to back to make rendering simpler
         std::sort(candidates.begin(), candidates.end());
+        if (!copy_hits) {
+            previous_nearest = candidates.empty()
+                ? no_depth
+                : candidates.front().distance
+                    * euclidean_to_projected_correction;
+        }
+        if (_checkerboard) {
+            _next_history.depths[column] = candidates.empty()
+                ? no_depth
+                : candidates.front().distance;
+        }
 
         //
         // STEP 2: Now draw them
@@ -203,6 +886,11 @@ void render_pipeline::do_work(
         // pixels down a row! Worksets are rectangles with height of the
         // framebuffer, only the width is partitioned.
         for (auto row = 0; row < fb.h; ++row) {
+            if (copy_hits && !previous_floor_rows[row]) {
+                copy_surface_pixel(fb, column - 1, row, column, row);
+                continue;
+            }
+
             // Track whether something was drawn, if not then the floor/ceiling
             // should be rendered to fill in the space.
             bool drew_a_hit = false;
@@ -237,23 +925,20 @@ void render_pipeline::do_work(
                     / static_cast<float>(wall_end - wall_start);
                 auto const uv = point2f{hit.u, v};
 
-                // Get the color of the pixel based on the wall texture.
-                auto const texel
-                    = get_surface_pixel(_texture_cache[hit.texture], uv);
-
-                // If the pixel is transparent then don't render this hit.
-                // Keep iterating through farther back hits to find a non
-                // transparent pixel.
-                //
-                // HACK! Magenta is hardcoded as the translucent pixel.
-                if (texel.r == 255 && texel.g == 0 && texel.b == 255) {
+                // Get the color of the pixel based on the wall texture, with
+                // the fog applied. If the pixel is transparent then don't
+                // render this hit. Keep iterating through farther back hits
+                // to find a non transparent pixel.
+                packed_color fog_texel;
+                auto const weight = fog_weight(corrected_distance);
+                if (!shade_texel(
+                        _textures, pal, hit.texture, uv, weight, fog_texel)) {
                     continue;
                 }
-
-                // Otherwise, apply fog affect
-                auto const fog_texel
-                    = linear_interpolate(texel, mycolor::constants::black,
-                        corrected_distance / cam.get_far());
+                if (!_settings.textures) {
+                    shade_texel(_textures, pal, hit.texture, flat_uv, weight,
+                        fog_texel);
+                }
 
                 // Then set the pixel in the framebuffer
                 set_surface_pixel(fb, column, row, fog_texel);
@@ -268,9 +953,10 @@ void render_pipeline::do_work(
 
             // Otherwise: draw a floor/ceiling in its place.
 
-            // Prevent division by 0 in reverse projection
-            if (half_height == row) {
-                set_surface_pixel(fb, column, row, mycolor::constants::black);
+            // Leave it black if the floor is off, or if reverse projection
+            // would divide by 0
+            if (!_settings.floor || half_height == row) {
+                set_surface_pixel(fb, column, row, black);
                 continue;
             }
 
@@ -281,45 +967,185 @@ void render_pipeline::do_work(
             // is purposefully distorted with a fish-eye so the trig will work.
             auto const floor_distance_vs = static_cast<float>(half_height)
                 / mymath::abs(half_height - row);
+
+            // Far away floor is shaded at a coarser rate, by copying the pixel
+            // to the left (2x1) or above (2x2) if that one is floor too
+            floor_rows[row] = 1;
+            if (rates.enabled) {
+                if (second_of_pair && previous_floor_rows[row]
+                    && floor_distance_vs > rates.floor_2x1_distance) {
+                    copy_surface_pixel(fb, column - 1, row, column, row);
+                    continue;
+                }
+                if (row % 2 == 1 && floor_rows[row - 1]
+                    && floor_distance_vs > rates.floor_2x2_distance) {
+                    copy_surface_pixel(fb, column, row - 1, column, row);
+                    continue;
+                }
+            }
             auto const floor_distance_distorted_vs
                 = floor_distance_vs / euclidean_to_projected_correction;
-            auto const floor_coord_local_ws = point2f{0.f, 0.f}
-                + vector2f{static_cast<float>(M_PI) - ray_radians_ws,
-                      floor_distance_distorted_vs};
-            // TODO: Why are the signs weird here...
-            auto floor_coord_ws = cam.get_position()
-                + point2f{-floor_coord_local_ws.x, floor_coord_local_ws.y};
+            auto const floor_coord_ws = cam.get_position()
+                + ray_dir_ws * floor_distance_distorted_vs;
 
             // Figure out if we're rendering the floor or ceiling.
             auto is_ceiling = row < half_height;
 
-            // Wrap the coordinate between [0,1] before querying the texture
-            while (floor_coord_ws.x <= 0.f) {
-                floor_coord_ws.x += 1.f;
-            }
-            while (floor_coord_ws.x >= 1.f) {
-                floor_coord_ws.x -= 1.f;
-            }
-            while (floor_coord_ws.y <= 0.f) {
-                floor_coord_ws.y += 1.f;
-            }
-            while (floor_coord_ws.y >= 1.f) {
-                floor_coord_ws.y -= 1.f;
-            }
+            // Wrap the coordinate between [0,1) before querying the texture
+            auto const floor_uv = remainder(floor_coord_ws);
 
-            // Query the texture then place the pixel.
-            auto const tile_color = get_surface_pixel(
-                is_ceiling ? _texture_cache[6] : _texture_cache[3],
-                floor_coord_ws);
-
-            // Apply fog effect
-            auto const fog_texel = linear_interpolate(tile_color,
-                mycolor::constants::black, floor_distance_vs / cam.get_far());
+            // Query the texture and apply the fog effect. Floors have no
+            // transparency, so transparent texels are drawn as magenta.
+            auto fog_texel = transparent;
+            shade_texel(_textures, pal,
+                is_ceiling ? lvl.ceiling_texture : lvl.floor_texture,
+                _settings.textures ? floor_uv : flat_uv,
+                fog_weight(floor_distance_vs), fog_texel);
 
             // Finalize pixel color
             set_surface_pixel(fb, column, row, fog_texel);
         }
+
+        std::swap(floor_rows, previous_floor_rows);
+    }
+
+    auto const reconstruct_start = std::chrono::steady_clock::now();
+    _shade_ms[thread_id] = std::chrono::duration<float, std::milli>(
+        reconstruct_start - shade_start)
+                               .count();
+    if (_checkerboard) {
+        _reprojected_columns[thread_id]
+            = reconstruct_columns(cam, fb, start_column, end_column);
+        _reconstruct_ms[thread_id] = std::chrono::duration<float, std::milli>(
+            std::chrono::steady_clock::now() - reconstruct_start)
+                                         .count();
     }
 }
 
+unsigned render_pipeline::reconstruct_columns(
+    camera const& cam, SDL_Surface& fb, int start_column, int end_column)
+{
+    auto const half_height = fb.h / 2;
+    auto const forward = cam.get_forward();
+    auto const projection_plane = cam.get_projection_plane();
+    auto const& previous = _history.viewpoint;
+    auto& depths = _next_history.depths;
+    unsigned reprojected = 0;
+
+    for (auto column = start_column; column < end_column; ++column) {
+        if (column % 2 == _frame_parity) {
+            continue;
+        }
+
+        // Only neighbours in this workset can be used, the others may still
+        // be being drawn
+        auto const has_left = column - 1 >= start_column;
+        auto const has_right = column + 1 < end_column;
+
+        // Guess the column's depth from its neighbours. Where they disagree
+        // there's an edge, and whatever is reprojected would have one side's
+        // depth, so it's interpolated instead.
+        auto depth = no_depth;
+        auto same_surface = true;
+        if (has_left && has_right) {
+            auto const left = depths[column - 1];
+            auto const right = depths[column + 1];
+            same_surface = similar_depth(left, right);
+            depth = same_surface && left != no_depth ? (left + right) / 2.f
+                                                     : std::min(left, right);
+        } else if (has_left) {
+            depth = depths[column - 1];
+        } else if (has_right) {
+            depth = depths[column + 1];
+        }
+        depths[column] = depth;
+
+        // Only the nearest wall or sprite is reprojected, from the column of
+        // the previous frame that saw the same spot on it. The floor and
+        // ceiling are at a different depth on every row, so they're always
+        // interpolated.
+        auto from = -1;
+        auto scale = 1.f;
+        auto first_row = 0;
+        auto end_row = 0;
+        if (same_surface && depth != no_depth && _use_history) {
+            auto const plane_t = column / static_cast<float>(fb.w);
+            auto const target = linear_interpolate(projection_plane, plane_t)
+                + ray_direction(cam, plane_t) * depth;
+            auto const offset = displacement(previous.position, target);
+            auto const previous_depth_vs = dot(offset, previous.forward);
+            if (previous_depth_vs > previous.near) {
+                auto const side = dot(offset, perp(previous.forward));
+                auto const previous_side
+                    = side * previous.near / previous_depth_vs;
+                auto const previous_t = (previous.right - previous_side)
+                    / (previous.right + previous.left);
+                // Only columns that were shaded last frame are exact, which
+                // are the ones with the parity missing from this one
+                auto const missing_parity = 1 - _frame_parity;
+                auto const nearest = 2
+                        * static_cast<int>(std::floor(
+                            (previous_t * _history.width - missing_parity)
+                                / 2.f
+                            + 0.5f))
+                    + missing_parity;
+
+                // Disocclusion: the previous frame saw something else there
+                if (nearest >= 0 && nearest < _history.width
+                    && similar_depth(
+                        _history.depths[nearest], length(offset))) {
+                    // Things are drawn with a height inversely proportional
+                    // to their depth
+                    auto const depth_vs = dot(
+                        displacement(cam.get_position(), target), forward);
+                    auto const half_size
+                        = static_cast<int>(half_height / depth_vs);
+                    from = nearest;
+                    scale = depth_vs / previous_depth_vs;
+                    first_row = std::max(half_height - half_size, 0);
+                    end_row = std::min(half_height + half_size, fb.h);
+                    ++reprojected;
+                }
+            }
+        }
+
+        for (auto row = 0; row < fb.h; ++row) {
+            if (row >= first_row && row < end_row) {
+                auto const from_row = clamp(half_height
+                        + static_cast<int>(
+                            std::floor((row - half_height) * scale + 0.5f)),
+                    0, fb.h - 1);
+                auto const c = packed_color{
+                    _history.pixels[from_row * _history.width + from]};
+                set_surface_pixel(fb, column, row,
+                    has_left && has_right
+                        ? clamp_between(c,
+                            get_surface_pixel(fb, column - 1, row),
+                            get_surface_pixel(fb, column + 1, row))
+                        : c);
+            } else if (has_left && has_right) {
+                set_surface_pixel(fb, column, row,
+                    linear_interpolate(get_surface_pixel(fb, column - 1, row),
+                        get_surface_pixel(fb, column + 1, row),
+                        weight_one / 2));
+            } else if (has_left || has_right) {
+                copy_surface_pixel(
+                    fb, has_left ? column - 1 : column + 1, row, column, row);
+            }
+        }
+    }
+
+    // Keep this frame, before the HUD goes over it, for the next one
+    auto const bytes = static_cast<std::size_t>(end_column - start_column) * 4;
+    for (auto row = 0; row < fb.h; ++row) {
+        std::memcpy(
+            &_next_history.pixels[row * _next_history.width + start_column],
+            static_cast<Uint8 const*>(fb.pixels) + row * fb.pitch
+                + start_column * 4,
+            bytes);
+    }
+
+    return reprojected;
+}
+
 } // namespace raycaster
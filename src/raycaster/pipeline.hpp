@@ -1,12 +1,16 @@
 #pragma once
 
-#include "texture_cache.hpp"
+#include "pvs.hpp"
+#include "sector.hpp"
+#include "texture_registry.hpp"
 
 #include <mymath/mymath.hpp>
+#include <sdl_application/thread_pool.hpp>
+#include <sdl_raii/sdl_raii.hpp>
 
-#include <atomic>
+#include <cstdint>
 #include <functional>
-#include <thread>
+#include <memory>
 #include <vector>
 
 struct SDL_Surface;
@@ -16,31 +20,272 @@ namespace raycaster {
 class camera;
 struct level;
 
-namespace detail {
-constexpr auto num_threads = 4;
-} // namespace detail
+/// What render_pipeline::set_render_settings() can change between frames.
+struct render_settings {
+    static constexpr unsigned max_threads = 64;
+    /// Largest width or height of `resolution`
+    static constexpr int max_resolution = 16384;
+
+    /// Threads drawing columns, counting the one that calls render()
+    unsigned threads = 4;
+    /// Size the scene is drawn at before it's scaled to fill the
+    /// framebuffer. 0 by 0 to draw at the framebuffer's size.
+    mymath::extent2i resolution{0, 0};
+    /// Nothing further than this is drawn. 0 to use the camera's.
+    float far_plane = 0.f;
+    /// Fade things to black towards the far plane
+    bool fog = true;
+    /// Draw the floor and ceiling, else leave them black
+    bool floor = true;
+    /// Texture everything, else draw the opaque parts of each texture in
+    /// the color at its middle
+    bool textures = true;
+};
+
+/// Sprite visibility counts for the last rendered frame.
+struct sprite_stats {
+    unsigned visible = 0;
+    unsigned culled = 0;
+};
+
+/// Variable-rate shading: far away pixels are shaded once per 2x1 or 2x2
+/// block, and copied to the rest of the block. Distances are in world units
+/// along the camera's forward axis.
+struct shading_rates {
+    bool enabled = false;
+    /// Floor and ceiling past this are shaded every other column
+    float floor_2x1_distance = 2.f;
+    /// Floor and ceiling past this are also shaded every other row
+    float floor_2x2_distance = 4.f;
+    /// Every other column, if the nearest wall or sprite of the column to
+    /// its left is past this, no ray is cast and that column's walls and
+    /// sprites are copied. Objects less than a column wide can vanish.
+    float wall_2x1_distance = 4.f;
+};
+
+/// What checkerboard rendering saved, averaged over recent frames.
+struct checkerboard_stats {
+    /// Time the slowest worker spent shading its half of the columns, and
+    /// filling in the other half
+    float shade_ms = 0.f;
+    float reconstruct_ms = 0.f;
+    /// Roughly what shading the other half would have cost instead
+    float saved_ms = 0.f;
+    /// Share of the filled in columns that were taken from the previous
+    /// frame rather than interpolated
+    float reprojected = 0.f;
+};
 
 class render_pipeline {
 public:
-    render_pipeline(texture_cache cache);
+    explicit render_pipeline(texture_registry const& textures);
+
+    /// @param sprite_alpha How far to draw sprites from their previous
+    /// positions (see entity_store::save_positions()) to their current ones
+    void render(level const& lvl, camera const& cam, SDL_Surface& framebuffer,
+        float sprite_alpha = 1.f);
+
+    sprite_stats get_sprite_stats() const;
+
+    /// Allocate and build everything sized to `framebuffer` (the target for
+    /// the render resolution, per-column tables, checkerboard history) now,
+    /// e.g. right after a resize, rather than in the next render().
+    void prepare(camera const& cam, SDL_Surface const& framebuffer);
 
-    void render(level const& lvl, camera const& cam, SDL_Surface& framebuffer);
+    /// Takes effect on the next render(), which reallocates whatever else
+    /// the new settings need. Changing the thread count restarts the
+    /// workers. A new resolution's target is allocated here, so a size that
+    /// can't be allocated is reported to the caller.
+    ///
+    /// @throws std::invalid_argument if `settings` are out of range
+    /// @throws std::runtime_error if the target can't be allocated. The old
+    /// settings stay in effect after either.
+    void set_render_settings(render_settings const& settings);
+    render_settings const& get_render_settings() const;
+
+    /// Brings a copy of the camera up to date with the latest input
+    using camera_latch = std::function<void(camera&)>;
+
+    /// Called by render() before anything is set up from the camera, so the
+    /// frame shows the freshest input it can ("late latching"). Empty to
+    /// draw the camera as given.
+    void set_camera_latch(camera_latch latch);
+
+    /// Takes effect on the next render().
+    void set_shading_rates(shading_rates const& rates);
+    shading_rates const& get_shading_rates() const;
+
+    /// Shade every other column, alternating every frame, and fill in the
+    /// rest from the previous frame. Takes effect on the next render().
+    void set_checkerboard(bool enabled);
+    bool get_checkerboard() const;
+    checkerboard_stats get_checkerboard_stats() const;
 
 private:
-    texture_cache _texture_cache;
+    texture_registry const& _textures;
+    render_settings _settings;
+    shading_rates _shading_rates;
 
-    // Purposefully generic name for a mess of a function
-    void do_work(unsigned thread_id, level const& lvl, camera const& cam, SDL_Surface& fb);
+    /// Runs do_work(), null with a single thread
+    std::unique_ptr<sdl_app::thread_pool> _pool;
+    /// Call `fn(i)` for each of the `_settings.threads` worksets, in
+    /// parallel if there's a pool
+    void for_each_workset(std::function<void(std::size_t)> const& fn);
 
-    struct rendering_context {
-        unsigned id;
-        std::atomic<bool> can_start{false};
-        std::atomic<bool> done{false};
-        std::function<void(unsigned)> work;
+    /// Where the scene is drawn when it's not drawn at the framebuffer's size
+    sdl::surface _target;
+    /// The column of `_target` each column of the framebuffer is copied from
+    std::vector<int> _scaled_columns;
+    /// Pixel format of the last framebuffer, for targets allocated before
+    /// the next one is seen
+    std::uint32_t _target_format = SDL_PIXELFORMAT_ARGB8888;
+    /// Make `_target` and `_scaled_columns` match `_settings.resolution`
+    /// and `framebuffer`.
+    void prepare_target(SDL_Surface const& framebuffer);
+    /// Reallocate `_target` if it's not `size` in `_target_format`. Leaves
+    /// it alone if that throws.
+    void allocate_target(mymath::extent2i size);
+    void scale_target(SDL_Surface& framebuffer);
+
+    /// What rays through the projection plane depend on, besides where the
+    /// camera is and which way it's facing
+    struct view_plane {
+        int width = 0;
+        float near = 0.f;
+        float right = 0.f;
+        float left = 0.f;
     };
 
-    std::array<rendering_context, detail::num_threads> _contexts;
-    std::array<std::thread, detail::num_threads> _threads;
+    /// Per column, the direction of its ray in view space: `x` along the
+    /// camera's forward axis, `y` along the projection plane. The same for
+    /// any camera with the same projection plane, so it's only rebuilt when
+    /// the width or the plane changes.
+    std::vector<mymath::vec2f> _column_rays;
+    view_plane _column_rays_plane;
+    void prepare_column_rays(camera const& cam, int width);
+    /// Size `_next_history` for a frame of `target`.
+    void prepare_history(SDL_Surface const& target);
+
+    /// Where the camera was for a frame, to reproject it later
+    struct view {
+        mymath::point2f position;
+        mymath::vec2f forward;
+        float near = 0.f;
+        float right = 0.f;
+        float left = 0.f;
+    };
+
+    /// A finished frame, before anything else is drawn over it
+    struct frame_history {
+        std::vector<std::uint32_t> pixels;
+        /// Per column, the distance to the nearest hit from the projection
+        /// plane (max float if nothing was hit)
+        std::vector<float> depths;
+        view viewpoint;
+        level const* lvl = nullptr;
+        int width = 0;
+        int height = 0;
+    };
+
+    /// Fill in the columns of `start_column` to `end_column` that weren't
+    /// shaded this frame, and record the whole range in `_next_history`.
+    ///
+    /// @return How many columns were reprojected from `_history`
+    unsigned reconstruct_columns(camera const& cam, SDL_Surface& fb,
+        int start_column, int end_column);
+
+    camera_latch _camera_latch;
+
+    bool _checkerboard = false;
+    /// Columns with this parity are shaded this frame
+    int _frame_parity = 0;
+    /// Whether `_history` is the frame before this one, of the same level
+    /// and size
+    bool _use_history = false;
+    frame_history _history;
+    frame_history _next_history;
+
+    checkerboard_stats _checkerboard_stats;
+    /// Per workset
+    std::vector<float> _shade_ms;
+    std::vector<float> _reconstruct_ms;
+    std::vector<unsigned> _reprojected_columns;
+
+    /// Decode the PVS of the camera's grid cell. Leaves `_use_pvs` false if
+    /// the level has no PVS or the camera is outside the grid.
+    void find_camera_pvs(level const& lvl, camera const& cam);
+
+    bool _use_pvs = false;
+    /// Walls and grid cells that may be visible from the camera's cell
+    pvs_bits _pvs_walls;
+    pvs_bits _pvs_cells;
+
+    /// A sprite that survived culling, with what the workers need to draw it
+    /// worked out once per frame instead of once per column.
+    struct visible_sprite {
+        /// The sprite turned to face the camera
+        mymath::line2f plane;
+        unsigned int texture;
+        /// Range of screen columns the sprite may cover (inclusive)
+        int first_column;
+        int last_column;
+    };
+
+    /// Cull sprites behind the camera, past the far plane, outside the FOV
+    /// or outside the camera's PVS, and bin the rest by the worker whose
+    /// columns they overlap.
+    void cull_sprites(
+        level const& lvl, camera const& cam, int width, float alpha);
+
+    std::vector<visible_sprite> _visible_sprites;
+    /// Indices into `_visible_sprites`, one bin per worker
+    std::vector<std::vector<std::uint32_t>> _sprite_bins;
+    sprite_stats _sprite_stats;
+
+    /// A sector seen through a chain of portals, and the screen columns it
+    /// was seen in. A sector seen through several portals shows up once for
+    /// each.
+    struct visible_sector {
+        std::uint32_t sector;
+        int first_column;
+        int last_column;
+        /// Number of portals between it and the camera
+        unsigned portal_depth;
+    };
+
+    /// Find the sectors visible from the camera by recursively clipping the
+    /// view to the portals leading out of its sector, and bin them by the
+    /// worker whose columns they overlap. Leaves `_use_sectors` false if the
+    /// level has no sectors or the camera is outside all of them, in which
+    /// case the workers walk the wall grid instead.
+    void find_visible_sectors(level const& lvl, camera const& cam, int width);
+
+    bool _use_sectors = false;
+    /// Where the camera was last frame, to speed up finding it again
+    std::uint32_t _camera_sector = no_sector;
+    std::vector<visible_sector> _visible_sectors;
+    /// Sectors whose portals still need to be followed
+    std::vector<visible_sector> _open_sectors;
+    /// Indices into `_visible_sectors`, one bin per worker
+    std::vector<std::vector<std::uint32_t>> _sector_bins;
+
+    /// Which walls a worker tested in the column it's on, since a wall can be
+    /// listed in several grid cells or sectors. Each column gets a new stamp,
+    /// so the stamps are only cleared when they run out, not every frame.
+    struct tested_walls {
+        /// The stamp of the column that last tested each wall, 0 for none
+        std::vector<std::uint32_t> stamps;
+        std::uint32_t stamp = 0;
+
+        /// Get a new stamp for a column of a level with `wall_count` walls
+        void next_column(std::size_t wall_count);
+    };
+
+    /// One per worker
+    std::vector<tested_walls> _tested_walls;
+
+    // Purposefully generic name for a mess of a function
+    void do_work(unsigned thread_id, level const& lvl, camera const& cam, SDL_Surface& fb);
 };
 
 } // namespace raycaster
@@ -0,0 +1,377 @@
+#include "pvs.hpp"
+
+#include "level.hpp"
+
+#include <sdl_application/thread_pool.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace mymath;
+
+namespace {
+
+using namespace raycaster;
+
+/// Keep sample points off the cell's edges, where walls usually are
+constexpr auto sample_inset = 0.01f;
+/// Where targeted rays aim along a wall, avoiding its corners
+constexpr float wall_targets[] = {0.01f, 0.25f, 0.5f, 0.75f, 0.99f};
+/// A targeted ray blocked this close to its end still reaches the wall
+constexpr auto target_tolerance = 0.001f;
+
+//
+// Run-length coding
+//
+
+void put_varint(std::vector<std::uint8_t>& out, std::size_t value)
+{
+    while (value >= 0x80) {
+        out.push_back(static_cast<std::uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<std::uint8_t>(value));
+}
+
+/// @return The decoded value, or 0 (and `p == end`) if the data runs out
+std::size_t get_varint(std::uint8_t const*& p, std::uint8_t const* end)
+{
+    std::size_t value = 0;
+    for (auto shift = 0u; p < end && shift < 64; shift += 7) {
+        auto const byte = *p++;
+        value |= static_cast<std::size_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+    p = end;
+    return 0;
+}
+
+void encode_runs(pvs_bits const& bits, std::vector<std::uint8_t>& out)
+{
+    auto value = false;
+    std::size_t run = 0;
+    for (std::size_t i = 0; i < bits.size; ++i) {
+        if (bits.test(i) != value) {
+            put_varint(out, run);
+            run = 0;
+            value = !value;
+        }
+        ++run;
+    }
+    put_varint(out, run);
+}
+
+void set_range(pvs_bits& bits, std::size_t first, std::size_t last)
+{
+    for (auto i = first; i < last;) {
+        if (i % 64 == 0 && last - i >= 64) {
+            bits.words[i / 64] = ~std::uint64_t{0};
+            i += 64;
+        } else {
+            bits.set(i);
+            ++i;
+        }
+    }
+}
+
+void decode_runs(std::uint8_t const* p, std::uint8_t const* end, std::size_t n,
+    pvs_bits& out)
+{
+    out.reset(n);
+    std::size_t position = 0;
+    auto value = false;
+    while (p < end && position < n) {
+        auto const run = std::min(get_varint(p, end), n - position);
+        if (value) {
+            set_range(out, position, position + run);
+        }
+        position += run;
+        value = !value;
+    }
+}
+
+/// @return The index of the lowest set bit of `word`, the `w`th word
+int bit_index(std::size_t w, std::uint64_t word)
+{
+    auto n = 0;
+    for (; (word & 1) == 0; word >>= 1) {
+        ++n;
+    }
+    return static_cast<int>(w * 64) + n;
+}
+
+//
+// Visibility
+//
+
+struct ray_hit {
+    float t;
+    std::uint32_t wall;
+};
+
+/// Segment intersection, with `t` the factor along `ray`
+bool intersect(line2f const& ray, line2f const& seg, float& t)
+{
+    auto const d = displacement(ray.start, ray.end);
+    auto const e = displacement(seg.start, seg.end);
+    auto const denom = cross(d, e);
+    if (denom == 0.f) {
+        return false;
+    }
+    auto const w = displacement(ray.start, seg.start);
+    t = cross(w, e) / denom;
+    auto const u = cross(w, d) / denom;
+    return t >= 0.f && t <= 1.f && u >= 0.f && u <= 1.f;
+}
+
+class visibility_builder {
+public:
+    visibility_builder(level const& lvl,
+        std::vector<bool> const& opaque_textures, pvs_options const& options)
+    : _lvl{lvl}
+    , _opaque_textures{opaque_textures}
+    , _options{options}
+    {
+        auto const& grid = lvl.grid;
+        _wall_count = std::min(lvl.walls.size(), lvl.first_dynamic_wall);
+        _ray_length = length(
+            vec2f{grid.width * grid.cell_size, grid.height * grid.cell_size});
+    }
+
+    /// Find what's visible from `cell`
+    void build(int cell, pvs_bits& walls, pvs_bits& cells)
+    {
+        auto const& grid = _lvl.grid;
+        walls.reset(_wall_count);
+        cells.reset(static_cast<std::size_t>(grid.cell_count()));
+
+        // Sample points spread over the cell, edges included
+        _samples.clear();
+        auto const cx = cell % grid.width;
+        auto const cy = cell / grid.width;
+        auto const n = std::max(_options.samples_per_axis, 2);
+        for (auto j = 0; j < n; ++j) {
+            for (auto i = 0; i < n; ++i) {
+                auto const fx = sample_inset
+                    + (1.f - 2.f * sample_inset) * i / (n - 1.f);
+                auto const fy = sample_inset
+                    + (1.f - 2.f * sample_inset) * j / (n - 1.f);
+                _samples.push_back(
+                    {grid.origin.x + (cx + fx) * grid.cell_size,
+                        grid.origin.y + (cy + fy) * grid.cell_size});
+            }
+        }
+
+        // Rays in all directions from every sample point
+        auto const ray_count = std::max(_options.rays_per_sample, 1);
+        for (auto const& p : _samples) {
+            for (auto r = 0; r < ray_count; ++r) {
+                auto const angle = 2.f * static_cast<float>(M_PI) * r
+                    / static_cast<float>(ray_count);
+                auto const dir
+                    = vec2f{std::cos(angle), std::sin(angle)} * _ray_length;
+                cast(line2f{p, p + dir}, no_wall, walls, cells);
+            }
+        }
+
+        // Rays can slip past small or distant walls. Aim straight at every
+        // wall near what's been seen so far, from every sample point.
+        _considered.reset(_wall_count);
+        for (auto const c : dilate(cells)) {
+            grid.for_each_wall(c, [&](std::uint32_t w) {
+                if (w >= _wall_count || walls.test(w) || _considered.test(w)) {
+                    return;
+                }
+                _considered.set(w);
+                aim_at(w, walls, cells);
+            });
+        }
+
+        for (auto const c : dilate(cells)) {
+            cells.set(static_cast<std::size_t>(c));
+        }
+    }
+
+private:
+    static constexpr auto no_wall = std::numeric_limits<std::uint32_t>::max();
+
+    bool is_opaque(std::uint32_t wall) const
+    {
+        auto const texture = _lvl.walls[wall].texture;
+        return texture < _opaque_textures.size() && _opaque_textures[texture];
+    }
+
+    /// Mark everything `ray` sees, up to and including the first opaque wall
+    /// other than `ignore`.
+    ///
+    /// @return The factor along `ray` it's blocked at, or more than 1
+    float cast(line2f const& ray, std::uint32_t ignore, pvs_bits& walls,
+        pvs_bits& cells)
+    {
+        auto const& grid = _lvl.grid;
+        auto blocked = std::numeric_limits<float>::max();
+        _hits.clear();
+        grid.traverse(ray, [&](int cell, float t_exit) {
+            cells.set(static_cast<std::size_t>(cell));
+            grid.for_each_wall(cell, [&](std::uint32_t w) {
+                // Dynamic walls can move, so they neither block nor get
+                // culled
+                if (w >= _wall_count) {
+                    return;
+                }
+                auto t = 0.f;
+                if (!intersect(ray, _lvl.walls[w].data, t)) {
+                    return;
+                }
+                _hits.push_back(ray_hit{t, w});
+                if (w != ignore && is_opaque(w)) {
+                    blocked = std::min(blocked, t);
+                }
+            });
+            return blocked > t_exit;
+        });
+
+        for (auto const& hit : _hits) {
+            if (hit.t <= blocked) {
+                walls.set(hit.wall);
+            }
+        }
+        return blocked;
+    }
+
+    void aim_at(std::uint32_t wall, pvs_bits& walls, pvs_bits& cells)
+    {
+        auto const& line = _lvl.walls[wall].data;
+        for (auto const& p : _samples) {
+            for (auto const u : wall_targets) {
+                auto const target = line.start
+                    + displacement(line.start, line.end) * u;
+                if (cast(line2f{p, target}, wall, walls, cells)
+                    >= 1.f - target_tolerance) {
+                    walls.set(wall);
+                    return;
+                }
+            }
+        }
+    }
+
+    /// @return The cells of `cells` and their neighbours
+    std::vector<int> const& dilate(pvs_bits const& cells)
+    {
+        auto const& grid = _lvl.grid;
+        _grown.reset(cells.size);
+        for (std::size_t w = 0; w < cells.words.size(); ++w) {
+            for (auto word = cells.words[w]; word != 0; word &= word - 1) {
+                auto const cell = bit_index(w, word);
+                auto const x = cell % grid.width;
+                auto const y = cell / grid.width;
+                for (auto ny = std::max(y - 1, 0);
+                     ny <= std::min(y + 1, grid.height - 1); ++ny) {
+                    for (auto nx = std::max(x - 1, 0);
+                         nx <= std::min(x + 1, grid.width - 1); ++nx) {
+                        _grown.set(
+                            static_cast<std::size_t>(ny * grid.width + nx));
+                    }
+                }
+            }
+        }
+
+        _dilated.clear();
+        for (std::size_t w = 0; w < _grown.words.size(); ++w) {
+            for (auto word = _grown.words[w]; word != 0; word &= word - 1) {
+                _dilated.push_back(bit_index(w, word));
+            }
+        }
+        return _dilated;
+    }
+
+    level const& _lvl;
+    std::vector<bool> const& _opaque_textures;
+    pvs_options _options;
+    /// Static walls only
+    std::size_t _wall_count = 0;
+    float _ray_length = 0.f;
+
+    std::vector<point2f> _samples;
+    std::vector<ray_hit> _hits;
+    pvs_bits _considered;
+    pvs_bits _grown;
+    std::vector<int> _dilated;
+};
+
+} // namespace
+
+namespace raycaster {
+
+void pvs_bits::reset(std::size_t n)
+{
+    size = n;
+    words.assign((n + 63) / 64, 0);
+}
+
+std::size_t pvs_bits::count() const
+{
+    std::size_t total = 0;
+    for (auto word : words) {
+        for (; word != 0; word &= word - 1) {
+            ++total;
+        }
+    }
+    return total;
+}
+
+void pvs_table::get_walls(int cell, pvs_bits& out) const
+{
+    decode_runs(wall_runs.data() + wall_offsets[cell],
+        wall_runs.data() + wall_offsets[cell + 1], wall_count, out);
+}
+
+void pvs_table::get_cells(int cell, pvs_bits& out) const
+{
+    decode_runs(cell_runs.data() + cell_offsets[cell],
+        cell_runs.data() + cell_offsets[cell + 1], cell_offsets.size() - 1,
+        out);
+}
+
+pvs_table build_pvs(level const& lvl, std::vector<bool> const& opaque_textures,
+    sdl_app::thread_pool& pool, pvs_options const& options)
+{
+    pvs_table table;
+    auto const cell_count = static_cast<std::size_t>(lvl.grid.cell_count());
+    if (lvl.grid.empty()) {
+        return table;
+    }
+
+    // Encoded per cell in parallel, then concatenated
+    std::vector<std::vector<std::uint8_t>> wall_runs(cell_count);
+    std::vector<std::vector<std::uint8_t>> cell_runs(cell_count);
+    pool.parallel_for(cell_count, [&](std::size_t cell) {
+        visibility_builder builder{lvl, opaque_textures, options};
+        pvs_bits walls;
+        pvs_bits cells;
+        builder.build(static_cast<int>(cell), walls, cells);
+        encode_runs(walls, wall_runs[cell]);
+        encode_runs(cells, cell_runs[cell]);
+    });
+
+    table.wall_count = static_cast<std::uint32_t>(
+        std::min(lvl.walls.size(), lvl.first_dynamic_wall));
+    table.wall_offsets.push_back(0);
+    table.cell_offsets.push_back(0);
+    for (std::size_t cell = 0; cell < cell_count; ++cell) {
+        table.wall_runs.insert(table.wall_runs.end(), wall_runs[cell].begin(),
+            wall_runs[cell].end());
+        table.cell_runs.insert(table.cell_runs.end(), cell_runs[cell].begin(),
+            cell_runs[cell].end());
+        table.wall_offsets.push_back(
+            static_cast<std::uint32_t>(table.wall_runs.size()));
+        table.cell_offsets.push_back(
+            static_cast<std::uint32_t>(table.cell_runs.size()));
+    }
+    return table;
+}
+
+} // namespace raycaster
@@ -0,0 +1,88 @@
+/// @file pvs.hpp
+/// @brief Precomputed potentially visible sets.
+///
+/// For each cell of a level's wall grid, the walls and the cells that can be
+/// seen from somewhere inside it. The level compiler builds them offline.
+/// With them, a ray from the camera can stop as soon as it reaches a cell
+/// that can't be seen from the camera's cell, and walls that can't be seen
+/// are never tested.
+///
+/// Visibility is found by casting rays, so it's only as good as the sampling.
+/// Cells next to a visible one count as visible too, to cover for rays that
+/// slip past.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace sdl_app {
+class thread_pool;
+} // namespace sdl_app
+
+namespace raycaster {
+
+struct level;
+
+/// A decoded set: bit `i` is set if wall (or cell) `i` may be visible.
+struct pvs_bits {
+    std::vector<std::uint64_t> words;
+    std::size_t size = 0;
+
+    /// Clear, and make room for `n` bits
+    void reset(std::size_t n);
+
+    void set(std::size_t i) { words[i / 64] |= std::uint64_t{1} << (i % 64); }
+
+    /// Indices past the end (e.g. walls added after the PVS was built) count
+    /// as visible.
+    bool test(std::size_t i) const
+    {
+        return i >= size || ((words[i / 64] >> (i % 64)) & 1) != 0;
+    }
+
+    std::size_t count() const;
+};
+
+/// The potentially visible sets of every grid cell.
+///
+/// Each set is stored run-length compressed: alternating runs of clear and
+/// set bits, starting with a (possibly empty) clear run, each length written
+/// as a LEB128 varint. Visible walls and cells tend to be clustered, so most
+/// sets are a handful of bytes.
+struct pvs_table {
+    /// Byte ranges in `wall_runs`, one per grid cell plus one
+    std::vector<std::uint32_t> wall_offsets;
+    std::vector<std::uint8_t> wall_runs;
+    /// Byte ranges in `cell_runs`, one per grid cell plus one
+    std::vector<std::uint32_t> cell_offsets;
+    std::vector<std::uint8_t> cell_runs;
+    /// Number of walls the sets were built for
+    std::uint32_t wall_count = 0;
+
+    bool empty() const { return wall_offsets.empty(); }
+
+    /// Decode the walls that may be visible from `cell`.
+    void get_walls(int cell, pvs_bits& out) const;
+
+    /// Decode the cells that may be visible from `cell`.
+    void get_cells(int cell, pvs_bits& out) const;
+};
+
+struct pvs_options {
+    /// Points sampled along each axis of a cell
+    int samples_per_axis = 4;
+    /// Rays cast in all directions from each sample point
+    int rays_per_sample = 512;
+};
+
+/// Build the PVS of every cell of `lvl.grid`.
+///
+/// @param opaque_textures Indexed by texid: whether the texture has no
+/// transparent texels. Only walls with opaque textures block the view.
+/// @param pool Cells are processed in parallel on it
+pvs_table build_pvs(level const& lvl, std::vector<bool> const& opaque_textures,
+    sdl_app::thread_pool& pool, pvs_options const& options = {});
+
+} // namespace raycaster
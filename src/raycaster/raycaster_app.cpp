@@ -1,9 +1,11 @@
 #include "raycaster_app.hpp"
 
 #include "camera.hpp"
+#include "collision.hpp"
 #include "intersection.hpp"
 #include "pipeline.hpp"
 #include "pixel_format_debug.hpp"
+#include "scene_query.hpp"
 
 #include <mycolor/mycolor.hpp>
 #include <mymath/mymath.hpp>
@@ -13,7 +15,11 @@
 
 #include <SDL.h>
 
+#include <algorithm>
 #include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
 #include <stdexcept>
 #include <string>
 #include <utility>
@@ -31,9 +37,18 @@ using namespace raycaster;
 constexpr float PI_OVER_2 = M_PI / 2.f;
 constexpr float PI_FLOAT = M_PI;
 
+/// Keeps the camera far enough from walls that they don't clip through the
+/// near plane.
+constexpr auto player_radius = 0.2f;
+
+// Per tick, so the game plays the same at any frame rate
+constexpr auto yaw_step = 0.05f;
+constexpr auto move_step = 0.05f;
+
 constexpr auto L_g_app = "g_app";
 constexpr auto L_g_level = "g_level";
 constexpr auto L_g_camera = "g_camera";
+constexpr auto L_g_render = "g_render";
 constexpr auto L_update = "update";
 
 // My framebuffer set pixel operation has only been tested on the following
@@ -44,94 +59,724 @@ constexpr Uint32 desired_framebuffer_formats[] = {
     SDL_PIXELFORMAT_RGB888,
 };
 
-bool save_screenshot(SDL_Surface* framebuffer, const char* filename)
+/// Sprite handles go to Lua as a single integer
+lua_Integer to_lua_id(entity_handle h)
+{
+    return static_cast<lua_Integer>(
+        (static_cast<std::uint64_t>(h.generation) << 32) | h.index);
+}
+
+entity_handle from_lua_id(lua_Integer id)
 {
-    // Try a straight dump (note: gives undesired results if format includes
-    // alpha)
-    auto const err = SDL_SaveBMP(framebuffer, filename);
-    if (err != 0) {
-        SDL_Log("save_screenshot: SDL_SaveBitmap failed: %s", SDL_GetError());
-        return false;
+    auto const bits = static_cast<std::uint64_t>(id);
+    return entity_handle{static_cast<std::uint32_t>(bits),
+        static_cast<std::uint32_t>(bits >> 32)};
+}
+
+/// Push a table of the histogram's samples, average_ms, p50_ms, p95_ms,
+/// p99_ms, worst_ms, and histogram, where histogram[i] counts samples from
+/// i - 1 to i ms
+void push_histogram(lua_State* L, duration_histogram const& h)
+{
+    lua_createtable(L, 0, 11);
+    lua_pushinteger(L, h.samples);
+    lua_setfield(L, -2, "samples");
+    lua_pushnumber(L, h.average_ms());
+    lua_setfield(L, -2, "average_ms");
+    lua_pushnumber(L, h.percentile_ms(0.5));
+    lua_setfield(L, -2, "p50_ms");
+    lua_pushnumber(L, h.percentile_ms(0.95));
+    lua_setfield(L, -2, "p95_ms");
+    lua_pushnumber(L, h.percentile_ms(0.99));
+    lua_setfield(L, -2, "p99_ms");
+    lua_pushnumber(L, h.worst_ms);
+    lua_setfield(L, -2, "worst_ms");
+
+    lua_createtable(L, duration_histogram::bucket_count, 0);
+    for (auto i = 0; i < duration_histogram::bucket_count; ++i) {
+        lua_pushinteger(L, h.buckets[i]);
+        lua_rawseti(L, -2, i + 1);
     }
+    lua_setfield(L, -2, "histogram");
+}
 
-    return true;
+/// @return `title`, the histogram's stats and its non-empty buckets, as
+/// lines that fit in the console
+std::vector<std::string> describe_histogram(
+    std::string const& title, duration_histogram const& h)
+{
+    char text[128];
+    std::snprintf(text, sizeof(text),
+        "%u samples, avg %.2f ms, p50 %.0f, p95 %.0f, p99 %.0f, worst "
+        "%.2f ms",
+        h.samples, h.average_ms(), h.percentile_ms(0.5),
+        h.percentile_ms(0.95), h.percentile_ms(0.99), h.worst_ms);
+    std::vector<std::string> lines{title, text};
+
+    std::string line;
+    for (auto i = 0; i < duration_histogram::bucket_count; ++i) {
+        if (h.buckets[i] == 0) {
+            continue;
+        }
+        std::snprintf(text, sizeof(text), "%s%d ms: %u  ",
+            i == duration_histogram::bucket_count - 1 ? ">=" : "", i,
+            h.buckets[i]);
+        if (line.size() + std::strlen(text) > 100) {
+            lines.push_back(line);
+            line.clear();
+        }
+        line += text;
+    }
+    if (!line.empty()) {
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+} // namespace
+
+static int luabind_quit(lua_State* L)
+{
+    lua_getglobal(L, L_g_app);
+    auto app = lua::to<raycaster::raycaster_app*>(L);
+    if (!app) {
+        SDL_Log("for some reason, can't get g_app");
+        return 0;
+    }
+    lua_pop(L, 1); // g_app
+
+    app->quit();
+
+    return 0;
 }
 
-bool draw_string(
-    std::string const& str, point2i pos, SDL_Surface* font, SDL_Surface* dest)
+static int luabind_spawn_barrel(lua_State* L)
 {
-    auto const font_size = extent2i{6, 8};
+    lua_getglobal(L, L_g_app);
+    auto app = lua::to<raycaster::raycaster_app*>(L);
+    if (!app) {
+        SDL_Log("for some reason, can't get g_app");
+        return 0;
+    }
+    lua_pop(L, 1); // g_app
 
-    for (auto const& c : str) {
-        if (c == '\0') {
-            break;
+    lua_getglobal(L, L_g_level);
+    auto level = lua::to<raycaster::level*>(L);
+    if (!level) {
+        SDL_Log("for some reason, can't get g_level");
+        return 0;
+    }
+    lua_pop(L, 1); // g_level
+
+    lua_getglobal(L, L_g_camera);
+    auto camera = lua::to<raycaster::camera*>(L);
+    if (!camera) {
+        SDL_Log("for some reason, can't get g_camera");
+        return 0;
+    }
+    lua_pop(L, 1); // g_camera
+
+    auto const barrel = level->sprites.spawn(
+        camera->get_position(), app->get_textures().acquire("barrel.bmp"));
+
+    lua_pushinteger(L, to_lua_id(barrel));
+    return 1;
+}
+
+static int luabind_remove_sprite(lua_State* L)
+{
+    if (lua_gettop(L) != 1 || lua_type(L, 1) != LUA_TNUMBER) {
+        SDL_Log("remove_sprite: expected a sprite id");
+        return 0;
+    }
+    auto const id = lua_tointeger(L, 1);
+    lua_pop(L, 1); // id
+
+    lua_getglobal(L, L_g_level);
+    auto level = lua::to<raycaster::level*>(L);
+    if (!level) {
+        SDL_Log("for some reason, can't get g_level");
+        return 0;
+    }
+    lua_pop(L, 1); // g_level
+
+    lua_pushboolean(L, level->sprites.despawn(from_lua_id(id)));
+    return 1;
+}
+
+static int luabind_add_wall(lua_State* L)
+{
+    auto valid_args = lua_gettop(L) == 5;
+    for (auto i = 1; valid_args && i <= 4; ++i) {
+        valid_args = lua_type(L, i) == LUA_TNUMBER;
+    }
+    if (!valid_args || lua_type(L, 5) != LUA_TSTRING) {
+        SDL_Log("add_wall: expected x1, y1, x2, y2, texture");
+        return 0;
+    }
+    for (auto i = 1; i <= 4; ++i) {
+        if (!std::isfinite(lua_tonumber(L, i))) {
+            SDL_Log("add_wall: coordinates must be finite");
+            return 0;
         }
+    }
+    auto const line = line2f{{lua::to<float>(L, 1), lua::to<float>(L, 2)},
+        {lua::to<float>(L, 3), lua::to<float>(L, 4)}};
+    auto const texture_name = lua::to<std::string>(L, 5);
+    lua_pop(L, 5); // args
 
-        auto src_rect = SDL_Rect{c * font_size.w, 0, font_size.w, font_size.h};
-        auto dst_rect = SDL_Rect{pos.x, pos.y, font_size.w, font_size.h};
-        if (SDL_BlitSurface(font, &src_rect, dest, &dst_rect) != 0) {
-            return false;
+    lua_getglobal(L, L_g_app);
+    auto app = lua::to<raycaster::raycaster_app*>(L);
+    if (!app) {
+        SDL_Log("for some reason, can't get g_app");
+        return 0;
+    }
+    lua_pop(L, 1); // g_app
+
+    lua_getglobal(L, L_g_level);
+    auto level = lua::to<raycaster::level*>(L);
+    if (!level) {
+        SDL_Log("for some reason, can't get g_level");
+        return 0;
+    }
+    lua_pop(L, 1); // g_level
+
+    std::size_t index;
+    try {
+        index = add_dynamic_wall(
+            *level, line, app->get_textures().acquire(texture_name));
+    } catch (std::invalid_argument const& e) {
+        SDL_Log("add_wall: %s", e.what());
+        return 0;
+    }
+
+    // Same numbering as the wall indices returned by raycast()
+    lua_pushinteger(L, static_cast<lua_Integer>(index + 1));
+    return 1;
+}
+
+static int luabind_move_wall(lua_State* L)
+{
+    auto valid_args = lua_gettop(L) == 5;
+    for (auto i = 1; valid_args && i <= 5; ++i) {
+        valid_args = lua_type(L, i) == LUA_TNUMBER;
+    }
+    if (!valid_args) {
+        SDL_Log("move_wall: expected id, x1, y1, x2, y2");
+        return 0;
+    }
+    for (auto i = 2; i <= 5; ++i) {
+        if (!std::isfinite(lua_tonumber(L, i))) {
+            SDL_Log("move_wall: coordinates must be finite");
+            return 0;
+        }
+    }
+    auto const id = lua_tointeger(L, 1);
+    auto const line = line2f{{lua::to<float>(L, 2), lua::to<float>(L, 3)},
+        {lua::to<float>(L, 4), lua::to<float>(L, 5)}};
+    lua_pop(L, 5); // args
+
+    lua_getglobal(L, L_g_level);
+    auto level = lua::to<raycaster::level*>(L);
+    if (!level) {
+        SDL_Log("for some reason, can't get g_level");
+        return 0;
+    }
+    lua_pop(L, 1); // g_level
+
+    lua_pushboolean(L,
+        id > 0
+            && move_dynamic_wall(
+                *level, static_cast<std::size_t>(id - 1), line));
+    return 1;
+}
+
+static int luabind_set_wall_enabled(lua_State* L)
+{
+    if (lua_gettop(L) != 2 || lua_type(L, 1) != LUA_TNUMBER
+        || lua_type(L, 2) != LUA_TBOOLEAN) {
+        SDL_Log("set_wall_enabled: expected id, enabled");
+        return 0;
+    }
+    auto const id = lua_tointeger(L, 1);
+    auto const enabled = lua_toboolean(L, 2) != 0;
+    lua_pop(L, 2); // args
+
+    lua_getglobal(L, L_g_level);
+    auto level = lua::to<raycaster::level*>(L);
+    if (!level) {
+        SDL_Log("for some reason, can't get g_level");
+        return 0;
+    }
+    lua_pop(L, 1); // g_level
+
+    lua_pushboolean(L,
+        id > 0
+            && set_dynamic_wall_enabled(
+                *level, static_cast<std::size_t>(id - 1), enabled));
+    return 1;
+}
+
+static int luabind_get_camera(lua_State* L)
+{
+    lua_getglobal(L, L_g_camera);
+    auto camera = lua::to<raycaster::camera*>(L);
+    if (!camera) {
+        SDL_Log("for some reason, can't get g_camera");
+        return 0;
+    }
+    lua_pop(L, 1); // g_camera
+
+    lua_pushnumber(L, camera->get_position().x);
+    lua_pushnumber(L, camera->get_position().y);
+    lua_pushnumber(L, camera->get_rotation());
+    return 3;
+}
+
+static int luabind_raycast(lua_State* L)
+{
+    auto const nargs = lua_gettop(L);
+    auto valid_args = nargs >= 4 && nargs <= 6;
+    for (auto i = 1; valid_args && i <= 4; ++i) {
+        valid_args = lua_type(L, i) == LUA_TNUMBER;
+    }
+    for (auto i = 5; valid_args && i <= nargs; ++i) {
+        valid_args = lua_type(L, i) == LUA_TSTRING || lua_isnil(L, i);
+    }
+    if (!valid_args) {
+        SDL_Log("raycast: expected x, y, angle, distance[, kinds[, texture]]");
+        return 0;
+    }
+
+    auto const origin = point2f{lua::to<float>(L, 1), lua::to<float>(L, 2)};
+    auto const direction = vector2f{lua::to<float>(L, 3), lua::to<float>(L, 4)};
+
+    auto mask = static_cast<unsigned>(hit_anything);
+    if (nargs >= 5 && !lua_isnil(L, 5)) {
+        auto const kinds = lua::to<std::string>(L, 5);
+        if (kinds == "walls") {
+            mask = hit_walls;
+        } else if (kinds == "sprites") {
+            mask = hit_sprites;
+        } else if (kinds != "any") {
+            SDL_Log("raycast: kinds must be \"walls\", \"sprites\" or "
+                    "\"any\"");
+            return 0;
         }
+    }
 
-        pos.x += font_size.w;
+    lua_getglobal(L, L_g_app);
+    auto app = lua::to<raycaster::raycaster_app*>(L);
+    if (!app) {
+        SDL_Log("for some reason, can't get g_app");
+        return 0;
+    }
+    lua_pop(L, 1); // g_app
+
+    lua_getglobal(L, L_g_level);
+    auto level = lua::to<raycaster::level*>(L);
+    if (!level) {
+        SDL_Log("for some reason, can't get g_level");
+        return 0;
+    }
+    lua_pop(L, 1); // g_level
+
+    // Only look the texture up, so a query never loads one. No sprite can
+    // have a texture that isn't loaded, so then no sprite can be hit.
+    auto sprite_texture = any_sprite_texture;
+    if (nargs >= 6 && !lua_isnil(L, 6)
+        && !app->get_textures().find(
+            lua::to<std::string>(L, 6), sprite_texture)) {
+        mask &= ~static_cast<unsigned>(hit_sprites);
+    }
+
+    auto const hit = raycast(
+        *level, line2f{origin, origin + direction}, mask, sprite_texture);
+    if (!hit) {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    lua_pushstring(L, hit.kind == hit_kind::wall ? "wall" : "sprite");
+    lua_pushnumber(L, hit.distance);
+    lua_pushnumber(L, hit.position.x);
+    lua_pushnumber(L, hit.position.y);
+    if (hit.kind == hit_kind::wall) {
+        // Lua counts from 1
+        lua_pushinteger(L, static_cast<lua_Integer>(hit.wall + 1));
+    } else {
+        lua_pushinteger(L, to_lua_id(hit.sprite));
+    }
+    return 5;
+}
+
+static int luabind_load_level(lua_State* L)
+{
+    if (lua_gettop(L) != 1) {
+        SDL_Log("Not enough args!");
+        return 0;
+    }
+
+    if (lua_type(L, -1) != LUA_TSTRING) {
+        SDL_Log("Expected string for filename, didn't get!");
+        return 0;
+    }
+    auto filename = lua::to<std::string>(L);
+    lua_pop(L, 1); // filename
+
+    lua_getglobal(L, L_g_app);
+    auto app = lua::to<raycaster::raycaster_app*>(L);
+    if (!app) {
+        SDL_Log("Couldn't get g_app, bad lua state?");
+        return 0;
+    }
+    lua_pop(L, 1); // g_app
+
+    try {
+        app->change_level(
+            raycaster::load_level(filename, L, app->get_asset_pack()));
+    } catch (std::exception& e) {
+        SDL_Log("Failed to load level: %s", e.what());
+        return 0;
+    }
+
+    return 0;
+}
+
+static int luabind_load_world(lua_State* L)
+{
+    auto const nargs = lua_gettop(L);
+    if (nargs < 1 || nargs > 2 || lua_type(L, 1) != LUA_TSTRING
+        || (nargs == 2 && lua_type(L, 2) != LUA_TNUMBER)) {
+        SDL_Log("load_world: expected a directory[, budget in MB]");
+        return 0;
+    }
+    auto const dir = lua::to<std::string>(L, 1);
+    auto const budget_mb = nargs == 2 ? lua_tonumber(L, 2) : 64.;
+    lua_pop(L, nargs); // args
+
+    lua_getglobal(L, L_g_app);
+    auto app = lua::to<raycaster::raycaster_app*>(L);
+    if (!app) {
+        SDL_Log("Couldn't get g_app, bad lua state?");
+        return 0;
+    }
+    lua_pop(L, 1); // g_app
+
+    try {
+        app->load_world(dir,
+            static_cast<std::size_t>(std::max(budget_mb, 0.) * 1024 * 1024));
+    } catch (std::exception& e) {
+        SDL_Log("Failed to load world: %s", e.what());
+    }
+
+    return 0;
+}
+
+static int luabind_preload_level(lua_State* L)
+{
+    if (lua_gettop(L) != 1 || lua_type(L, -1) != LUA_TSTRING) {
+        SDL_Log("preload_level: expected a filename");
+        return 0;
+    }
+    auto filename = lua::to<std::string>(L);
+    lua_pop(L, 1); // filename
+
+    lua_getglobal(L, L_g_app);
+    auto app = lua::to<raycaster::raycaster_app*>(L);
+    if (!app) {
+        SDL_Log("Couldn't get g_app, bad lua state?");
+        return 0;
+    }
+    lua_pop(L, 1); // g_app
+
+    app->get_level_loader().preload(filename);
+
+    return 0;
+}
+
+static int luabind_level_ready(lua_State* L)
+{
+    if (lua_gettop(L) != 1 || lua_type(L, -1) != LUA_TSTRING) {
+        SDL_Log("level_ready: expected a filename");
+        return 0;
+    }
+    auto filename = lua::to<std::string>(L);
+    lua_pop(L, 1); // filename
+
+    lua_getglobal(L, L_g_app);
+    auto app = lua::to<raycaster::raycaster_app*>(L);
+    if (!app) {
+        SDL_Log("Couldn't get g_app, bad lua state?");
+        return 0;
+    }
+    lua_pop(L, 1); // g_app
+
+    lua_pushboolean(L,
+        app->get_level_loader().get_status(filename)
+            == level_loader::status::ready);
+    return 1;
+}
+
+static int luabind_switch_level(lua_State* L)
+{
+    if (lua_gettop(L) != 1 || lua_type(L, -1) != LUA_TSTRING) {
+        SDL_Log("switch_level: expected a filename");
+        return 0;
+    }
+    auto filename = lua::to<std::string>(L);
+    lua_pop(L, 1); // filename
+
+    lua_getglobal(L, L_g_app);
+    auto app = lua::to<raycaster::raycaster_app*>(L);
+    if (!app) {
+        SDL_Log("Couldn't get g_app, bad lua state?");
+        return 0;
+    }
+    lua_pop(L, 1); // g_app
+
+    app->request_level_switch(std::move(filename));
+
+    return 0;
+}
+
+static int luabind_set_shading_rates(lua_State* L)
+{
+    auto const nargs = lua_gettop(L);
+    auto valid_args
+        = (nargs == 1 || nargs == 4) && lua_type(L, 1) == LUA_TBOOLEAN;
+    for (auto i = 2; valid_args && i <= nargs; ++i) {
+        valid_args = lua_type(L, i) == LUA_TNUMBER;
+    }
+    if (!valid_args) {
+        SDL_Log("set_shading_rates: expected enabled[, floor_2x1, floor_2x2, "
+                "walls_2x1]");
+        return 0;
+    }
+
+    lua_getglobal(L, L_g_app);
+    auto app = lua::to<raycaster::raycaster_app*>(L);
+    if (!app) {
+        SDL_Log("Couldn't get g_app, bad lua state?");
+        return 0;
+    }
+    lua_pop(L, 1); // g_app
+
+    auto rates = app->get_pipeline().get_shading_rates();
+    rates.enabled = lua_toboolean(L, 1) != 0;
+    if (nargs == 4) {
+        rates.floor_2x1_distance = lua::to<float>(L, 2);
+        rates.floor_2x2_distance = lua::to<float>(L, 3);
+        rates.wall_2x1_distance = lua::to<float>(L, 4);
+    }
+    lua_pop(L, nargs); // args
+
+    app->get_pipeline().set_shading_rates(rates);
+    return 0;
+}
+
+static char const* const pacing_mode_names[] = {
+    "uncapped",
+    "fixed",
+    "power_saver",
+};
+
+static int luabind_set_frame_pacing(lua_State* L)
+{
+    auto const nargs = lua_gettop(L);
+    if (nargs < 1 || nargs > 2 || lua_type(L, 1) != LUA_TSTRING
+        || (nargs == 2 && lua_type(L, 2) != LUA_TNUMBER)) {
+        SDL_Log("set_frame_pacing: expected a mode[, target fps]");
+        return 0;
+    }
+    auto const name = lua::to<std::string>(L, 1);
+    auto const fps = nargs == 2 ? lua_tonumber(L, 2) : 0.;
+    lua_pop(L, nargs); // args
+
+    auto mode = -1;
+    for (auto i = 0; i < 3; ++i) {
+        if (name == pacing_mode_names[i]) {
+            mode = i;
+        }
+    }
+    if (mode < 0 || (nargs == 2 && fps <= 0.)) {
+        SDL_Log("set_frame_pacing: mode must be \"uncapped\", \"fixed\" or "
+                "\"power_saver\", and fps positive");
+        return 0;
+    }
+
+    lua_getglobal(L, L_g_app);
+    auto app = lua::to<raycaster::raycaster_app*>(L);
+    if (!app) {
+        SDL_Log("Couldn't get g_app, bad lua state?");
+        return 0;
+    }
+    lua_pop(L, 1); // g_app
+
+    auto& pacer = app->get_frame_pacer();
+    pacer.set_mode(static_cast<pacing_mode>(mode));
+    if (nargs == 2) {
+        pacer.set_target_fps(fps);
+    }
+    pacer.reset_stats();
+    return 0;
+}
+
+static int luabind_get_frame_pacing(lua_State* L)
+{
+    lua_getglobal(L, L_g_app);
+    auto app = lua::to<raycaster::raycaster_app*>(L);
+    if (!app) {
+        SDL_Log("Couldn't get g_app, bad lua state?");
+        return 0;
+    }
+    lua_pop(L, 1); // g_app
+
+    auto const& pacer = app->get_frame_pacer();
+    auto const& stats = pacer.get_stats();
+    push_histogram(L, stats.frame_times);
+    lua_pushstring(L, pacing_mode_names[static_cast<int>(pacer.get_mode())]);
+    lua_setfield(L, -2, "mode");
+    lua_pushnumber(L, pacer.get_target_fps());
+    lua_setfield(L, -2, "target_fps");
+    lua_pushinteger(L, stats.missed_deadlines);
+    lua_setfield(L, -2, "missed_deadlines");
+    lua_pushnumber(L, pacer.get_spin_margin_ms());
+    lua_setfield(L, -2, "spin_margin_ms");
+    return 1;
+}
+
+static int luabind_print_frame_pacing(lua_State* L)
+{
+    lua_getglobal(L, L_g_app);
+    auto app = lua::to<raycaster::raycaster_app*>(L);
+    if (!app) {
+        SDL_Log("Couldn't get g_app, bad lua state?");
+        return 0;
+    }
+    lua_pop(L, 1); // g_app
+
+    app->print_frame_pacing();
+    return 0;
+}
+
+static int luabind_get_input_latency(lua_State* L)
+{
+    lua_getglobal(L, L_g_app);
+    auto app = lua::to<raycaster::raycaster_app*>(L);
+    if (!app) {
+        SDL_Log("Couldn't get g_app, bad lua state?");
+        return 0;
     }
+    lua_pop(L, 1); // g_app
 
-    return true;
+    push_histogram(L, app->get_input_latency());
+    lua_pushboolean(L, app->get_late_latching());
+    lua_setfield(L, -2, "late_latching");
+    return 1;
 }
 
-} // namespace
-
-static int luabind_quit(lua_State* L)
+static int luabind_print_input_latency(lua_State* L)
 {
     lua_getglobal(L, L_g_app);
     auto app = lua::to<raycaster::raycaster_app*>(L);
     if (!app) {
-        SDL_Log("for some reason, can't get g_app");
+        SDL_Log("Couldn't get g_app, bad lua state?");
         return 0;
     }
     lua_pop(L, 1); // g_app
 
-    app->quit();
-
+    app->print_input_latency();
     return 0;
 }
 
-static int luabind_spawn_barrel(lua_State* L)
+static int luabind_set_late_latching(lua_State* L)
 {
-    lua_getglobal(L, L_g_level);
-    auto level = lua::to<raycaster::level*>(L);
-    if (!level) {
-        SDL_Log("for some reason, can't get g_level");
+    if (lua_gettop(L) != 1 || lua_type(L, 1) != LUA_TBOOLEAN) {
+        SDL_Log("set_late_latching: expected enabled");
         return 0;
     }
-    lua_pop(L, 1); // g_level
+    auto const enabled = lua_toboolean(L, 1) != 0;
+    lua_pop(L, 1); // enabled
 
-    lua_getglobal(L, L_g_camera);
-    auto camera = lua::to<raycaster::camera*>(L);
-    if (!camera) {
-        SDL_Log("for some reason, can't get g_camera");
+    lua_getglobal(L, L_g_app);
+    auto app = lua::to<raycaster::raycaster_app*>(L);
+    if (!app) {
+        SDL_Log("Couldn't get g_app, bad lua state?");
         return 0;
     }
-    lua_pop(L, 1); // g_camera
-
-    level->sprites.push_back(raycaster::sprite{camera->get_position(), 8});
+    lua_pop(L, 1); // g_app
 
+    app->set_late_latching(enabled);
     return 0;
 }
 
-static int luabind_load_level(lua_State* L)
+/// g_render's __index: `g_render.threads` and so on read the pipeline's
+/// render_settings
+static int luabind_get_render_setting(lua_State* L)
 {
-    if (lua_gettop(L) != 1) {
-        SDL_Log("Not enough args!");
+    if (lua_gettop(L) != 2 || lua_type(L, 2) != LUA_TSTRING) {
+        SDL_Log("g_render: expected a setting's name");
         return 0;
     }
+    auto const name = lua::to<std::string>(L, 2);
+    lua_pop(L, 2); // table, name
 
-    if (lua_type(L, -1) != LUA_TSTRING) {
-        SDL_Log("Expected string for filename, didn't get!");
+    lua_getglobal(L, L_g_app);
+    auto app = lua::to<raycaster::raycaster_app*>(L);
+    if (!app) {
+        SDL_Log("Couldn't get g_app, bad lua state?");
         return 0;
     }
-    auto filename = lua::to<std::string>(L);
-    lua_pop(L, 1); // filename
+    lua_pop(L, 1); // g_app
+
+    auto const& settings = app->get_pipeline().get_render_settings();
+    if (name == "threads") {
+        lua_pushinteger(L, settings.threads);
+    } else if (name == "resolution") {
+        if (settings.resolution.w == 0) {
+            lua_pushnil(L);
+        } else {
+            lua_createtable(L, 2, 0);
+            lua_pushinteger(L, settings.resolution.w);
+            lua_rawseti(L, -2, 1);
+            lua_pushinteger(L, settings.resolution.h);
+            lua_rawseti(L, -2, 2);
+        }
+    } else if (name == "far_plane") {
+        lua_pushnumber(L, settings.far_plane);
+    } else if (name == "fog") {
+        lua_pushboolean(L, settings.fog);
+    } else if (name == "floor") {
+        lua_pushboolean(L, settings.floor);
+    } else if (name == "textures") {
+        lua_pushboolean(L, settings.textures);
+    } else {
+        lua_pushnil(L);
+    }
+    return 1;
+}
+
+/// `value` truncated to an int if it's from `lo` to `hi`, else `lo` or `hi`
+/// (`lo` for NaN). Casting a double that doesn't fit is undefined, and the
+/// clamped value is still out of range for set_render_settings() to reject.
+static int clamp_to_int(double value, int lo, int hi)
+{
+    if (!(value > lo)) {
+        return lo;
+    }
+    return value < hi ? static_cast<int>(value) : hi;
+}
+
+/// g_render's __newindex: `g_render.threads = 8` and so on change the
+/// pipeline's render_settings from the next frame
+static int luabind_set_render_setting(lua_State* L)
+{
+    if (lua_gettop(L) != 3 || lua_type(L, 2) != LUA_TSTRING) {
+        SDL_Log("g_render: expected a setting's name and value");
+        return 0;
+    }
+    auto const name = lua::to<std::string>(L, 2);
 
     lua_getglobal(L, L_g_app);
     auto app = lua::to<raycaster::raycaster_app*>(L);
@@ -141,13 +786,69 @@ static int luabind_load_level(lua_State* L)
     }
     lua_pop(L, 1); // g_app
 
+    auto settings = app->get_pipeline().get_render_settings();
+    auto const type = lua_type(L, 3);
+    auto valid = true;
+    if (name == "threads" && type == LUA_TNUMBER) {
+        auto const too_many
+            = static_cast<int>(render_settings::max_threads) + 1;
+        settings.threads = static_cast<unsigned>(
+            clamp_to_int(lua_tonumber(L, 3), 0, too_many));
+    } else if (name == "resolution" && type == LUA_TNIL) {
+        settings.resolution = extent2i{0, 0};
+    } else if (name == "resolution" && type == LUA_TTABLE) {
+        lua_geti(L, 3, 1);
+        lua_geti(L, 3, 2);
+        valid = lua_type(L, -2) == LUA_TNUMBER
+            && lua_type(L, -1) == LUA_TNUMBER;
+        auto const too_big = render_settings::max_resolution + 1;
+        settings.resolution
+            = extent2i{clamp_to_int(lua_tonumber(L, -2), -1, too_big),
+                clamp_to_int(lua_tonumber(L, -1), -1, too_big)};
+        lua_pop(L, 2); // w, h
+    } else if (name == "far_plane" && type == LUA_TNUMBER) {
+        // Doubles past float's range are undefined to convert, so they're
+        // made infinite for set_render_settings() to reject
+        auto const far_plane = lua_tonumber(L, 3);
+        settings.far_plane
+            = std::abs(far_plane) <= std::numeric_limits<float>::max()
+            ? static_cast<float>(far_plane)
+            : std::numeric_limits<float>::infinity();
+    } else if (name == "fog" && type == LUA_TBOOLEAN) {
+        settings.fog = lua_toboolean(L, 3) != 0;
+    } else if (name == "floor" && type == LUA_TBOOLEAN) {
+        settings.floor = lua_toboolean(L, 3) != 0;
+    } else if (name == "textures" && type == LUA_TBOOLEAN) {
+        settings.textures = lua_toboolean(L, 3) != 0;
+    } else {
+        valid = false;
+    }
+    lua_pop(L, 3); // table, name, value
+
+    if (!valid) {
+        SDL_Log("g_render: no setting %s of that type", name.c_str());
+        return 0;
+    }
     try {
-        app->change_level(raycaster::load_level(filename, L));
-    } catch (std::exception& e) {
-        SDL_Log("Failed to load level: %s", e.what());
+        app->get_pipeline().set_render_settings(settings);
+    } catch (std::exception const& e) {
+        // Out of range, or a resolution too big to allocate
+        SDL_Log("g_render.%s: %s", name.c_str(), e.what());
+    }
+    return 0;
+}
+
+static int luabind_print_render_settings(lua_State* L)
+{
+    lua_getglobal(L, L_g_app);
+    auto app = lua::to<raycaster::raycaster_app*>(L);
+    if (!app) {
+        SDL_Log("Couldn't get g_app, bad lua state?");
         return 0;
     }
+    lua_pop(L, 1); // g_app
 
+    app->print_render_settings();
     return 0;
 }
 
@@ -156,35 +857,58 @@ namespace raycaster {
 raycaster_app::raycaster_app(std::shared_ptr<sdl::sdl_init> sdl,
     sdl::window window, std::unique_ptr<input_buffer> input,
     std::unique_ptr<asset_store> assets,
+    std::unique_ptr<texture_registry> textures,
     std::unique_ptr<render_pipeline> pipeline, lua::state L, camera cam)
 : sdl_application(
       std::move(sdl), std::move(window), std::move(input), std::move(assets))
+, _textures{std::move(textures)}
 , _pipeline{std::move(pipeline)}
 , _L{std::move(L)}
+, _level_loader{*_textures, get_asset_store().get_pack()}
 , _camera{cam}
+, _previous_camera_position{cam.get_position()}
+, _previous_camera_rotation{cam.get_rotation()}
 {
-    auto framebuffer = get_framebuffer();
-    auto found_format = false;
-    for (auto const& want_format : desired_framebuffer_formats) {
-        if (framebuffer->format->format == want_format) {
-            found_format = true;
-            break;
-        }
-    }
-
-    if (!found_format) {
-        SDL_Log("Invalid surface format!");
-        SDL_Log("GOT:");
-        print_pixel_format(framebuffer->format->format);
-        throw std::runtime_error{"invalid surface format! See log"};
-    }
+    framebuffer_changed(*get_framebuffer());
 
-    _font_texture = get_asset_store().get_asset("6x8-terminal-mspaint.bmp");
+    _barrel_texture = _textures->acquire("barrel.bmp");
+    _barrel_explode_texture = _textures->acquire("barrel_explode.bmp");
 
     // register a basic C function
     lua_register(_L.get(), "quit", &luabind_quit);
     lua_register(_L.get(), "spawn_barrel", &luabind_spawn_barrel);
+    lua_register(_L.get(), "remove_sprite", &luabind_remove_sprite);
+    lua_register(_L.get(), "add_wall", &luabind_add_wall);
+    lua_register(_L.get(), "move_wall", &luabind_move_wall);
+    lua_register(_L.get(), "set_wall_enabled", &luabind_set_wall_enabled);
+    lua_register(_L.get(), "get_camera", &luabind_get_camera);
+    lua_register(_L.get(), "raycast", &luabind_raycast);
     lua_register(_L.get(), "load_level", &luabind_load_level);
+    lua_register(_L.get(), "load_world", &luabind_load_world);
+    lua_register(_L.get(), "preload_level", &luabind_preload_level);
+    lua_register(_L.get(), "level_ready", &luabind_level_ready);
+    lua_register(_L.get(), "switch_level", &luabind_switch_level);
+    lua_register(_L.get(), "set_shading_rates", &luabind_set_shading_rates);
+    lua_register(_L.get(), "set_frame_pacing", &luabind_set_frame_pacing);
+    lua_register(_L.get(), "get_frame_pacing", &luabind_get_frame_pacing);
+    lua_register(_L.get(), "print_frame_pacing", &luabind_print_frame_pacing);
+    lua_register(_L.get(), "get_input_latency", &luabind_get_input_latency);
+    lua_register(
+        _L.get(), "print_input_latency", &luabind_print_input_latency);
+    lua_register(_L.get(), "set_late_latching", &luabind_set_late_latching);
+    lua_register(
+        _L.get(), "print_render_settings", &luabind_print_render_settings);
+
+    // g_render is an empty table whose fields are looked up in, and
+    // assigned to, the pipeline's settings
+    lua_newtable(_L.get());
+    lua_createtable(_L.get(), 0, 2);
+    lua_pushcfunction(_L.get(), &luabind_get_render_setting);
+    lua_setfield(_L.get(), -2, "__index");
+    lua_pushcfunction(_L.get(), &luabind_set_render_setting);
+    lua_setfield(_L.get(), -2, "__newindex");
+    lua_setmetatable(_L.get(), -2);
+    lua_setglobal(_L.get(), L_g_render);
 
     lua_pushlightuserdata(_L.get(), this);
     lua_setglobal(_L.get(), L_g_app);
@@ -193,21 +917,303 @@ raycaster_app::raycaster_app(std::shared_ptr<sdl::sdl_init> sdl,
     lua_setglobal(_L.get(), L_g_camera);
 
     _console.set_callback([this](std::string const& cmd) {
-        if (luaL_dostring(_L.get(), cmd.data())) {
-            _console.log("LUA ERROR: "s + lua::to<char const*>(_L.get()));
+        if (_player) {
+            // Replayed commands run at the frame they were recorded at
+            return;
         }
+        if (_recorder) {
+            _recorder->record_command(cmd);
+        }
+        run_command(cmd);
     });
 } // namespace raycaster
 
 void raycaster_app::change_level(std::unique_ptr<level> level)
 {
+    // A level replaces the streamed world, if any
+    _world.reset();
+    set_level(std::move(level));
+
+    _camera.set_position(_level->player_start);
+    _camera.set_rotation(0.f);
+    snap_camera();
+}
+
+void raycaster_app::load_world(std::string const& dir, std::size_t budget_bytes)
+{
+    auto const manifest = load_world_manifest(dir, _L.get(), get_asset_pack());
+
+    world_options options;
+    options.chunk_size = manifest.chunk_size;
+    options.budget_bytes = budget_bytes;
+    _world = std::make_unique<world_streamer>(*_textures,
+        make_chunk_directory_source(dir, get_asset_store().get_pack()),
+        options);
+    _pending_level.clear();
+
+    // Nothing to play until the chunks around the start have loaded
+    _level.reset();
+    lua_pushlightuserdata(_L.get(), nullptr);
+    lua_setglobal(_L.get(), L_g_level);
+
+    _camera.set_position(manifest.player_start);
+    _camera.set_rotation(0.f);
+    snap_camera();
+}
+
+void raycaster_app::set_level(std::unique_ptr<level> level)
+{
+    bind_textures(*level, *_textures);
     _level = std::move(level);
 
     lua_pushlightuserdata(_L.get(), _level.get());
     lua_setglobal(_L.get(), L_g_level);
+}
 
-    _camera.set_position(_level->player_start);
-    _camera.set_rotation(0.f);
+level_loader& raycaster_app::get_level_loader() { return _level_loader; }
+
+texture_registry& raycaster_app::get_textures() { return *_textures; }
+
+render_pipeline& raycaster_app::get_pipeline() { return *_pipeline; }
+
+sdl_app::asset_pack const* raycaster_app::get_asset_pack()
+{
+    return get_asset_store().get_pack().get();
+}
+
+void raycaster_app::request_level_switch(std::string filename)
+{
+    _level_loader.preload(filename);
+    _pending_level = std::move(filename);
+}
+
+void raycaster_app::print_frame_pacing()
+{
+    auto const& pacer = get_frame_pacer();
+    auto const& stats = pacer.get_stats();
+
+    char title[128];
+    std::snprintf(title, sizeof(title),
+        "Frame times, %s %.0f fps, %u missed, spin %.2f ms",
+        pacing_mode_names[static_cast<int>(pacer.get_mode())],
+        pacer.get_target_fps(), stats.missed_deadlines,
+        pacer.get_spin_margin_ms());
+    for (auto const& line : describe_histogram(title, stats.frame_times)) {
+        SDL_Log("%s", line.c_str());
+        _console.log(line);
+    }
+}
+
+void raycaster_app::print_render_settings()
+{
+    auto const& settings = _pipeline->get_render_settings();
+    char resolution[32] = "native";
+    if (settings.resolution.w > 0) {
+        std::snprintf(resolution, sizeof(resolution), "%dx%d",
+            settings.resolution.w, settings.resolution.h);
+    }
+    char line[128];
+    std::snprintf(line, sizeof(line),
+        "Render: %u threads, %s, far plane %.1f, fog %s, floor %s, "
+        "textures %s",
+        settings.threads, resolution,
+        settings.far_plane > 0.f ? settings.far_plane : _camera.get_far(),
+        settings.fog ? "on" : "off", settings.floor ? "on" : "off",
+        settings.textures ? "on" : "off");
+    SDL_Log("%s", line);
+    _console.log(line);
+}
+
+void raycaster_app::print_input_latency()
+{
+    auto const title = "Input latency, late latching "s
+        + (_late_latching ? "on" : "off");
+    for (auto const& line : describe_histogram(title, get_input_latency())) {
+        SDL_Log("%s", line.c_str());
+        _console.log(line);
+    }
+}
+
+void raycaster_app::set_late_latching(bool enabled)
+{
+    _late_latching = enabled;
+    if (enabled) {
+        _pipeline->set_camera_latch(
+            [this](camera& cam) { latch_camera(cam); });
+    } else {
+        _pipeline->set_camera_latch(nullptr);
+    }
+    reset_input_latency();
+}
+
+bool raycaster_app::get_late_latching() const { return _late_latching; }
+
+void raycaster_app::latch_camera(camera& cam)
+{
+    // A replay only takes input from the recording, and update() doesn't
+    // turn the camera with the console open
+    if (_player || _console.is_open() || !_level) {
+        return;
+    }
+
+    // Only turning is latched, the rest of the input waits for the next tick
+    latch_input({SDL_SCANCODE_A, SDL_SCANCODE_D});
+
+    // Turn from where the last tick left the camera the way the keys held
+    // right now will turn it next tick, so the view keeps up with them
+    // instead of trailing a tick behind. Turning is where lag is felt the
+    // most; movement stays interpolated, since it has to slide along walls.
+    auto const& input_buffer = get_input_buffer();
+    auto turn = 0.f;
+    if (input_buffer.is_pressed(SDL_SCANCODE_A)) {
+        turn += yaw_step;
+    }
+    if (input_buffer.is_pressed(SDL_SCANCODE_D)) {
+        turn -= yaw_step;
+    }
+    cam.set_rotation(_camera.get_rotation() + turn * get_tick_alpha());
+}
+
+void raycaster_app::record_input(
+    std::unique_ptr<sdl_app::input_recorder> recorder)
+{
+    _recorder = std::move(recorder);
+}
+
+void raycaster_app::replay_input(
+    std::unique_ptr<sdl_app::input_player> player, bool timedemo)
+{
+    _player = std::move(player);
+    _timedemo = timedemo;
+    // One recorded tick per frame, so the timedemo renders every one of them
+    // as fast as it can
+    if (timedemo) {
+        get_frame_pacer().set_mode(pacing_mode::uncapped);
+    }
+    set_lockstep(timedemo);
+    _frame_times_ms.clear();
+    _last_frame_start = 0u;
+}
+
+bool raycaster_app::record_or_replay_input()
+{
+    auto& input_buffer = get_input_buffer();
+    if (_recorder) {
+        _recorder->record_frame(input_buffer);
+    }
+    if (!_player) {
+        return true;
+    }
+
+    if (_timedemo) {
+        // From the start of one frame to the next, so it covers everything
+        // including presenting the frame
+        auto const now = SDL_GetPerformanceCounter();
+        if (_last_frame_start == 0u) {
+            _timedemo_start = now;
+        } else {
+            _frame_times_ms.push_back((now - _last_frame_start) * 1000.0
+                / SDL_GetPerformanceFrequency());
+        }
+        _last_frame_start = now;
+    }
+
+    if (_player->is_finished()) {
+        _player.reset();
+        _replayed_commands.clear();
+        if (_timedemo) {
+            report_timedemo();
+            set_lockstep(false);
+            quit();
+            return false;
+        }
+        SDL_Log("Replay finished, back to the keyboard");
+        return true;
+    }
+
+    _replayed_commands = _player->play_frame(input_buffer);
+    return true;
+}
+
+void raycaster_app::report_timedemo()
+{
+    auto const frames = _frame_times_ms.size();
+    if (frames == 0) {
+        SDL_Log("Timedemo: no frames");
+        return;
+    }
+
+    auto const total_s = (_last_frame_start - _timedemo_start)
+        / static_cast<double>(SDL_GetPerformanceFrequency());
+    auto sorted = _frame_times_ms;
+    std::sort(sorted.begin(), sorted.end());
+    auto const percentile = [&](double p) {
+        return sorted[static_cast<std::size_t>(p * (frames - 1) + 0.5)];
+    };
+
+    SDL_Log("Timedemo: %u frames in %.3f s, %.1f fps average",
+        static_cast<unsigned>(frames), total_s, frames / total_s);
+    SDL_Log("Frame times (ms): min %.3f, median %.3f, 95th %.3f, "
+            "99th %.3f, max %.3f",
+        sorted.front(), percentile(0.5), percentile(0.95), percentile(0.99),
+        sorted.back());
+}
+
+void raycaster_app::run_command(std::string const& command)
+{
+    if (luaL_dostring(_L.get(), command.data())) {
+        _console.log("LUA ERROR: "s + lua::to<char const*>(_L.get()));
+    }
+}
+
+void raycaster_app::apply_pending_level_switch()
+{
+    if (_pending_level.empty()) {
+        return;
+    }
+
+    // Recorded and replayed runs have to switch on the same frame, so wait
+    // for the level rather than play on while it loads and is copied
+    auto const wait = _recorder || _player;
+    while (true) {
+        switch (_level_loader.get_status(_pending_level)) {
+        case level_loader::status::ready:
+            if (auto level = _level_loader.take(_pending_level)) {
+                change_level(std::move(level));
+                _pending_level.clear();
+                return;
+            }
+            break;
+        case level_loader::status::loading:
+            break;
+        case level_loader::status::failed:
+            _console.log("Failed to load level: "
+                + _level_loader.get_error(_pending_level));
+            _pending_level.clear();
+            return;
+        default:
+            return;
+        }
+
+        if (!wait) {
+            // Keep playing the current level in the meantime
+            return;
+        }
+        SDL_Delay(1);
+    }
+}
+
+void raycaster_app::update_world()
+{
+    if (!_world) {
+        return;
+    }
+
+    _world->update(_camera.get_position());
+    auto view = _world->take_view();
+    if (view) {
+        set_level(std::move(view));
+    }
 }
 
 void raycaster_app::unhandled_event(SDL_Event const& event)
@@ -217,13 +1223,25 @@ void raycaster_app::unhandled_event(SDL_Event const& event)
         on_window_event(event.window);
         break;
     case SDL_TEXTINPUT:
-        _console.handle_event(event);
+        // Typing doesn't get mixed into a replay
+        if (!_player) {
+            _console.handle_event(event);
+        }
         break;
     }
 }
 
 void raycaster_app::update()
 {
+    save_tick_state();
+    if (!record_or_replay_input()) {
+        return;
+    }
+
+    // Swap levels between frames so nothing ever sees a half-switched level
+    apply_pending_level_switch();
+    update_world();
+
     lua_getglobal(_L.get(), L_update);
     if (lua_pcall(_L.get(), 0, 0, 0)) {
         throw std::runtime_error{"update() lua failed"};
@@ -243,6 +1261,9 @@ void raycaster_app::update()
 
     if (_console.is_open()) {
         _console.update(input_buffer);
+        for (auto const& command : _replayed_commands) {
+            run_command(command);
+        }
         return;
     }
 
@@ -250,9 +1271,6 @@ void raycaster_app::update()
         return;
     }
 
-    auto const yaw_step = 0.05f;
-    auto const move_step = 0.05f;
-
     if (input_buffer.is_pressed(SDL_SCANCODE_W)) {
         try_to_move_camera({_camera.get_rotation(), move_step});
     }
@@ -280,49 +1298,57 @@ void raycaster_app::update()
             _camera.get_position()
                 + vector2f{_camera.get_rotation(), _camera.get_far()},
         };
-        std::vector<sprite*> barrel_hits;
-        for (auto& sprite : _level->sprites) {
-            auto const sprite_plane = line2f{sprite.data
-                    + vector2f{_camera.get_rotation() + PI_OVER_2, 0.5f},
-                sprite.data
-                    + vector2f{_camera.get_rotation() - PI_OVER_2, 0.5f}};
-            point2f cross_point{0.f, 0.f};
-            float t = 0.f;
-            if (find_intersection(ray_line, sprite_plane, cross_point, t)) {
-                if (sprite.texture == 8) {
-                    barrel_hits.push_back(&sprite);
-                }
-            }
-        }
-
-        std::sort(
-            begin(barrel_hits), end(barrel_hits), [this](sprite* a, sprite* b) {
-                return line2f{_camera.get_position(), a->data}.length()
-                    < line2f{_camera.get_position(), b->data}.length();
-            });
-
-        for (auto barrel : barrel_hits) {
-            barrel->texture = 9;
-            break;
+        // Other sprites don't stop the shot, walls do
+        auto const hit
+            = raycast(*_level, ray_line, hit_anything, _barrel_texture);
+        if (hit.kind == hit_kind::sprite) {
+            auto const barrel = _level->sprites.find(hit.sprite);
+            _level->sprites.set_texture(barrel, _barrel_explode_texture);
+            _level->sprites.set_state(barrel, entity_state::destroyed);
         }
     }
 
     if (input_buffer.is_hit(SDL_SCANCODE_TAB)) {
-        _screenshot_queued = true;
+        _capture.request_screenshot("screenshot.bmp");
+    }
+    if (input_buffer.is_hit(SDL_SCANCODE_F9)) {
+        if (_capture.is_recording()) {
+            _capture.stop_recording();
+        } else {
+            _capture.start_recording("capture.raw");
+        }
     }
 
     if (input_buffer.is_hit(SDL_SCANCODE_1)) {
         _debug_noclip = !_debug_noclip;
     }
     if (input_buffer.is_hit(SDL_SCANCODE_2)) {
-        _debug_no_textures = !_debug_no_textures;
+        auto settings = _pipeline->get_render_settings();
+        settings.textures = !settings.textures;
+        _pipeline->set_render_settings(settings);
     }
     if (input_buffer.is_hit(SDL_SCANCODE_3)) {
-        _debug_no_floor = !_debug_no_floor;
+        auto settings = _pipeline->get_render_settings();
+        settings.floor = !settings.floor;
+        _pipeline->set_render_settings(settings);
     }
     if (input_buffer.is_hit(SDL_SCANCODE_4)) {
         _debug_no_hud = !_debug_no_hud;
     }
+    if (input_buffer.is_hit(SDL_SCANCODE_5)) {
+        toggle_indexed_textures();
+    }
+    if (input_buffer.is_hit(SDL_SCANCODE_6)) {
+        auto rates = _pipeline->get_shading_rates();
+        rates.enabled = !rates.enabled;
+        _pipeline->set_shading_rates(rates);
+    }
+    if (input_buffer.is_hit(SDL_SCANCODE_7)) {
+        _pipeline->set_checkerboard(!_pipeline->get_checkerboard());
+    }
+    if (input_buffer.is_hit(SDL_SCANCODE_8)) {
+        set_late_latching(!_late_latching);
+    }
 }
 
 void raycaster_app::render()
@@ -330,17 +1356,15 @@ void raycaster_app::render()
     auto* framebuffer = get_framebuffer();
 
     if (_level) {
-        _pipeline->render(*_level, _camera, *framebuffer);
+        _pipeline->render(*_level, get_interpolated_camera(), *framebuffer,
+            get_tick_alpha());
     }
 
-    if (_screenshot_queued) {
-        if (!save_screenshot(framebuffer, "screenshot.bmp")) {
-            SDL_Log("save_screenshot failed!");
-        } else {
-            SDL_Log("saved screenshot to screenshot.bmp");
-        }
-        _screenshot_queued = false;
-    } else if (!_debug_no_hud) {
+    // Capture before the HUD so screenshots and recordings stay clean. This
+    // only copies the framebuffer; the writing happens on another thread.
+    _capture.capture(*framebuffer);
+
+    if (!_debug_no_hud) {
         draw_hud();
     }
 
@@ -354,63 +1378,198 @@ void raycaster_app::render()
     }
 }
 
-void raycaster_app::try_to_move_camera(mymath::vector2f const& vec)
+void raycaster_app::framebuffer_changed(SDL_Surface& framebuffer)
 {
-    // Do the movement
-    auto const old_pos = _camera.get_position();
-    _camera.move(vec);
+    auto found_format = false;
+    for (auto const& want_format : desired_framebuffer_formats) {
+        if (framebuffer.format->format == want_format) {
+            found_format = true;
+            break;
+        }
+    }
 
-    if (_debug_noclip) {
+    if (!found_format) {
+        SDL_Log("Invalid surface format!");
+        SDL_Log("GOT:");
+        print_pixel_format(framebuffer.format->format);
+        throw std::runtime_error{"invalid surface format! See log"};
+    }
+
+    // The glyphs and the cached HUD lines are in the framebuffer's format
+    if (!_text || framebuffer.format->format != _text_format) {
+        _text = std::make_unique<text_renderer>(
+            get_asset_store().get_asset("6x8-terminal-mspaint.bmp"),
+            extent2i{6, 8}, *framebuffer.format);
+        _text_format = framebuffer.format->format;
+        _hud_lines = {};
+    }
+
+    // Recordings are raw frames of one size
+    if (_capture.is_recording()) {
+        SDL_Log("The framebuffer changed, stopping the recording");
+        _capture.stop_recording();
+    }
+
+    _pipeline->prepare(_camera, framebuffer);
+}
+
+void raycaster_app::toggle_indexed_textures()
+{
+    if (_textures->get_palette()) {
+        _textures->set_palette(nullptr);
         return;
     }
 
-    auto const new_pos = _camera.get_position();
+    // Built from whatever is loaded now, which should be most of the level.
+    // Textures loaded later are mapped to it as they come.
+    auto const start = SDL_GetPerformanceCounter();
+    _textures->set_palette(std::make_shared<palette const>(
+        build_palette(_textures->get_all())));
+    auto const elapsed_ms = (SDL_GetPerformanceCounter() - start) * 1000.0
+        / SDL_GetPerformanceFrequency();
+
+    auto const memory = _textures->get_memory_usage();
+    SDL_Log("Quantized %u textures in %.3f ms: %u bytes indexed (+%u for the "
+            "palette) vs %u truecolor",
+        static_cast<unsigned>(memory.textures), elapsed_ms,
+        static_cast<unsigned>(memory.indexed_bytes),
+        static_cast<unsigned>(memory.palette_bytes),
+        static_cast<unsigned>(memory.truecolor_bytes));
+}
+
+void raycaster_app::save_tick_state()
+{
+    snap_camera();
+    if (_level) {
+        _level->sprites.save_positions();
+    }
+}
 
-    auto const movement_line = line2f{old_pos, new_pos};
+void raycaster_app::snap_camera()
+{
+    _previous_camera_position = _camera.get_position();
+    _previous_camera_rotation = _camera.get_rotation();
+}
 
-    // Then figure out if it's valid. If not, reverse it.
-    for (auto const& wall : _level->walls) {
-        auto t = 0.f;
-        auto intersection = point2f{0.f, 0.f};
-        if (find_intersection(movement_line, wall.data, intersection, t)) {
-            _camera.set_position(old_pos);
-            return;
-        }
+camera raycaster_app::get_interpolated_camera() const
+{
+    auto const alpha = get_tick_alpha();
+    auto interpolated = _camera;
+    interpolated.set_position(linear_interpolate(
+        _previous_camera_position, _camera.get_position(), alpha));
+    // The short way round
+    auto const turn = std::remainder(
+        _camera.get_rotation() - _previous_camera_rotation, 2.f * PI_FLOAT);
+    interpolated.set_rotation(_previous_camera_rotation + turn * alpha);
+    return interpolated;
+}
+
+void raycaster_app::try_to_move_camera(mymath::vector2f const& vec)
+{
+    if (_debug_noclip) {
+        _camera.move(vec);
+        return;
     }
+
+    auto const delta = point2f{0.f, 0.f} + vec;
+    _camera.set_position(move_and_slide(_level->walls, _level->grid,
+        _camera.get_position(), delta, player_radius, _collision_scratch));
 }
 
 void raycaster_app::draw_hud()
 {
-    auto framebuffer = get_framebuffer();
-    auto font = _font_texture;
-
     if (_console.is_open()) {
-        _console.draw(*framebuffer, *font);
+        _console.draw(*get_framebuffer(), *_text);
         return;
     }
 
-    auto onOrOff = [](bool b) { return b ? "ON"s : "OFF"s; };
+    auto onOrOff = [](bool b) { return b ? "ON" : "OFF"; };
+    // Formatted into here, then only drawn from scratch when it changes
+    char line[128];
+
+    auto const& pacer = get_frame_pacer();
+    if (pacer.get_mode() != pacing_mode::uncapped) {
+        std::snprintf(line, sizeof(line), "FPS: %u (%d cap, %u missed)", _fps,
+            static_cast<int>(pacer.get_frame_rate_cap()),
+            pacer.get_stats().missed_deadlines);
+    } else {
+        std::snprintf(line, sizeof(line), "FPS: %u", _fps);
+    }
+    draw_hud_line(0, line);
+
+    auto const& settings = _pipeline->get_render_settings();
+    std::snprintf(line, sizeof(line), "1: Noclip %s", onOrOff(_debug_noclip));
+    draw_hud_line(1, line);
+    std::snprintf(line, sizeof(line), "2: Texture %s",
+        onOrOff(settings.textures));
+    draw_hud_line(2, line);
+    std::snprintf(line, sizeof(line), "3: Floor %s", onOrOff(settings.floor));
+    draw_hud_line(3, line);
+    std::snprintf(line, sizeof(line), "4: HUD %s", onOrOff(!_debug_no_hud));
+    draw_hud_line(4, line);
+    std::snprintf(line, sizeof(line), "# threads: %u", settings.threads);
+    draw_hud_line(5, line);
+
+    auto const sprites = _pipeline->get_sprite_stats();
+    std::snprintf(line, sizeof(line), "Sprites: %u visible %u culled",
+        sprites.visible, sprites.culled);
+    draw_hud_line(6, line);
+
+    if (_capture.is_recording()) {
+        std::snprintf(line, sizeof(line), "F9: REC %u dropped %u",
+            _capture.get_written_frames(), _capture.get_dropped_frames());
+        draw_hud_line(7, line);
+    }
+
+    if (_world) {
+        auto const world = _world->get_stats();
+        std::snprintf(line, sizeof(line),
+            "World: %zu chunks %zu/%zu KB %zu loading", world.resident_chunks,
+            world.resident_bytes / 1024, world.budget_bytes / 1024,
+            world.pending_chunks);
+        draw_hud_line(8, line);
+    }
 
-    SDL_CHECK(draw_string(
-        "FPS: "s + std::to_string(_fps), point2i{0, 0}, font, framebuffer));
+    auto const textures = _textures->get_memory_usage();
+    std::snprintf(line, sizeof(line), "5: 8-bit textures %s %zu/%zu KB",
+        onOrOff(_textures->get_palette() != nullptr),
+        (textures.indexed_bytes + textures.palette_bytes) / 1024,
+        textures.truecolor_bytes / 1024);
+    draw_hud_line(9, line);
+    std::snprintf(line, sizeof(line), "6: Variable-rate shading %s",
+        onOrOff(_pipeline->get_shading_rates().enabled));
+    draw_hud_line(10, line);
+
+    if (_pipeline->get_checkerboard()) {
+        auto const stats = _pipeline->get_checkerboard_stats();
+        std::snprintf(line, sizeof(line),
+            "7: Checkerboard ON saved %.1f ms, %d%% reprojected",
+            stats.saved_ms, static_cast<int>(stats.reprojected * 100.f));
+    } else {
+        std::snprintf(line, sizeof(line), "7: Checkerboard OFF");
+    }
+    draw_hud_line(11, line);
+
+    auto const& latency = get_input_latency();
+    std::snprintf(line, sizeof(line),
+        "8: Late latching %s, latency avg %.1f ms, p95 %.0f ms",
+        onOrOff(_late_latching), latency.average_ms(),
+        latency.percentile_ms(0.95));
+    draw_hud_line(12, line);
+}
 
-    SDL_CHECK(draw_string("1: Noclip "s + onOrOff(_debug_noclip),
-        point2i{0, 10}, font, framebuffer));
-    // SDL_CHECK(draw_string("2: Texture "s + onOrOff(!_debug_no_textures),
-    //     point2i{0, 20}, font, framebuffer));
-    // SDL_CHECK(draw_string("3: Floor "s + onOrOff(!_debug_no_floor),
-    //     point2i{0, 30}, font, framebuffer));
-    SDL_CHECK(draw_string("4: HUD "s + onOrOff(!_debug_no_hud), point2i{0, 40},
-        font, framebuffer));
-    SDL_CHECK(draw_string("# threads: "s + std::to_string(detail::num_threads),
-        point2i{0, 50}, font, framebuffer));
+void raycaster_app::draw_hud_line(int row, char const* text)
+{
+    _hud_lines[row].draw(
+        *_text, text, point2i{0, row * 10}, *get_framebuffer());
 }
 
 void raycaster_app::on_window_event(SDL_WindowEvent const& event)
 {
     switch (event.event) {
     case SDL_WINDOWEVENT_RESIZED:
-        // Used to do something, now doesn't
+        // sdl_application gets the new framebuffer, see framebuffer_changed()
+        SDL_Log("Window resized to %dx%d", event.data1, event.data2);
         break;
     }
 }
@@ -1,20 +1,29 @@
 #pragma once
 
 #include "camera.hpp"
+#include "collision.hpp"
 #include "console.hpp"
 #include "level.hpp"
+#include "level_loader.hpp"
 #include "pipeline.hpp"
+#include "texture_registry.hpp"
+#include "world_streamer.hpp"
 
 #include <lua_raii/lua_raii.hpp>
 #include <mymath/mymath.hpp>
 #include <sdl_application/asset_store.hpp>
+#include <sdl_application/frame_capture.hpp>
+#include <sdl_application/input_recording.hpp>
 #include <sdl_application/sdl_application.hpp>
+#include <sdl_application/text_renderer.hpp>
 #include <sdl_raii/sdl_raii.hpp>
 
 #include <SDL.h>
 
 #include <array>
 #include <cstdint>
+#include <memory>
+#include <string>
 #include <vector>
 
 namespace raycaster {
@@ -24,38 +33,128 @@ public:
     raycaster_app(std::shared_ptr<sdl::sdl_init> sdl, sdl::window window,
         std::unique_ptr<sdl_app::input_buffer> input,
         std::unique_ptr<sdl_app::asset_store> assets,
+        std::unique_ptr<texture_registry> textures,
         std::unique_ptr<render_pipeline> pipeline, lua::state L, camera cam);
 
     void change_level(std::unique_ptr<level> level);
 
+    /// Stream the chunked world in `dir` (see world_streamer.hpp) instead of
+    /// playing a level. The current level is dropped right away.
+    ///
+    /// @throws std::runtime_error if the world's manifest can't be read
+    void load_world(std::string const& dir, std::size_t budget_bytes);
+
+    level_loader& get_level_loader();
+    texture_registry& get_textures();
+    render_pipeline& get_pipeline();
+    sdl_app::asset_pack const* get_asset_pack();
+
+    /// Switch to `filename` at the start of the first frame where it has
+    /// finished loading in the background.
+    void request_level_switch(std::string filename);
+
+    /// Write the frame pacing stats to the console and the log.
+    void print_frame_pacing();
+    /// Write the pipeline's render settings to the console and the log.
+    void print_render_settings();
+    /// Write the input-to-present latency stats to the console and the log.
+    void print_input_latency();
+
+    /// Turn the camera by the keys held right before each frame is drawn,
+    /// rather than only by those held at the last tick. Resets the latency
+    /// stats.
+    void set_late_latching(bool enabled);
+    bool get_late_latching() const;
+
+    /// Record every tick's input and console commands with `recorder`.
+    /// Lua's random seed must already be set to the recorder's.
+    void record_input(std::unique_ptr<sdl_app::input_recorder> recorder);
+
+    /// Drive the app from a recording instead of the keyboard, then go back
+    /// to the keyboard. With `timedemo`, frames aren't capped, and the app
+    /// logs the frame times and quits at the end of the recording. Lua's
+    /// random seed must already be set to the recording's.
+    void replay_input(
+        std::unique_ptr<sdl_app::input_player> player, bool timedemo);
+
 protected:
     void unhandled_event(SDL_Event const& event) override;
     void update() override;
     void render() override;
+    void framebuffer_changed(SDL_Surface& framebuffer) override;
 
 private:
+    /// Record or play back this tick's input, before anything reads it.
+    /// @return false if the timedemo is over
+    bool record_or_replay_input();
+    void report_timedemo();
+    void run_command(std::string const& command);
+    void apply_pending_level_switch();
+    /// Make `level` current without touching the camera.
+    void set_level(std::unique_ptr<level> level);
+    /// Follow the camera around the streamed world, if there is one.
+    void update_world();
+    /// Switch between truecolor textures and 8-bit ones with a palette built
+    /// from the textures loaded so far.
+    void toggle_indexed_textures();
+    /// Remember where everything is before a tick moves it, so frames can
+    /// be drawn between ticks.
+    void save_tick_state();
+    /// Draw the next frame with the camera where it is, e.g. after a
+    /// teleport, rather than sweep it across the level.
+    void snap_camera();
+    /// @return The camera get_tick_alpha() of the way through the last tick
+    camera get_interpolated_camera() const;
+    /// Late latching: poll input and turn `cam` by it (see
+    /// render_pipeline::set_camera_latch()).
+    void latch_camera(camera& cam);
     void try_to_move_camera(mymath::vector2f const& vec);
     void draw_hud();
+    /// Draw one of the HUD's lines, which are 10 px apart
+    void draw_hud_line(int row, char const* text);
     void on_window_event(SDL_WindowEvent const& event);
 
+    std::unique_ptr<texture_registry> _textures;
     std::unique_ptr<render_pipeline> _pipeline;
     lua::state _L;
     std::unique_ptr<level> _level;
+    level_loader _level_loader;
+    std::string _pending_level;
+    std::unique_ptr<world_streamer> _world;
     camera _camera;
+    /// Where the camera was at the start of the last tick
+    mymath::point2f _previous_camera_position;
+    float _previous_camera_rotation = 0.f;
+    collision_scratch _collision_scratch;
     console _console;
 
+    texture_handle _barrel_texture;
+    texture_handle _barrel_explode_texture;
+
     Uint32 _fps_interval_start = 0u;
     Uint32 _fps_interval_frames = 0u;
     Uint32 _fps = 0u;
 
-    bool _debug_no_textures = false;
-    bool _debug_no_floor = false;
     bool _debug_no_hud = false;
     bool _debug_noclip = false;
+    bool _late_latching = false;
+
+    sdl_app::frame_capture _capture;
 
-    bool _screenshot_queued = false;
+    std::unique_ptr<sdl_app::input_recorder> _recorder;
+    std::unique_ptr<sdl_app::input_player> _player;
+    /// Commands of the frame being replayed
+    std::vector<std::string> _replayed_commands;
+    bool _timedemo = false;
+    Uint64 _timedemo_start = 0u;
+    Uint64 _last_frame_start = 0u;
+    std::vector<double> _frame_times_ms;
 
-    SDL_Surface* _font_texture = nullptr;
+    std::unique_ptr<sdl_app::text_renderer> _text;
+    /// The pixel format `_text` draws in
+    Uint32 _text_format = 0u;
+    static constexpr auto hud_rows = 13;
+    std::array<sdl_app::text_line, hud_rows> _hud_lines;
 };
 
 } // namespace raycaster
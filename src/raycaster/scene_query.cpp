@@ -0,0 +1,110 @@
+#include "scene_query.hpp"
+
+#include "intersection.hpp"
+#include "level.hpp"
+
+#include <cmath>
+
+using namespace mymath;
+
+namespace {
+
+using namespace raycaster;
+
+/// Sprites are drawn 1 unit wide
+constexpr auto sprite_half_width = 0.5f;
+
+void raycast_walls(level const& lvl, line2f const& ray, float ray_length,
+    ray_hit& nearest)
+{
+    lvl.grid.traverse(ray, [&](int cell, float t_exit) {
+        lvl.grid.for_each_wall(cell, [&](std::uint32_t wall_index) {
+            auto cross_point = point2f{0.f, 0.f};
+            auto t = 0.f;
+            // Walls spanning several cells get tested again, which is cheaper
+            // than remembering them for the few cells a query visits
+            if (!find_intersection(
+                    ray, lvl.walls[wall_index].data, cross_point, t)) {
+                return;
+            }
+            auto const distance = line2f{ray.start, cross_point}.length();
+            if (distance < nearest.distance) {
+                nearest = ray_hit{};
+                nearest.kind = hit_kind::wall;
+                nearest.distance = distance;
+                nearest.position = cross_point;
+                nearest.wall = wall_index;
+            }
+        });
+        // Anything in later cells is further away than this hit
+        return nearest.distance > t_exit * ray_length;
+    });
+}
+
+void raycast_sprites(level const& lvl, line2f const& ray, float ray_length,
+    texture_handle sprite_texture, ray_hit& nearest)
+{
+    auto const dir = point2f{(ray.end.x - ray.start.x) / ray_length,
+        (ray.end.y - ray.start.y) / ray_length};
+
+    auto const& positions = lvl.sprites.get_positions();
+    auto const& textures = lvl.sprites.get_textures();
+    auto const& states = lvl.sprites.get_states();
+    for (std::size_t i = 0; i < positions.size(); ++i) {
+        if (states[i] != entity_state::active
+            || (sprite_texture != any_sprite_texture
+                && textures[i] != sprite_texture)) {
+            continue;
+        }
+
+        // Facing the ray, the sprite's plane is perpendicular to it, so the
+        // distance to the plane is just the projection onto the ray
+        auto const offset = positions[i] - ray.start;
+        auto const along = offset.x * dir.x + offset.y * dir.y;
+        if (along < 0.f || along >= nearest.distance) {
+            continue;
+        }
+        auto const across = offset.x * dir.y - offset.y * dir.x;
+        if (std::abs(across) > sprite_half_width) {
+            continue;
+        }
+
+        nearest = ray_hit{};
+        nearest.kind = hit_kind::sprite;
+        nearest.distance = along;
+        nearest.position = ray.start + dir * along;
+        nearest.sprite = lvl.sprites.get_handle(i);
+    }
+}
+
+} // namespace
+
+namespace raycaster {
+
+ray_hit raycast(level const& lvl, line2f const& ray, unsigned mask,
+    texture_handle sprite_texture)
+{
+    auto const ray_length = ray.length();
+
+    // Track the nearest hit so far, with nothing hit yet meaning "at the end
+    // of the ray"
+    auto nearest = ray_hit{};
+    nearest.distance = ray_length;
+    if (ray_length <= 0.f) {
+        return nearest;
+    }
+
+    if (mask & hit_walls) {
+        raycast_walls(lvl, ray, ray_length, nearest);
+    }
+    if (mask & hit_sprites) {
+        raycast_sprites(lvl, ray, ray_length, sprite_texture, nearest);
+    }
+
+    if (!nearest) {
+        nearest.distance = 0.f;
+    }
+    return nearest;
+}
+
+} // namespace raycaster
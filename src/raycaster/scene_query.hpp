@@ -0,0 +1,61 @@
+/// @file scene_query.hpp
+/// @brief Ray queries against a level, for gameplay code (hitscan weapons,
+/// using things, picking things up).
+
+#pragma once
+
+#include "entity_store.hpp"
+#include "texture_registry.hpp"
+
+#include <mymath/mymath.hpp>
+
+#include <cstddef>
+#include <limits>
+
+namespace raycaster {
+
+struct level;
+
+enum class hit_kind {
+    none,
+    wall,
+    sprite,
+};
+
+/// Bit flags for what a ray can hit. Anything else is see-through.
+enum hit_mask : unsigned {
+    hit_walls = 1u << 0,
+    hit_sprites = 1u << 1,
+    hit_anything = hit_walls | hit_sprites,
+};
+
+/// Pass as `sprite_texture` to let any sprite be hit.
+constexpr auto any_sprite_texture = std::numeric_limits<texture_handle>::max();
+
+struct ray_hit {
+    hit_kind kind = hit_kind::none;
+    /// Distance from the ray's start to `position`
+    float distance = 0.f;
+    mymath::point2f position{0.f, 0.f};
+    /// Index into the level's walls, for wall hits
+    std::size_t wall = 0;
+    /// The sprite, for sprite hits
+    entity_handle sprite;
+
+    explicit operator bool() const { return kind != hit_kind::none; }
+};
+
+/// Find the nearest thing along `ray`, from `ray.start` to `ray.end`.
+///
+/// Walls are found by walking the wall grid and stop as soon as a hit is
+/// closer than the cells left to visit. Sprites are treated as 1 unit wide
+/// billboards facing the ray, as they are when the camera looks at them.
+///
+/// @param mask Which kinds of things can be hit (see hit_mask)
+/// @param sprite_texture Only sprites with this texture can be hit. Use
+/// `any_sprite_texture` to allow all of them. Destroyed sprites are never hit.
+ray_hit raycast(level const& lvl, mymath::line2f const& ray,
+    unsigned mask = hit_anything,
+    texture_handle sprite_texture = any_sprite_texture);
+
+} // namespace raycaster
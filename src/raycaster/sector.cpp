@@ -0,0 +1,278 @@
+#include "sector.hpp"
+
+#include "level.hpp"
+#include "wall_grid.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+
+using namespace mymath;
+
+namespace {
+
+using namespace raycaster;
+
+/// Points this close to an outline count as on it. Walls are usually drawn
+/// right along the sector outlines.
+constexpr auto outline_epsilon = 0.001f;
+
+/// Shared edges are matched on endpoints rounded to this many steps per unit
+constexpr auto endpoint_resolution = 1024.f;
+
+using edge_key = std::array<long, 4>;
+
+edge_key make_edge_key(point2f const& a, point2f const& b)
+{
+    auto const q = [](float f) { return std::lround(f * endpoint_resolution); };
+    return {q(a.x), q(a.y), q(b.x), q(b.y)};
+}
+
+float distance_to_segment(point2f const& p, line2f const& seg)
+{
+    auto const d = displacement(seg.start, seg.end);
+    auto const m = displacement(seg.start, p);
+    auto const len_sq = length_squared(d);
+    auto const t
+        = len_sq > 0.f ? clamp(dot(m, d) / len_sq, 0.f, 1.f) : 0.f;
+    return length(m - d * t);
+}
+
+/// Whether two segments properly cross. Touching and collinear cases are
+/// left to the endpoint tests in build_sector_map().
+bool segments_cross(line2f const& a, line2f const& b)
+{
+    auto const da = displacement(a.start, a.end);
+    auto const db = displacement(b.start, b.end);
+    auto const side
+        = [](vec2f const& d, point2f const& o, point2f const& p) {
+              return cross(d, displacement(o, p));
+          };
+    auto const a0 = side(da, a.start, b.start);
+    auto const a1 = side(da, a.start, b.end);
+    auto const b0 = side(db, b.start, a.start);
+    auto const b1 = side(db, b.start, a.end);
+    return ((a0 < 0.f && a1 > 0.f) || (a0 > 0.f && a1 < 0.f))
+        && ((b0 < 0.f && b1 > 0.f) || (b0 > 0.f && b1 < 0.f));
+}
+
+/// Whether walls lying along `edge` cover all of it, so nothing can be seen
+/// through it.
+///
+/// @param nearby Scratch space
+bool is_walled_off(line2f const& edge, std::vector<wall> const& walls,
+    wall_grid const& grid, std::vector<std::uint32_t>& nearby)
+{
+    auto const along = displacement(edge.start, edge.end);
+    auto const edge_length = length(along);
+    if (edge_length <= 0.f) {
+        return true;
+    }
+    auto const dir = along * (1.f / edge_length);
+
+    auto bounds = edge.get_bounding_box();
+    bounds.tl.x -= outline_epsilon;
+    bounds.tl.y -= outline_epsilon;
+    bounds.br.x += outline_epsilon;
+    bounds.br.y += outline_epsilon;
+    grid.query(bounds, nearby);
+
+    // The parts of the edge covered by collinear walls, as distances along it
+    std::vector<std::pair<float, float>> covered;
+    for (auto const index : nearby) {
+        if (index >= walls.size()) {
+            continue;
+        }
+        auto const& line = walls[index].data;
+        auto const a = displacement(edge.start, line.start);
+        auto const b = displacement(edge.start, line.end);
+        if (std::abs(cross(dir, a)) > outline_epsilon
+            || std::abs(cross(dir, b)) > outline_epsilon) {
+            continue;
+        }
+        auto const ta = dot(dir, a);
+        auto const tb = dot(dir, b);
+        covered.emplace_back(std::min(ta, tb), std::max(ta, tb));
+    }
+
+    std::sort(covered.begin(), covered.end());
+    auto reached = 0.f;
+    for (auto const& span : covered) {
+        if (span.first > reached + outline_epsilon) {
+            break;
+        }
+        reached = std::max(reached, span.second);
+    }
+    return reached >= edge_length - outline_epsilon;
+}
+
+bool overlaps(sector_map const& sectors, std::uint32_t s, line2f const& line)
+{
+    if (sectors.contains(s, line.start) || sectors.contains(s, line.end)) {
+        return true;
+    }
+    for (auto j = sectors.point_offsets[s]; j < sectors.point_offsets[s + 1];
+         ++j) {
+        if (segments_cross(line, sectors.edge(s, j))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+namespace raycaster {
+
+line2f sector_map::edge(std::uint32_t s, std::uint32_t j) const
+{
+    auto const next = j + 1 < point_offsets[s + 1] ? j + 1 : point_offsets[s];
+    return {points[j], points[next]};
+}
+
+bool sector_map::contains(std::uint32_t s, point2f const& p) const
+{
+    // Crossing number, plus a tolerance band around the outline
+    auto inside = false;
+    for (auto j = point_offsets[s]; j < point_offsets[s + 1]; ++j) {
+        auto const e = edge(s, j);
+        if (distance_to_segment(p, e) <= outline_epsilon) {
+            return true;
+        }
+        if ((e.start.y > p.y) != (e.end.y > p.y)) {
+            auto const x = e.start.x
+                + (p.y - e.start.y) * (e.end.x - e.start.x)
+                    / (e.end.y - e.start.y);
+            if (p.x < x) {
+                inside = !inside;
+            }
+        }
+    }
+    return inside;
+}
+
+std::uint32_t sector_map::find(point2f const& p, std::uint32_t hint) const
+{
+    if (hint < size()) {
+        if (contains(hint, p)) {
+            return hint;
+        }
+        for (auto j = point_offsets[hint]; j < point_offsets[hint + 1]; ++j) {
+            if (neighbours[j] != no_sector && contains(neighbours[j], p)) {
+                return neighbours[j];
+            }
+        }
+    }
+
+    for (std::uint32_t s = 0; s < size(); ++s) {
+        if (contains(s, p)) {
+            return s;
+        }
+    }
+    return no_sector;
+}
+
+sector_map build_sector_map(std::vector<std::vector<point2f>> const& outlines,
+    std::vector<wall> const& walls, wall_grid const& grid)
+{
+    sector_map sectors;
+    if (outlines.empty()) {
+        return sectors;
+    }
+
+    //
+    // Outlines, wound with the inside on the left of each edge (positive
+    // signed area)
+    //
+
+    sectors.point_offsets.push_back(0);
+    for (auto const& outline : outlines) {
+        auto end = outline.end();
+        // Tolerate outlines that repeat the first point to close them
+        if (outline.size() > 1 && outline.front() == outline.back()) {
+            --end;
+        }
+        if (end - outline.begin() < 3) {
+            throw std::runtime_error{"A sector needs at least 3 points"};
+        }
+
+        auto area = 0.f;
+        for (auto i = outline.begin(); i != end; ++i) {
+            auto const next = i + 1 == end ? outline.begin() : i + 1;
+            area += i->x * next->y - next->x * i->y;
+        }
+
+        if (area > 0.f) {
+            sectors.points.insert(sectors.points.end(), outline.begin(), end);
+        } else {
+            sectors.points.insert(sectors.points.end(),
+                std::make_reverse_iterator(end), outline.rend());
+        }
+        sectors.point_offsets.push_back(
+            static_cast<std::uint32_t>(sectors.points.size()));
+    }
+
+    //
+    // Portals: an edge a -> b in one sector is shared with another sector if
+    // it has the edge b -> a. Shared edges that are walled off all the way
+    // along stay solid.
+    //
+
+    std::map<edge_key, std::uint32_t> edge_owners;
+    for (std::uint32_t s = 0; s < sectors.size(); ++s) {
+        for (auto j = sectors.point_offsets[s];
+             j < sectors.point_offsets[s + 1]; ++j) {
+            auto const e = sectors.edge(s, j);
+            edge_owners[make_edge_key(e.start, e.end)] = s;
+        }
+    }
+
+    std::vector<std::uint32_t> candidates;
+    sectors.neighbours.assign(sectors.points.size(), no_sector);
+    for (std::uint32_t s = 0; s < sectors.size(); ++s) {
+        for (auto j = sectors.point_offsets[s];
+             j < sectors.point_offsets[s + 1]; ++j) {
+            auto const e = sectors.edge(s, j);
+            auto const other = edge_owners.find(make_edge_key(e.end, e.start));
+            if (other != edge_owners.end() && other->second != s
+                && !is_walled_off(e, walls, grid, candidates)) {
+                sectors.neighbours[j] = other->second;
+            }
+        }
+    }
+
+    //
+    // Walls
+    //
+
+    sectors.wall_offsets.push_back(0);
+    for (std::uint32_t s = 0; s < sectors.size(); ++s) {
+        auto const& first = sectors.points[sectors.point_offsets[s]];
+        auto bounds = rectangle2<float>{first, first};
+        for (auto j = sectors.point_offsets[s];
+             j < sectors.point_offsets[s + 1]; ++j) {
+            auto const& p = sectors.points[j];
+            bounds.tl.x = std::min(bounds.tl.x, p.x - outline_epsilon);
+            bounds.tl.y = std::min(bounds.tl.y, p.y - outline_epsilon);
+            bounds.br.x = std::max(bounds.br.x, p.x + outline_epsilon);
+            bounds.br.y = std::max(bounds.br.y, p.y + outline_epsilon);
+        }
+
+        grid.query(bounds, candidates);
+        for (auto const index : candidates) {
+            if (index < walls.size()
+                && overlaps(sectors, s, walls[index].data)) {
+                sectors.wall_indices.push_back(index);
+            }
+        }
+        sectors.wall_offsets.push_back(
+            static_cast<std::uint32_t>(sectors.wall_indices.size()));
+    }
+
+    return sectors;
+}
+
+} // namespace raycaster
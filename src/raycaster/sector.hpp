@@ -0,0 +1,82 @@
+#pragma once
+
+#include <mymath/mymath.hpp>
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace raycaster {
+
+struct wall;
+struct wall_grid;
+
+constexpr auto no_sector = std::numeric_limits<std::uint32_t>::max();
+
+/// An optional portal/sector description of a level. Sectors are polygons
+/// (usually rooms), and an edge shared by two sectors is a portal between
+/// them. Following portals from the camera's sector tells the renderer which
+/// rooms can be seen at all, so it doesn't have to look at any others.
+///
+/// Like wall_grid, everything is stored in flat (CSR) arrays. The outline of
+/// sector `s` is `points[point_offsets[s]]` up to `points[point_offsets[s +
+/// 1]]`, wound so the inside is on the left of each edge. Edge `j` goes from
+/// `points[j]` to the next point of the same outline and leads into sector
+/// `neighbours[j]`, or nowhere (no_sector) if it isn't a portal.
+struct sector_map {
+    std::vector<std::uint32_t> point_offsets;
+    std::vector<mymath::point2f> points;
+    std::vector<std::uint32_t> neighbours;
+
+    /// The walls overlapping each sector: sector `s` has
+    /// `wall_indices[wall_offsets[s]]` up to `wall_indices[wall_offsets[s +
+    /// 1]]`
+    std::vector<std::uint32_t> wall_offsets;
+    std::vector<std::uint32_t> wall_indices;
+
+    bool empty() const { return point_offsets.size() < 2; }
+
+    std::uint32_t size() const
+    {
+        return empty() ? 0u
+                       : static_cast<std::uint32_t>(point_offsets.size() - 1);
+    }
+
+    /// @return Edge `j` of sector `s`
+    mymath::line2f edge(std::uint32_t s, std::uint32_t j) const;
+
+    /// @return Whether `p` is inside sector `s` (or on its outline)
+    bool contains(std::uint32_t s, mymath::point2f const& p) const;
+
+    /// Find the sector containing `p`. `hint` (e.g. where the camera was last
+    /// frame) and its neighbours are tried before searching every sector.
+    ///
+    /// @return The sector, or no_sector if `p` isn't in any
+    std::uint32_t find(
+        mymath::point2f const& p, std::uint32_t hint = no_sector) const;
+
+    /// Call `visit(wall_index)` for each wall overlapping sector `s`.
+    template <typename Visitor>
+    void for_each_wall(std::uint32_t s, Visitor&& visit) const;
+};
+
+/// Build sectors from their outlines (in either winding). Edges that two
+/// sectors share, with the same endpoints, become portals. Each wall is
+/// listed in every sector it overlaps; `grid` must be the grid over `walls`.
+sector_map build_sector_map(
+    std::vector<std::vector<mymath::point2f>> const& outlines,
+    std::vector<wall> const& walls, wall_grid const& grid);
+
+//
+// template implementation
+//
+
+template <typename Visitor>
+void sector_map::for_each_wall(std::uint32_t s, Visitor&& visit) const
+{
+    for (auto i = wall_offsets[s]; i < wall_offsets[s + 1]; ++i) {
+        visit(wall_indices[i]);
+    }
+}
+
+} // namespace raycaster
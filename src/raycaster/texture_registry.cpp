@@ -0,0 +1,179 @@
+#include "texture_registry.hpp"
+
+#include <sdl_application/asset_store.hpp>
+
+#include <SDL.h>
+
+#include <exception>
+#include <utility>
+
+namespace {
+
+constexpr auto checker_size = 8;
+
+/// Magenta and black, like every other engine's missing texture
+sdl::surface make_missing_texture()
+{
+    auto surf = sdl::make_surface(SDL_CreateRGBSurfaceWithFormat(
+        0, checker_size, checker_size, 24, SDL_PIXELFORMAT_BGR24));
+
+    for (auto y = 0; y < checker_size; ++y) {
+        auto const row = static_cast<Uint8*>(surf->pixels) + y * surf->pitch;
+        for (auto x = 0; x < checker_size; ++x) {
+            // Not pure magenta, that's the transparent color
+            auto const on = ((x / (checker_size / 2)) ^ (y / (checker_size / 2)))
+                & 1;
+            row[x * 3 + 0] = on ? 254 : 0; // b
+            row[x * 3 + 1] = 0; // g
+            row[x * 3 + 2] = on ? 255 : 0; // r
+        }
+    }
+
+    return surf;
+}
+
+} // namespace
+
+namespace raycaster {
+
+texture_registry::texture_registry(
+    std::string base_dir, std::shared_ptr<sdl_app::asset_pack const> pack)
+: _base_dir{std::move(base_dir)}
+, _pack{std::move(pack)}
+{
+    _owned.push_back(make_missing_texture());
+    _surfaces.push_back(_owned.back().get());
+}
+
+texture_handle texture_registry::acquire(std::string const& name)
+{
+    if (name.empty()) {
+        return missing_texture;
+    }
+
+    sdl::surface surf;
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        auto const existing = _handles.find(name);
+        if (existing != _handles.end()) {
+            return existing->second;
+        }
+
+        auto const staged = _staged.find(name);
+        if (staged != _staged.end()) {
+            surf = std::move(staged->second);
+            _staged.erase(staged);
+        }
+    }
+
+    if (!surf) {
+        try {
+            surf = load(name);
+        } catch (std::exception const& e) {
+            SDL_Log("texture_registry: %s", e.what());
+            // Don't go back to the disk, or log again, every time it's asked
+            // for
+            std::lock_guard<std::mutex> lock{_mutex};
+            _handles[name] = missing_texture;
+            return missing_texture;
+        }
+    }
+
+    auto const handle = static_cast<texture_handle>(_surfaces.size());
+    if (_palette) {
+        _indexed.push_back(quantize(surf.get(), *_palette));
+    }
+    _surfaces.push_back(surf.get());
+    _owned.push_back(std::move(surf));
+
+    std::lock_guard<std::mutex> lock{_mutex};
+    _handles[name] = handle;
+    return handle;
+}
+
+bool texture_registry::find(
+    std::string const& name, texture_handle& handle) const
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+    auto const existing = _handles.find(name);
+    if (existing == _handles.end() || existing->second == missing_texture) {
+        return false;
+    }
+    handle = existing->second;
+    return true;
+}
+
+void texture_registry::stage(std::string const& name)
+{
+    if (name.empty()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        if (_handles.count(name) || _staged.count(name)) {
+            return;
+        }
+    }
+
+    sdl::surface surf;
+    try {
+        surf = load(name);
+    } catch (std::exception const&) {
+        // acquire() will try again and report it
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock{_mutex};
+    if (!_handles.count(name)) {
+        _staged.emplace(name, std::move(surf));
+    }
+}
+
+void texture_registry::stage_all(
+    std::vector<std::string> const& names, sdl_app::thread_pool& pool)
+{
+    pool.parallel_for(names.size(), [&](std::size_t i) { stage(names[i]); });
+}
+
+void texture_registry::set_palette(std::shared_ptr<palette const> pal)
+{
+    _palette = std::move(pal);
+    _indexed.clear();
+    if (!_palette) {
+        _indexed.shrink_to_fit();
+        return;
+    }
+
+    _indexed.reserve(_surfaces.size());
+    for (auto const surf : _surfaces) {
+        _indexed.push_back(quantize(surf, *_palette));
+    }
+}
+
+texture_memory texture_registry::get_memory_usage() const
+{
+    texture_memory usage;
+    usage.textures = _surfaces.size();
+    for (auto const surf : _surfaces) {
+        usage.truecolor_bytes += static_cast<std::size_t>(surf->pitch) * surf->h;
+    }
+    for (auto const& texture : _indexed) {
+        usage.indexed_bytes += texture.texels.size();
+    }
+    if (_palette) {
+        usage.palette_bytes = _palette->memory_usage();
+    }
+    return usage;
+}
+
+sdl::surface texture_registry::load(std::string const& name) const
+{
+    auto const packed = _pack ? _pack->find(name) : nullptr;
+    if (packed) {
+        return _pack->make_surface(*packed);
+    }
+    return sdl_app::load_image(_base_dir + "/" + name);
+}
+
+} // namespace raycaster
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "palette.hpp"
+
+#include <sdl_application/asset_pack.hpp>
+#include <sdl_application/thread_pool.hpp>
+#include <sdl_raii/sdl_raii.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace raycaster {
+
+/// Dense index into a texture_registry. Levels resolve texture names to
+/// handles once, at load, so the renderer only ever indexes a flat array.
+using texture_handle = std::uint32_t;
+
+/// Always valid: a checkerboard used for missing or unknown textures.
+constexpr texture_handle missing_texture = 0;
+
+/// Bytes taken by textures, per representation.
+struct texture_memory {
+    std::size_t textures = 0;
+    std::size_t truecolor_bytes = 0;
+    /// 0 unless textures are indexed
+    std::size_t indexed_bytes = 0;
+    /// The palette and its lookup tables, 0 unless textures are indexed
+    std::size_t palette_bytes = 0;
+};
+
+/// Owns every texture the levels use and hands out dense handles for them.
+///
+/// Threading: acquire(), find(), set_palette() and the getters must only be
+/// called from the main thread (the getters also from the render workers
+/// while the main thread waits on them).
+/// stage() can be called from any thread to decode images ahead of time so
+/// that a later acquire() doesn't touch the disk.
+class texture_registry {
+public:
+    /// @param pack If set, textures are taken from here (without decoding)
+    /// before falling back to files in `base_dir`
+    explicit texture_registry(std::string base_dir,
+        std::shared_ptr<sdl_app::asset_pack const> pack = nullptr);
+
+    texture_registry(texture_registry const& other) = delete;
+    texture_registry(texture_registry&& other) = delete;
+    texture_registry& operator=(texture_registry const& other) = delete;
+    texture_registry& operator=(texture_registry&& other) = delete;
+
+    /// Resolve `name` (relative to the asset directory) to a handle, loading
+    /// it if needed. Does a hash lookup, so don't use this in a loop.
+    ///
+    /// @return missing_texture if `name` is empty or can't be loaded. A name
+    /// that couldn't be loaded isn't tried again.
+    texture_handle acquire(std::string const& name);
+
+    /// Look up a texture that's already been acquired, without loading it.
+    ///
+    /// @return false if `name` hasn't been acquired, or couldn't be loaded
+    bool find(std::string const& name, texture_handle& handle) const;
+
+    /// Decode `name` without registering it. Thread-safe.
+    void stage(std::string const& name);
+
+    /// stage() many textures at once, decoding them in parallel.
+    void stage_all(
+        std::vector<std::string> const& names, sdl_app::thread_pool& pool);
+
+    SDL_Surface* get(texture_handle handle) const { return _surfaces[handle]; }
+
+    std::size_t size() const { return _surfaces.size(); }
+
+    /// Every texture, indexed by handle
+    std::vector<SDL_Surface*> const& get_all() const { return _surfaces; }
+
+    /// Quantize every texture, loaded and to come, to 8-bit indices into
+    /// `pal`, or go back to truecolor only with nullptr. The truecolor
+    /// surfaces are kept either way. Main thread only.
+    void set_palette(std::shared_ptr<palette const> pal);
+
+    /// @return nullptr unless textures are indexed
+    palette const* get_palette() const { return _palette.get(); }
+
+    /// Only valid while get_palette() isn't nullptr.
+    indexed_texture const& get_indexed(texture_handle handle) const
+    {
+        return _indexed[handle];
+    }
+
+    texture_memory get_memory_usage() const;
+
+private:
+    sdl::surface load(std::string const& name) const;
+
+    std::string const _base_dir;
+    std::shared_ptr<sdl_app::asset_pack const> const _pack;
+
+    /// Indexed by handle. Kept separate from _owned so the hot path is a
+    /// plain pointer array.
+    std::vector<SDL_Surface*> _surfaces;
+    std::vector<sdl::surface> _owned;
+    std::shared_ptr<palette const> _palette;
+    /// Indexed by handle, empty unless there's a palette
+    std::vector<indexed_texture> _indexed;
+
+    /// Guards everything below
+    mutable std::mutex _mutex;
+    std::unordered_map<std::string, texture_handle> _handles;
+    std::unordered_map<std::string, sdl::surface> _staged;
+};
+
+} // namespace raycaster
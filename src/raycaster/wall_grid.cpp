@@ -0,0 +1,382 @@
+#include "wall_grid.hpp"
+
+#include "level.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+using namespace mymath;
+
+namespace {
+
+using namespace raycaster;
+
+/// Walls sitting exactly on a cell boundary (most of them, since levels are
+/// drawn on a grid) are added to the cells on both sides.
+constexpr float boundary_epsilon = 0.001f;
+
+/// Keep the grid from getting sparse on huge maps: at most this many cells per
+/// wall.
+constexpr int max_cells_per_wall = 4;
+constexpr int min_cell_budget = 256;
+
+/// Liang-Barsky clipping of the segment `a -> b` against a box.
+bool clip_segment(point2f const& a, point2f const& b, rectangle2<float> const& box,
+    float& t0, float& t1)
+{
+    auto const dx = b.x - a.x;
+    auto const dy = b.y - a.y;
+
+    float const p[] = {-dx, dx, -dy, dy};
+    float const q[] = {a.x - box.tl.x, box.br.x - a.x, a.y - box.tl.y,
+        box.br.y - a.y};
+
+    for (auto i = 0; i < 4; ++i) {
+        if (p[i] == 0.f) {
+            if (q[i] < 0.f) {
+                return false;
+            }
+            continue;
+        }
+
+        auto const r = q[i] / p[i];
+        if (p[i] < 0.f) {
+            if (r > t1) {
+                return false;
+            }
+            t0 = std::max(t0, r);
+        } else {
+            if (r < t0) {
+                return false;
+            }
+            t1 = std::min(t1, r);
+        }
+    }
+
+    return true;
+}
+
+/// Call `visit(cell_index)` for each cell of `grid` that `line` overlaps.
+/// Test each cell in the line's bounding box (slightly inflated) against the
+/// line itself so long diagonal walls don't fill their entire bounding box.
+template <typename Visitor>
+void for_each_overlapped_cell(
+    wall_grid const& grid, line2f const& line, Visitor&& visit)
+{
+    auto const bb = line.get_bounding_box();
+    auto const lo = grid.cell_of(
+        {bb.tl.x - boundary_epsilon, bb.tl.y - boundary_epsilon});
+    auto const hi = grid.cell_of(
+        {bb.br.x + boundary_epsilon, bb.br.y + boundary_epsilon});
+
+    for (auto cy = lo.y; cy <= hi.y; ++cy) {
+        for (auto cx = lo.x; cx <= hi.x; ++cx) {
+            auto const cell_box = rectangle2<float>{
+                {grid.origin.x + cx * grid.cell_size - boundary_epsilon,
+                    grid.origin.y + cy * grid.cell_size - boundary_epsilon},
+                {grid.origin.x + (cx + 1) * grid.cell_size + boundary_epsilon,
+                    grid.origin.y + (cy + 1) * grid.cell_size
+                        + boundary_epsilon},
+            };
+            auto t0 = 0.f;
+            auto t1 = 1.f;
+            if (clip_segment(line.start, line.end, cell_box, t0, t1)) {
+                visit(cy * grid.width + cx);
+            }
+        }
+    }
+}
+
+/// Take wall `index` out of the dynamic lists of `cells`, returning the
+/// entries to the free list.
+void unlink_dynamic(wall_grid& grid, std::uint32_t index,
+    std::vector<std::int32_t> const& cells)
+{
+    auto& entries = grid.dynamic_entries;
+    for (auto const cell : cells) {
+        // Cell lists are short, so a walk to unlink is fine
+        auto* link = &grid.dynamic_heads[cell];
+        while (*link >= 0 && entries[*link].wall != index) {
+            link = &entries[*link].next;
+        }
+        if (*link < 0) {
+            continue;
+        }
+        auto const entry = *link;
+        *link = entries[entry].next;
+        entries[entry].next = grid.dynamic_free;
+        grid.dynamic_free = entry;
+    }
+}
+
+/// Doubling the cell size this many times covers any finite float range
+constexpr int max_cell_size_doublings = 128;
+
+/// @return The smallest power of two cell size that keeps the grid for
+/// `bounds` within budget, or 0 if `bounds` isn't finite
+float choose_cell_size(rectangle2<float> const& bounds, std::size_t wall_count)
+{
+    auto const budget = std::min(
+        static_cast<float>(wall_grid::max_cells),
+        std::max(static_cast<float>(min_cell_budget),
+            static_cast<float>(max_cells_per_wall) * wall_count));
+
+    auto cell_size = 1.f;
+    for (auto i = 0; i < max_cell_size_doublings; ++i) {
+        auto const w = std::ceil((bounds.br.x - bounds.tl.x) / cell_size) + 1.f;
+        auto const h = std::ceil((bounds.br.y - bounds.tl.y) / cell_size) + 1.f;
+        if (w * h <= budget) {
+            return cell_size;
+        }
+        cell_size *= 2.f;
+    }
+    return 0.f;
+}
+
+bool is_finite(rectangle2<float> const& box)
+{
+    return std::isfinite(box.tl.x) && std::isfinite(box.tl.y)
+        && std::isfinite(box.br.x) && std::isfinite(box.br.y);
+}
+
+} // namespace
+
+namespace raycaster {
+
+point2i wall_grid::cell_of(point2f const& p) const
+{
+    auto const cx = static_cast<int>(std::floor((p.x - origin.x) / cell_size));
+    auto const cy = static_cast<int>(std::floor((p.y - origin.y) / cell_size));
+    return {clamp(cx, 0, width - 1), clamp(cy, 0, height - 1)};
+}
+
+bool wall_grid::clip(line2f const& seg, float& t0, float& t1) const
+{
+    auto const bounds = rectangle2<float>{origin,
+        {origin.x + width * cell_size, origin.y + height * cell_size}};
+    return clip_segment(seg.start, seg.end, bounds, t0, t1);
+}
+
+void wall_grid::query(
+    rectangle2<float> const& box, std::vector<std::uint32_t>& out) const
+{
+    out.clear();
+    if (empty()) {
+        return;
+    }
+
+    auto const lo = cell_of(box.tl);
+    auto const hi = cell_of(box.br);
+    for (auto cy = lo.y; cy <= hi.y; ++cy) {
+        for (auto cx = lo.x; cx <= hi.x; ++cx) {
+            for_each_wall(cy * width + cx,
+                [&out](std::uint32_t wall) { out.push_back(wall); });
+        }
+    }
+
+    // Walls spanning several cells show up once per cell
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+wall_grid::grow_result wall_grid::grow_to_fit(rectangle2<float> const& box)
+{
+    if (!is_finite(box)) {
+        return grow_result::too_big;
+    }
+
+    // An empty grid starts over, nothing is changed until the new size is
+    // known to be within max_cells
+    auto size = cell_size;
+    auto base = origin;
+    auto kept_width = width;
+    auto kept_height = height;
+    if (empty()) {
+        size = choose_cell_size(box, 1);
+        if (!(size > 0.f)) {
+            return grow_result::too_big;
+        }
+        base = point2f{std::floor(box.tl.x / size), std::floor(box.tl.y / size)}
+            * size;
+        kept_width = 0;
+        kept_height = 0;
+    } else if (box.tl.x >= origin.x && box.tl.y >= origin.y
+        && box.br.x < origin.x + width * cell_size
+        && box.br.y < origin.y + height * cell_size) {
+        return grow_result::covered;
+    }
+
+    // Whole cells to add before the first column and row. Everything is
+    // checked against max_cells as a float before it's made an int.
+    auto const max_side = static_cast<float>(max_cells);
+    auto const add_x_cells
+        = std::max(0.f, std::ceil((base.x - box.tl.x) / size));
+    auto const add_y_cells
+        = std::max(0.f, std::ceil((base.y - box.tl.y) / size));
+    if (!(add_x_cells + kept_width <= max_side)
+        || !(add_y_cells + kept_height <= max_side)) {
+        return grow_result::too_big;
+    }
+    auto const add_x = static_cast<int>(add_x_cells);
+    auto const add_y = static_cast<int>(add_y_cells);
+    auto const new_origin
+        = point2f{base.x - add_x * size, base.y - add_y * size};
+    // Like build_wall_grid(), with an extra cell for the max edge
+    auto const width_cells = std::floor((box.br.x - new_origin.x) / size) + 1;
+    auto const height_cells = std::floor((box.br.y - new_origin.y) / size) + 1;
+    if (!(width_cells <= max_side) || !(height_cells <= max_side)) {
+        return grow_result::too_big;
+    }
+    auto const new_width
+        = std::max(add_x + kept_width, static_cast<int>(width_cells));
+    auto const new_height
+        = std::max(add_y + kept_height, static_cast<int>(height_cells));
+    if (std::int64_t{new_width} * new_height > max_cells) {
+        return grow_result::too_big;
+    }
+
+    if (empty()) {
+        width = 0;
+        height = 0;
+        cell_offsets.assign(1, 0u);
+        cell_size = size;
+        origin = base;
+    }
+
+    auto const old_width = width;
+    auto const to_new_cell = [=](int cell) {
+        return (cell / old_width + add_y) * new_width + cell % old_width
+            + add_x;
+    };
+
+    // Flatten again, with empty cells around the old ones. An empty cell
+    // starts and ends where the next old one starts.
+    std::vector<std::uint32_t> offsets;
+    offsets.reserve(static_cast<std::size_t>(new_width) * new_height + 1);
+    auto old_cell = 0;
+    for (auto cy = 0; cy < new_height; ++cy) {
+        for (auto cx = 0; cx < new_width; ++cx) {
+            offsets.push_back(cell_offsets[old_cell]);
+            if (cx >= add_x && cx < add_x + width && cy >= add_y
+                && cy < add_y + height) {
+                ++old_cell;
+            }
+        }
+    }
+    offsets.push_back(static_cast<std::uint32_t>(wall_indices.size()));
+
+    if (!dynamic_heads.empty()) {
+        std::vector<std::int32_t> heads(offsets.size() - 1, -1);
+        for (auto cell = 0; cell < cell_count(); ++cell) {
+            heads[to_new_cell(cell)] = dynamic_heads[cell];
+        }
+        dynamic_heads = std::move(heads);
+        for (auto& wall : dynamic_cells) {
+            for (auto& cell : wall.second) {
+                cell = to_new_cell(cell);
+            }
+        }
+    }
+
+    cell_offsets = std::move(offsets);
+    origin = new_origin;
+    width = new_width;
+    height = new_height;
+    return grow_result::grown;
+}
+
+void wall_grid::insert_dynamic(std::uint32_t index, line2f const& line)
+{
+    if (empty()) {
+        return;
+    }
+    if (dynamic_heads.empty()) {
+        dynamic_heads.assign(cell_count(), -1);
+    }
+
+    // Moving a wall reuses its cell list, so it doesn't allocate once the
+    // list is big enough
+    auto& cells = dynamic_cells[index];
+    unlink_dynamic(*this, index, cells);
+    cells.clear();
+    for_each_overlapped_cell(*this, line, [&](int cell) {
+        std::int32_t entry;
+        if (dynamic_free >= 0) {
+            entry = dynamic_free;
+            dynamic_free = dynamic_entries[entry].next;
+        } else {
+            entry = static_cast<std::int32_t>(dynamic_entries.size());
+            dynamic_entries.push_back({});
+        }
+        dynamic_entries[entry] = dynamic_entry{index, dynamic_heads[cell]};
+        dynamic_heads[cell] = entry;
+        cells.push_back(cell);
+    });
+}
+
+void wall_grid::remove_dynamic(std::uint32_t index)
+{
+    auto const found = dynamic_cells.find(index);
+    if (found == dynamic_cells.end()) {
+        return;
+    }
+
+    unlink_dynamic(*this, index, found->second);
+    dynamic_cells.erase(found);
+}
+
+wall_grid build_wall_grid(std::vector<wall> const& walls)
+{
+    wall_grid grid;
+    if (walls.empty()) {
+        grid.cell_offsets.push_back(0);
+        return grid;
+    }
+
+    auto bounds = walls.front().data.get_bounding_box();
+    for (auto const& w : walls) {
+        auto const bb = w.data.get_bounding_box();
+        bounds.tl.x = std::min(bounds.tl.x, bb.tl.x);
+        bounds.tl.y = std::min(bounds.tl.y, bb.tl.y);
+        bounds.br.x = std::max(bounds.br.x, bb.br.x);
+        bounds.br.y = std::max(bounds.br.y, bb.br.y);
+    }
+
+    grid.cell_size = choose_cell_size(bounds, walls.size());
+    if (!(grid.cell_size > 0.f)) {
+        throw std::runtime_error{"Walls with coordinates that aren't finite"};
+    }
+    grid.origin = point2f{std::floor(bounds.tl.x / grid.cell_size),
+                      std::floor(bounds.tl.y / grid.cell_size)}
+        * grid.cell_size;
+    // The extra cell keeps walls on the max edge inside the grid
+    grid.width = static_cast<int>(
+                     std::floor((bounds.br.x - grid.origin.x) / grid.cell_size))
+        + 1;
+    grid.height = static_cast<int>(std::floor(
+                      (bounds.br.y - grid.origin.y) / grid.cell_size))
+        + 1;
+
+    // Figure out which cells each wall overlaps
+    std::vector<std::vector<std::uint32_t>> cells(grid.cell_count());
+    for (std::uint32_t i = 0; i < walls.size(); ++i) {
+        for_each_overlapped_cell(grid, walls[i].data,
+            [&cells, i](int cell) { cells[cell].push_back(i); });
+    }
+
+    // Flatten
+    grid.cell_offsets.reserve(cells.size() + 1);
+    for (auto const& cell : cells) {
+        grid.cell_offsets.push_back(
+            static_cast<std::uint32_t>(grid.wall_indices.size()));
+        grid.wall_indices.insert(
+            grid.wall_indices.end(), cell.begin(), cell.end());
+    }
+    grid.cell_offsets.push_back(
+        static_cast<std::uint32_t>(grid.wall_indices.size()));
+
+    return grid;
+}
+
+} // namespace raycaster
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <mymath/mymath.hpp>
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace raycaster {
+
+struct wall;
+
+/// A uniform grid over the level's walls. Each cell lists the walls that
+/// overlap it, so a ray (or a moving object) only has to test the walls in
+/// the cells it actually passes through instead of every wall in the level.
+///
+/// Cells are stored flattened (CSR): the walls in cell `i` are
+/// `wall_indices[cell_offsets[i]]` up to `wall_indices[cell_offsets[i + 1]]`.
+/// That keeps the whole grid in two flat arrays which are easy to serialize.
+///
+/// Walls that move at runtime (doors, platforms) can't live in the flat
+/// arrays without rebuilding them. They're kept in a second, dynamic layer of
+/// per-cell lists instead, which insert_dynamic()/remove_dynamic() update
+/// one wall at a time. Use for_each_wall() to see both layers.
+struct wall_grid {
+    /// Grids never have more cells than this, so cell indices and counts fit
+    /// in an int and a corrupt level or a runaway wall can't make one take
+    /// gigabytes
+    static constexpr int max_cells = 1 << 24;
+
+    /// World space position of the top-left corner of cell (0, 0)
+    mymath::point2f origin{0.f, 0.f};
+    float cell_size = 1.f;
+    int width = 0;
+    int height = 0;
+
+    std::vector<std::uint32_t> cell_offsets;
+    std::vector<std::uint32_t> wall_indices;
+
+    /// One entry of a dynamic cell list
+    struct dynamic_entry {
+        std::uint32_t wall;
+        /// Next entry in the same cell (or the free list), -1 at the end
+        std::int32_t next;
+    };
+
+    /// Runtime only, never serialized. Empty until the first dynamic wall is
+    /// inserted, so static levels pay nothing for it.
+    std::vector<std::int32_t> dynamic_heads;
+    std::vector<dynamic_entry> dynamic_entries;
+    std::int32_t dynamic_free = -1;
+    /// The cells each dynamic wall is in, so it can be removed quickly
+    std::unordered_map<std::uint32_t, std::vector<std::int32_t>> dynamic_cells;
+
+    bool empty() const { return width == 0 || height == 0; }
+
+    int cell_count() const { return width * height; }
+
+    /// @return The cell containing `p`, clamped to the edges of the grid.
+    mymath::point2i cell_of(mymath::point2f const& p) const;
+
+    /// Clip a segment to the bounds of the grid.
+    ///
+    /// @param t0 In: start factor along `seg`. Out: clipped start.
+    /// @param t1 In: end factor along `seg`. Out: clipped end.
+    /// @return false if the segment misses the grid entirely
+    bool clip(mymath::line2f const& seg, float& t0, float& t1) const;
+
+    /// Call `visit(wall_index)` for each wall in `cell`, static ones first.
+    template <typename Visitor>
+    void for_each_wall(int cell, Visitor&& visit) const;
+
+    /// Like for_each_wall(), but only the dynamic layer.
+    template <typename Visitor>
+    void for_each_dynamic_wall(int cell, Visitor&& visit) const;
+
+    bool has_dynamic_walls() const { return !dynamic_cells.empty(); }
+
+    enum class grow_result {
+        /// The grid already covered the box, nothing changed
+        covered,
+        grown,
+        /// Covering the box would take more than max_cells cells (or the box
+        /// isn't finite), nothing changed
+        too_big,
+    };
+
+    /// Add cells around the grid until it covers `box`. The cell size stays
+    /// the same, so walls stay in the cells they were in, but cell indices
+    /// change. An empty grid gets a cell size to suit `box`.
+    grow_result grow_to_fit(mymath::rectangle2<float> const& box);
+
+    /// Add wall `index` to the dynamic layer of every cell `line` overlaps.
+    /// Parts of `line` outside the grid are attributed to the nearest edge
+    /// cells, so grow_to_fit() it first.
+    void insert_dynamic(std::uint32_t index, mymath::line2f const& line);
+
+    /// Take wall `index` out of the dynamic layer. Does nothing if it isn't
+    /// there.
+    void remove_dynamic(std::uint32_t index);
+
+    /// Collect the walls in every cell overlapping `box`. Each wall is listed
+    /// once, in ascending order.
+    ///
+    /// @param out Cleared, then filled with indices into the level's walls
+    void query(mymath::rectangle2<float> const& box,
+        std::vector<std::uint32_t>& out) const;
+
+    /// Visit every cell that `seg` passes through, in order from `seg.start`
+    /// to `seg.end` (Amanatides & Woo voxel traversal).
+    ///
+    /// @param visit Called as `visit(cell_index, t_exit)` where `t_exit` is
+    /// the factor along `seg` at which the segment leaves the cell. Return
+    /// false to stop early.
+    template <typename Visitor>
+    void traverse(mymath::line2f const& seg, Visitor&& visit) const;
+};
+
+/// Build a grid for `walls`. A cell size is picked automatically so the
+/// number of cells stays proportional to the number of walls.
+///
+/// @throw std::runtime_error if a wall's coordinates aren't finite
+wall_grid build_wall_grid(std::vector<wall> const& walls);
+
+//
+// template implementation
+//
+
+template <typename Visitor>
+void wall_grid::for_each_wall(int cell, Visitor&& visit) const
+{
+    for (auto i = cell_offsets[cell]; i < cell_offsets[cell + 1]; ++i) {
+        visit(wall_indices[i]);
+    }
+    for_each_dynamic_wall(cell, visit);
+}
+
+template <typename Visitor>
+void wall_grid::for_each_dynamic_wall(int cell, Visitor&& visit) const
+{
+    if (dynamic_heads.empty()) {
+        return;
+    }
+    for (auto e = dynamic_heads[cell]; e >= 0; e = dynamic_entries[e].next) {
+        visit(dynamic_entries[e].wall);
+    }
+}
+
+template <typename Visitor>
+void wall_grid::traverse(mymath::line2f const& seg, Visitor&& visit) const
+{
+    if (empty()) {
+        return;
+    }
+
+    auto t0 = 0.f;
+    auto t1 = 1.f;
+    if (!clip(seg, t0, t1)) {
+        return;
+    }
+
+    auto const dx = seg.end.x - seg.start.x;
+    auto const dy = seg.end.y - seg.start.y;
+
+    auto const entry = mymath::point2f{seg.start.x + dx * t0,
+        seg.start.y + dy * t0};
+    auto const cell = cell_of(entry);
+    auto cx = cell.x;
+    auto cy = cell.y;
+
+    // Stepping direction and the `t` at which the segment crosses the next
+    // vertical/horizontal cell boundary.
+    auto const inf = 1e30f;
+    auto const step_x = dx > 0.f ? 1 : -1;
+    auto const step_y = dy > 0.f ? 1 : -1;
+    auto const t_delta_x = dx != 0.f ? cell_size / mymath::abs(dx) : inf;
+    auto const t_delta_y = dy != 0.f ? cell_size / mymath::abs(dy) : inf;
+    auto t_max_x = inf;
+    auto t_max_y = inf;
+    if (dx != 0.f) {
+        auto const boundary_x
+            = origin.x + (cx + (step_x > 0 ? 1 : 0)) * cell_size;
+        t_max_x = (boundary_x - seg.start.x) / dx;
+    }
+    if (dy != 0.f) {
+        auto const boundary_y
+            = origin.y + (cy + (step_y > 0 ? 1 : 0)) * cell_size;
+        t_max_y = (boundary_y - seg.start.y) / dy;
+    }
+
+    while (true) {
+        auto const t_exit = std::min(std::min(t_max_x, t_max_y), t1);
+        if (!visit(cy * width + cx, t_exit)) {
+            return;
+        }
+        if (t_exit >= t1) {
+            return;
+        }
+
+        if (t_max_x < t_max_y) {
+            cx += step_x;
+            t_max_x += t_delta_x;
+        } else {
+            cy += step_y;
+            t_max_y += t_delta_y;
+        }
+
+        if (cx < 0 || cx >= width || cy < 0 || cy >= height) {
+            return;
+        }
+    }
+}
+
+} // namespace raycaster
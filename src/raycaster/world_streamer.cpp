@@ -0,0 +1,340 @@
+#include "world_streamer.hpp"
+
+#include "level_binary.hpp"
+
+#include <SDL.h>
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+
+using namespace mymath;
+
+namespace {
+
+using namespace raycaster;
+
+constexpr auto world_manifest_name = "world.lua";
+
+/// Bookkeeping per cached chunk, on top of the level itself
+constexpr std::size_t chunk_overhead = 64;
+
+/// Concatenate chunks into one level, merging their texture tables.
+///
+/// @param chunks The nearest first; it supplies the floor and ceiling. Empty
+/// chunks are nullptr.
+std::unique_ptr<level> stitch(
+    std::vector<std::shared_ptr<level const>> const& chunks)
+{
+    auto view = std::make_unique<level>();
+
+    std::unordered_map<std::string, unsigned> texids;
+    auto const remap = [&](level const& chunk, unsigned texid) {
+        auto const& name = texid < chunk.texture_names.size()
+            ? chunk.texture_names[texid]
+            : std::string{};
+        auto const found = texids.find(name);
+        if (found != texids.end()) {
+            return found->second;
+        }
+        auto const new_texid
+            = static_cast<unsigned>(view->texture_names.size());
+        view->texture_names.push_back(name);
+        texids.emplace(name, new_texid);
+        return new_texid;
+    };
+
+    auto first = true;
+    for (auto const& chunk : chunks) {
+        if (!chunk) {
+            continue;
+        }
+        if (first) {
+            view->player_start = chunk->player_start;
+            view->floor_texture = remap(*chunk, chunk->floor_texture);
+            view->ceiling_texture = remap(*chunk, chunk->ceiling_texture);
+            first = false;
+        }
+
+        // Dynamic walls are a runtime thing, chunks shouldn't have any
+        auto const n_walls
+            = std::min(chunk->walls.size(), chunk->first_dynamic_wall);
+        for (std::size_t i = 0; i < n_walls; ++i) {
+            auto w = chunk->walls[i];
+            w.texture = remap(*chunk, w.texture);
+            view->walls.push_back(w);
+        }
+
+        auto const& positions = chunk->sprites.get_positions();
+        auto const& textures = chunk->sprites.get_textures();
+        auto const& states = chunk->sprites.get_states();
+        for (std::size_t i = 0; i < positions.size(); ++i) {
+            view->sprites.spawn(
+                positions[i], remap(*chunk, textures[i]), states[i]);
+        }
+    }
+
+    if (first) {
+        // Nothing but empty chunks around
+        view->floor_texture = remap(*view, 0);
+        view->ceiling_texture = view->floor_texture;
+    }
+
+    view->grid = build_wall_grid(view->walls);
+    return view;
+}
+
+} // namespace
+
+namespace raycaster {
+
+std::string chunk_filename(std::string const& dir, chunk_coord c)
+{
+    return dir + "/" + std::to_string(c.x) + "_" + std::to_string(c.y)
+        + level_binary_extension;
+}
+
+chunk_source make_chunk_directory_source(
+    std::string dir, std::shared_ptr<sdl_app::asset_pack const> pack)
+{
+    return [dir, pack](chunk_coord c) -> std::unique_ptr<level> {
+        auto const filename = chunk_filename(dir, c);
+        auto const packed = pack ? pack->find(filename) : nullptr;
+        if (packed) {
+            return load_level_binary(packed->data, packed->size, filename);
+        }
+        // Only chunks with something in them are written out
+        if (!std::ifstream{filename}) {
+            return nullptr;
+        }
+        return load_level_binary(filename);
+    };
+}
+
+world_manifest load_world_manifest(
+    std::string const& dir, lua_State* L, sdl_app::asset_pack const* pack)
+{
+    auto const filename = dir + "/" + world_manifest_name;
+    auto const packed = pack ? pack->find(filename) : nullptr;
+    auto const failed = packed
+        ? luaL_loadbuffer(L, reinterpret_cast<char const*>(packed->data),
+              packed->size, filename.c_str())
+        : luaL_loadfile(L, filename.c_str());
+    if (failed || lua_pcall(L, 0, 1, 0)) {
+        auto const error = lua::to<std::string>(L);
+        lua_pop(L, 1); // error
+        throw std::runtime_error{error};
+    }
+
+    auto const table = lua_gettop(L);
+    if (lua_type(L, table) != LUA_TTABLE
+        || lua_getfield(L, table, "chunk_size") != LUA_TNUMBER
+        || lua_getfield(L, table, "player_start") != LUA_TTABLE
+        || lua_getfield(L, table + 2, "x") != LUA_TNUMBER
+        || lua_getfield(L, table + 2, "y") != LUA_TNUMBER) {
+        lua_settop(L, table - 1);
+        throw std::runtime_error{"Bad world manifest: " + filename};
+    }
+
+    auto const manifest = world_manifest{lua::to<float>(L, table + 1),
+        {lua::to<float>(L, table + 3), lua::to<float>(L, table + 4)}};
+    lua_settop(L, table - 1);
+
+    if (!(manifest.chunk_size > 0.f)) {
+        throw std::runtime_error{"Bad chunk size in " + filename};
+    }
+    return manifest;
+}
+
+world_streamer::world_streamer(texture_registry& textures,
+    chunk_source source, world_options const& options)
+: _textures{textures}
+, _source{std::move(source)}
+, _options{options}
+{
+    _stats.budget_bytes = _options.budget_bytes;
+    _worker = std::thread([this] { worker_main(); });
+}
+
+world_streamer::~world_streamer()
+{
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        _stopping = true;
+    }
+    _wake_worker.notify_one();
+    _worker.join();
+}
+
+void world_streamer::update(point2f const& position)
+{
+    auto const center = chunk_of(position);
+    if (_has_center && center == _center) {
+        return;
+    }
+    _has_center = true;
+    _center = center;
+
+    std::vector<chunk_coord> wanted;
+    auto const r = std::max(_options.view_radius, 0);
+    for (auto dy = -r; dy <= r; ++dy) {
+        for (auto dx = -r; dx <= r; ++dx) {
+            wanted.push_back({center.x + dx, center.y + dy});
+        }
+    }
+    auto const distance = [center](chunk_coord c) {
+        return (c.x - center.x) * (c.x - center.x)
+            + (c.y - center.y) * (c.y - center.y);
+    };
+    std::stable_sort(wanted.begin(), wanted.end(),
+        [&](chunk_coord a, chunk_coord b) {
+            return distance(a) < distance(b);
+        });
+
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        _wanted = std::move(wanted);
+        ++_generation;
+    }
+    _wake_worker.notify_one();
+}
+
+std::unique_ptr<level> world_streamer::take_view()
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+    return std::move(_view);
+}
+
+world_stats world_streamer::get_stats()
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+    auto stats = _stats;
+    stats.resident_chunks = _cache.size();
+    stats.pending_chunks = static_cast<std::size_t>(
+        std::count_if(_wanted.begin(), _wanted.end(), [this](chunk_coord c) {
+            return std::none_of(_cache.begin(), _cache.end(),
+                [c](chunk const& cached) { return cached.coord == c; });
+        }));
+    return stats;
+}
+
+chunk_coord world_streamer::chunk_of(point2f const& p) const
+{
+    return {static_cast<int>(std::floor(p.x / _options.chunk_size)),
+        static_cast<int>(std::floor(p.y / _options.chunk_size))};
+}
+
+world_streamer::chunk* world_streamer::find(chunk_coord c)
+{
+    auto it = std::find_if(_cache.begin(), _cache.end(),
+        [c](chunk const& cached) { return cached.coord == c; });
+    if (it == _cache.end()) {
+        return nullptr;
+    }
+    _cache.splice(_cache.begin(), _cache, it);
+    return &_cache.front();
+}
+
+bool world_streamer::is_wanted(chunk_coord c) const
+{
+    return std::find(_wanted.begin(), _wanted.end(), c) != _wanted.end();
+}
+
+void world_streamer::evict()
+{
+    // Never evict the chunks around the camera, they're about to be stitched
+    auto it = _cache.end();
+    while (_stats.resident_bytes > _options.budget_bytes
+        && it != _cache.begin()) {
+        --it;
+        if (!is_wanted(it->coord)) {
+            _stats.resident_bytes -= it->bytes;
+            ++_stats.evictions;
+            it = _cache.erase(it);
+        }
+    }
+
+    if (_stats.resident_bytes > _options.budget_bytes) {
+        if (!_warned_over_budget) {
+            SDL_Log("world_streamer: the chunks around the camera need %u "
+                    "bytes, over the budget of %u",
+                static_cast<unsigned>(_stats.resident_bytes),
+                static_cast<unsigned>(_options.budget_bytes));
+            _warned_over_budget = true;
+        }
+    } else {
+        _warned_over_budget = false;
+    }
+}
+
+void world_streamer::worker_main()
+{
+    while (true) {
+        unsigned generation;
+        auto have_missing = false;
+        chunk_coord missing;
+        std::vector<std::shared_ptr<level const>> chunks;
+        {
+            std::unique_lock<std::mutex> lock{_mutex};
+            _wake_worker.wait(lock, [this] {
+                return _stopping || _stitched_generation != _generation;
+            });
+            if (_stopping) {
+                break;
+            }
+
+            generation = _generation;
+            for (auto const c : _wanted) {
+                auto const cached = find(c);
+                if (!cached) {
+                    missing = c;
+                    have_missing = true;
+                    break;
+                }
+                chunks.push_back(cached->data);
+            }
+        }
+
+        if (have_missing) {
+            // One chunk at a time, so a camera that keeps moving gets the
+            // chunks around where it is now rather than where it was
+            std::shared_ptr<level const> loaded;
+            try {
+                auto new_chunk = _source(missing);
+                if (new_chunk) {
+                    _textures.stage_all(new_chunk->texture_names, _decode_pool);
+                }
+                loaded = std::move(new_chunk);
+            } catch (std::exception const& e) {
+                // Treat it as empty rather than retrying every frame
+                SDL_Log("world_streamer: failed to load chunk %d, %d: %s",
+                    missing.x, missing.y, e.what());
+            }
+            auto const bytes
+                = chunk_overhead + (loaded ? memory_usage(*loaded) : 0);
+
+            std::lock_guard<std::mutex> lock{_mutex};
+            _cache.push_front(chunk{missing, std::move(loaded), bytes});
+            _stats.resident_bytes += bytes;
+            ++_stats.loads;
+            evict();
+            continue;
+        }
+
+        auto view = stitch(chunks);
+        auto const view_bytes = memory_usage(*view);
+
+        std::lock_guard<std::mutex> lock{_mutex};
+        // Otherwise the camera has moved on and it's already out of date
+        if (generation == _generation) {
+            _view = std::move(view);
+            _stitched_generation = generation;
+            _stats.view_bytes = view_bytes;
+        }
+    }
+}
+
+} // namespace raycaster
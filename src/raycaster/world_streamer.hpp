@@ -0,0 +1,170 @@
+/// @file world_streamer.hpp
+/// @brief Streaming worlds too big to keep in memory.
+///
+/// A world is split into square chunks of `chunk_size` units, each one a
+/// small level in world coordinates (see `level_compiler --chunk-size`, or
+/// generate them on the fly with a chunk_source). The streamer loads the
+/// chunks around the camera on a background thread and stitches them into
+/// one level, so the renderer and collision don't need to know about chunks
+/// at all.
+///
+/// Loaded chunks are cached up to a memory budget. Past it, the least
+/// recently used chunks that aren't around the camera are dropped. Textures
+/// are shared by every chunk and stay loaded.
+///
+/// The stitched level is rebuilt whenever the camera crosses into another
+/// chunk. Changes made to the old one during play (sprites, dynamic walls)
+/// don't carry over, so streamed worlds are for scenery.
+
+#pragma once
+
+#include "level.hpp"
+#include "texture_registry.hpp"
+
+#include <lua_raii/lua_raii.hpp>
+#include <mymath/mymath.hpp>
+#include <sdl_application/asset_pack.hpp>
+#include <sdl_application/thread_pool.hpp>
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace raycaster {
+
+struct chunk_coord {
+    int x = 0;
+    int y = 0;
+};
+
+inline bool operator==(chunk_coord const& lhs, chunk_coord const& rhs)
+{
+    return lhs.x == rhs.x && lhs.y == rhs.y;
+}
+
+inline bool operator!=(chunk_coord const& lhs, chunk_coord const& rhs)
+{
+    return !(lhs == rhs);
+}
+
+/// Makes a chunk: a level with its walls and sprites in world coordinates,
+/// and its textures not bound. Returns nullptr for empty chunks. Called on
+/// the streaming thread.
+using chunk_source = std::function<std::unique_ptr<level>(chunk_coord)>;
+
+/// @return Where chunk `c` is stored in a chunk directory
+std::string chunk_filename(std::string const& dir, chunk_coord c);
+
+/// Chunks stored as compiled levels in `dir` (see chunk_filename()), or in
+/// `pack` under the same names. Missing chunks are empty.
+chunk_source make_chunk_directory_source(std::string dir,
+    std::shared_ptr<sdl_app::asset_pack const> pack = nullptr);
+
+/// The `world.lua` script in a chunk directory, which returns
+/// `{chunk_size = ..., player_start = {x = ..., y = ...}}`.
+struct world_manifest {
+    float chunk_size;
+    mymath::point2f player_start;
+};
+
+/// Run the `world.lua` in `dir`, from `pack` if it has it.
+///
+/// @throws std::runtime_error if it's missing or malformed
+world_manifest load_world_manifest(
+    std::string const& dir, lua_State* L, sdl_app::asset_pack const* pack);
+
+struct world_options {
+    float chunk_size = 64.f;
+    /// How many chunks to keep loaded on each side of the camera's
+    int view_radius = 1;
+    /// Chunks around the camera are kept even past this
+    std::size_t budget_bytes = std::size_t{64} << 20;
+};
+
+struct world_stats {
+    std::size_t resident_chunks = 0;
+    std::size_t resident_bytes = 0;
+    std::size_t budget_bytes = 0;
+    /// The last stitched level, a copy of the chunks around the camera. Not
+    /// counted against the budget.
+    std::size_t view_bytes = 0;
+    /// Chunks around the camera that are still loading
+    std::size_t pending_chunks = 0;
+    std::size_t loads = 0;
+    std::size_t evictions = 0;
+};
+
+class world_streamer {
+public:
+    world_streamer(texture_registry& textures, chunk_source source,
+        world_options const& options);
+    ~world_streamer();
+
+    world_streamer(world_streamer const& other) = delete;
+    world_streamer(world_streamer&& other) = delete;
+    world_streamer& operator=(world_streamer const& other) = delete;
+    world_streamer& operator=(world_streamer&& other) = delete;
+
+    /// Call every frame with the camera's position. When it enters another
+    /// chunk, the chunks around it are requested, nearest first.
+    void update(mymath::point2f const& position);
+
+    /// @return The chunks around the camera stitched into one level, or
+    /// nullptr if they're still loading or it was already taken. Its
+    /// textures aren't bound yet.
+    std::unique_ptr<level> take_view();
+
+    world_stats get_stats();
+
+    chunk_coord chunk_of(mymath::point2f const& p) const;
+
+private:
+    struct chunk {
+        chunk_coord coord;
+        /// nullptr for empty chunks
+        std::shared_ptr<level const> data;
+        std::size_t bytes;
+    };
+
+    /// Must hold _mutex. Moves the chunk to the front (most recently used).
+    chunk* find(chunk_coord c);
+    /// Must hold _mutex.
+    bool is_wanted(chunk_coord c) const;
+    /// Must hold _mutex.
+    void evict();
+    void worker_main();
+
+    texture_registry& _textures;
+    chunk_source const _source;
+    world_options const _options;
+    sdl_app::thread_pool _decode_pool;
+
+    /// Main thread only
+    bool _has_center = false;
+    chunk_coord _center;
+
+    std::mutex _mutex;
+    std::condition_variable _wake_worker;
+    /// The chunks around the camera, nearest first
+    std::vector<chunk_coord> _wanted;
+    /// Bumped whenever `_wanted` changes
+    unsigned _generation = 0;
+    /// The generation `_view` was stitched for
+    unsigned _stitched_generation = 0;
+    std::unique_ptr<level> _view;
+    /// Most recently used first
+    std::list<chunk> _cache;
+    world_stats _stats;
+    bool _warned_over_budget = false;
+    bool _stopping = false;
+
+    std::thread _worker;
+};
+
+} // namespace raycaster
@@ -0,0 +1,171 @@
+/// Renders a level offscreen from its player start, turning on the spot, and
+/// reports the time per frame in each rendering mode:
+///
+/// - `truecolor`: the default
+/// - `indexed`: 8-bit indexed textures, also reporting how many bytes of
+///   texture the renderer reads from
+/// - `vrs`: truecolor with variable-rate shading, using the default rates
+/// - `scaling`: truecolor at 720p, 1080p, 1440p and 4K, also reporting the
+///   time per pixel and how long the pipeline took to prepare for each size.
+///   Not part of `all`, since 4K takes a while.
+///
+/// The view from the player start is saved to `render_<mode>.bmp` for each
+/// mode, to compare with `image_diff`. To compare cache miss rates, run one
+/// mode at a time under a profiler, e.g. `perf stat -e
+/// cache-references,cache-misses render_benchmark
+/// assets/levels/test_level.tmx.lua 500 indexed`.
+///
+/// Run from the repo root, so the textures can be found in `assets/`.
+
+#include <raycaster/camera.hpp>
+#include <raycaster/level.hpp>
+#include <raycaster/palette.hpp>
+#include <raycaster/pipeline.hpp>
+#include <raycaster/texture_registry.hpp>
+
+#include <lua_raii/lua_raii.hpp>
+#include <sdl_raii/sdl_raii.hpp>
+
+#include <SDL.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <memory>
+#include <string>
+
+using namespace mymath;
+using namespace raycaster;
+
+namespace {
+
+constexpr auto fb_width = 640;
+constexpr auto fb_height = 360;
+
+struct resolution {
+    char const* name;
+    int width;
+    int height;
+};
+
+constexpr resolution scaling_resolutions[] = {
+    {"720p", 1280, 720},
+    {"1080p", 1920, 1080},
+    {"1440p", 2560, 1440},
+    {"4K", 3840, 2160},
+};
+
+/// @return Milliseconds per frame
+double run(render_pipeline& pipeline, level const& lvl, camera cam,
+    SDL_Surface& framebuffer, int frames)
+{
+    // One full turn over all the frames
+    auto const yaw_step = 2.f * static_cast<float>(M_PI) / frames;
+
+    // Warm up the caches and the worker threads
+    pipeline.render(lvl, cam, framebuffer);
+
+    auto const start = std::chrono::steady_clock::now();
+    for (auto frame = 0; frame < frames; ++frame) {
+        pipeline.render(lvl, cam, framebuffer);
+        cam.rotate(yaw_step);
+    }
+    return std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - start)
+               .count()
+        / frames;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    auto const frames = argc > 2 ? std::atoi(argv[2]) : 300;
+    auto const mode = argc > 3 ? std::string{argv[3]} : "all";
+    if (argc < 2 || frames <= 0
+        || (mode != "all" && mode != "truecolor" && mode != "indexed"
+            && mode != "vrs" && mode != "scaling")) {
+        std::fprintf(stderr,
+            "Usage: %s level [frames] [all|truecolor|indexed|vrs|scaling]\n",
+            argv[0]);
+        return 1;
+    }
+
+    try {
+        auto L = lua::make_state();
+        auto lvl = load_level(argv[1], L.get());
+        texture_registry textures{"assets"};
+        bind_textures(*lvl, textures);
+
+        auto framebuffer = sdl::make_surface(SDL_CreateRGBSurfaceWithFormat(
+            0, fb_width, fb_height, 32, SDL_PIXELFORMAT_ARGB8888));
+        camera const cam{lvl->player_start, 0.f, 0.01f, 8.f, 0.01f};
+        render_pipeline pipeline{textures};
+
+        auto const save = [&](std::string const& name) {
+            pipeline.render(*lvl, cam, *framebuffer);
+            auto const filename = "render_" + name + ".bmp";
+            if (SDL_SaveBMP(framebuffer.get(), filename.c_str()) != 0) {
+                std::fprintf(stderr, "Couldn't save %s: %s\n",
+                    filename.c_str(), SDL_GetError());
+            }
+        };
+
+        if (mode == "all" || mode == "truecolor") {
+            auto const ms = run(pipeline, *lvl, cam, *framebuffer, frames);
+            std::printf("truecolor: %.3f ms/frame, %u texture bytes\n", ms,
+                static_cast<unsigned>(
+                    textures.get_memory_usage().truecolor_bytes));
+            save("truecolor");
+        }
+
+        if (mode == "all" || mode == "indexed") {
+            textures.set_palette(std::make_shared<palette const>(
+                build_palette(textures.get_all())));
+            auto const ms = run(pipeline, *lvl, cam, *framebuffer, frames);
+            auto const memory = textures.get_memory_usage();
+            std::printf("indexed:   %.3f ms/frame, %u texture bytes + %u for "
+                        "the palette\n",
+                ms, static_cast<unsigned>(memory.indexed_bytes),
+                static_cast<unsigned>(memory.palette_bytes));
+            save("indexed");
+            textures.set_palette(nullptr);
+        }
+
+        if (mode == "all" || mode == "vrs") {
+            shading_rates rates;
+            rates.enabled = true;
+            pipeline.set_shading_rates(rates);
+            auto const ms = run(pipeline, *lvl, cam, *framebuffer, frames);
+            std::printf("vrs:       %.3f ms/frame\n", ms);
+            save("vrs");
+        }
+
+        if (mode == "scaling") {
+            for (auto const& size : scaling_resolutions) {
+                auto scaled = sdl::make_surface(SDL_CreateRGBSurfaceWithFormat(
+                    0, size.width, size.height, 32, SDL_PIXELFORMAT_ARGB8888));
+
+                auto const start = std::chrono::steady_clock::now();
+                pipeline.prepare(cam, *scaled);
+                auto const prepared = std::chrono::duration<double,
+                    std::milli>{std::chrono::steady_clock::now() - start};
+
+                auto const ms = run(pipeline, *lvl, cam, *scaled, frames);
+                auto const pixels
+                    = static_cast<double>(size.width) * size.height;
+                std::printf("%-5s %4dx%-4d: %8.3f ms/frame, %.2f ns/pixel, "
+                            "prepared in %.3f ms\n",
+                    size.name, size.width, size.height, ms,
+                    ms * 1e6 / pixels, prepared.count());
+            }
+        }
+    } catch (std::exception const& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,238 @@
+#include "asset_pack.hpp"
+
+#include <sdl_application/asset_store.hpp>
+
+#include <SDL.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+using namespace std::string_literals;
+
+namespace {
+
+constexpr std::uint8_t magic[4] = {'R', 'C', 'A', 'P'};
+constexpr std::size_t header_words = 4;
+constexpr std::size_t entry_words = 8;
+constexpr auto purple_b8g8r8 = 0x00FF00FF;
+
+std::uint32_t read_u32(std::uint8_t const* p)
+{
+    return static_cast<std::uint32_t>(p[0])
+        | static_cast<std::uint32_t>(p[1]) << 8
+        | static_cast<std::uint32_t>(p[2]) << 16
+        | static_cast<std::uint32_t>(p[3]) << 24;
+}
+
+void write_u32(std::vector<std::uint8_t>& out, std::size_t at, std::uint32_t u)
+{
+    for (auto i = 0; i < 4; ++i) {
+        out[at + i] = static_cast<std::uint8_t>(u >> (8 * i));
+    }
+}
+
+bool ends_with(std::string const& str, std::string const& suffix)
+{
+    return str.size() >= suffix.size()
+        && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+std::vector<std::uint8_t> read_file(std::string const& path)
+{
+    std::ifstream file{path, std::ios::binary};
+    if (!file) {
+        throw std::runtime_error{"Couldn't open "s + path};
+    }
+    return std::vector<std::uint8_t>{std::istreambuf_iterator<char>{file},
+        std::istreambuf_iterator<char>{}};
+}
+
+} // namespace
+
+namespace sdl_app {
+
+std::uint32_t fnv1a(std::uint8_t const* data, std::size_t size)
+{
+    auto hash = 2166136261u;
+    for (std::size_t i = 0; i < size; ++i) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+asset_pack::asset_pack(std::string const& path, std::string base_dir)
+: _file{path}
+, _base_prefix{std::move(base_dir) + "/"}
+{
+    auto const data = _file.data();
+    auto const size = _file.size();
+
+    if (size < header_words * 4 || std::memcmp(data, magic, 4) != 0) {
+        throw std::runtime_error{"Not an asset pack: "s + path};
+    }
+    if (read_u32(data + 4) != asset_pack_version) {
+        throw std::runtime_error{"Unsupported asset pack version: "s + path};
+    }
+
+    auto const count = read_u32(data + 8);
+    if ((header_words + entry_words * static_cast<std::size_t>(count)) * 4
+        > size) {
+        throw std::runtime_error{"Truncated asset pack: "s + path};
+    }
+
+    _entries.reserve(count);
+    for (std::uint32_t i = 0; i < count; ++i) {
+        auto const e = data + (header_words + entry_words * i) * 4;
+        auto const name_offset = read_u32(e);
+        auto const name_size = read_u32(e + 4);
+        auto const data_offset = read_u32(e + 12);
+        auto const data_size = read_u32(e + 16);
+
+        if (static_cast<std::size_t>(name_offset) + name_size > size
+            || static_cast<std::size_t>(data_offset) + data_size > size) {
+            throw std::runtime_error{"Corrupt asset pack entry in "s + path};
+        }
+
+        entry new_entry{
+            std::string{reinterpret_cast<char const*>(data + name_offset),
+                name_size},
+            static_cast<asset_type>(read_u32(e + 8)),
+            data + data_offset,
+            data_size,
+            read_u32(e + 20),
+            static_cast<int>(read_u32(e + 24)),
+            static_cast<int>(read_u32(e + 28)),
+        };
+
+        if (new_entry.type == asset_type::image_bgr24
+            && static_cast<std::size_t>(new_entry.width) * new_entry.height * 3
+                != data_size) {
+            throw std::runtime_error{"Bad image size for "s + new_entry.name};
+        }
+
+        _index[new_entry.name] = _entries.size();
+        _entries.push_back(std::move(new_entry));
+    }
+}
+
+std::vector<std::string> asset_pack::validate(thread_pool& pool) const
+{
+    std::vector<char> ok(_entries.size(), 0);
+    pool.parallel_for(_entries.size(), [this, &ok](std::size_t i) {
+        auto const& e = _entries[i];
+        ok[i] = fnv1a(e.data, e.size) == e.checksum;
+    });
+
+    std::vector<std::string> failed;
+    for (std::size_t i = 0; i < _entries.size(); ++i) {
+        if (!ok[i]) {
+            failed.push_back(_entries[i].name);
+        }
+    }
+    return failed;
+}
+
+asset_pack::entry const* asset_pack::find(std::string const& name) const
+{
+    auto it = _index.find(name);
+    if (it == _index.end()
+        && name.compare(0, _base_prefix.size(), _base_prefix) == 0) {
+        it = _index.find(name.substr(_base_prefix.size()));
+    }
+    return it == _index.end() ? nullptr : &_entries[it->second];
+}
+
+sdl::surface asset_pack::make_surface(entry const& image) const
+{
+    if (image.type != asset_type::image_bgr24) {
+        throw std::runtime_error{"Not an image: "s + image.name};
+    }
+
+    // SDL wants a mutable pointer, but nothing writes to texture pixels
+    auto surf = sdl::make_surface(SDL_CreateRGBSurfaceWithFormatFrom(
+        const_cast<std::uint8_t*>(image.data), image.width, image.height, 24,
+        image.width * 3, SDL_PIXELFORMAT_BGR24));
+
+    if (SDL_SetColorKey(surf.get(), SDL_TRUE, purple_b8g8r8) != 0) {
+        SDL_Log("Couldn't set color key on: %s", image.name.c_str());
+    }
+
+    return surf;
+}
+
+void write_asset_pack(std::string const& output, std::string const& base_dir,
+    std::vector<std::string> const& names)
+{
+    struct pending {
+        std::string const& name;
+        asset_type type;
+        std::vector<std::uint8_t> data;
+        int width;
+        int height;
+    };
+
+    std::vector<pending> inputs;
+    for (auto const& name : names) {
+        auto const path = base_dir + "/" + name;
+        if (ends_with(name, ".bmp")) {
+            auto const surf = load_image(path);
+            std::vector<std::uint8_t> pixels(
+                static_cast<std::size_t>(surf->w) * surf->h * 3);
+            for (auto y = 0; y < surf->h; ++y) {
+                std::memcpy(pixels.data() + y * surf->w * 3,
+                    static_cast<std::uint8_t const*>(surf->pixels)
+                        + y * surf->pitch,
+                    surf->w * 3);
+            }
+            inputs.push_back(pending{name, asset_type::image_bgr24,
+                std::move(pixels), surf->w, surf->h});
+        } else {
+            inputs.push_back(
+                pending{name, asset_type::blob, read_file(path), 0, 0});
+        }
+    }
+
+    std::vector<std::uint8_t> out(
+        (header_words + entry_words * inputs.size()) * 4, 0);
+    std::memcpy(out.data(), magic, 4);
+    write_u32(out, 4, asset_pack_version);
+    write_u32(out, 8, static_cast<std::uint32_t>(inputs.size()));
+
+    for (std::size_t i = 0; i < inputs.size(); ++i) {
+        auto const& in = inputs[i];
+        auto const e = (header_words + entry_words * i) * 4;
+
+        auto const name_offset = out.size();
+        out.insert(out.end(), in.name.begin(), in.name.end());
+        // Keep data 4-byte aligned
+        out.resize((out.size() + 3) / 4 * 4, 0);
+        auto const data_offset = out.size();
+        out.insert(out.end(), in.data.begin(), in.data.end());
+        out.resize((out.size() + 3) / 4 * 4, 0);
+
+        write_u32(out, e, static_cast<std::uint32_t>(name_offset));
+        write_u32(out, e + 4, static_cast<std::uint32_t>(in.name.size()));
+        write_u32(out, e + 8, static_cast<std::uint32_t>(in.type));
+        write_u32(out, e + 12, static_cast<std::uint32_t>(data_offset));
+        write_u32(out, e + 16, static_cast<std::uint32_t>(in.data.size()));
+        write_u32(out, e + 20, fnv1a(in.data.data(), in.data.size()));
+        write_u32(out, e + 24, static_cast<std::uint32_t>(in.width));
+        write_u32(out, e + 28, static_cast<std::uint32_t>(in.height));
+    }
+
+    auto file = std::fopen(output.c_str(), "wb");
+    if (!file) {
+        throw std::runtime_error{"Couldn't open for writing: "s + output};
+    }
+    auto const written = std::fwrite(out.data(), 1, out.size(), file);
+    auto const closed = std::fclose(file) == 0;
+    if (written != out.size() || !closed) {
+        throw std::runtime_error{"Failed writing "s + output};
+    }
+}
+
+} // namespace sdl_app
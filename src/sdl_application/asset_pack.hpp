@@ -0,0 +1,91 @@
+/// @file asset_pack.hpp
+/// @brief Many assets in one memory-mapped file.
+///
+/// Layout (every field is 4 bytes, little-endian):
+///
+///     magic         "RCAP"
+///     version       asset_pack_version
+///     entry_count
+///     reserved      0
+///     entries       entry_count * {name offset, name size, type, data offset,
+///                                  data size, checksum, width, height}
+///     ...names and data...
+///
+/// Images are stored already converted to the engine's texture layout
+/// (BGR24, rows tightly packed, `width * 3` bytes each) so they can be used
+/// straight out of the mapping without decoding. Anything else (scripts,
+/// levels) is stored as-is. The checksum is FNV-1a over the data.
+
+#pragma once
+
+#include <sdl_application/mapped_file.hpp>
+#include <sdl_application/thread_pool.hpp>
+
+#include <sdl_raii/sdl_raii.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace sdl_app {
+
+constexpr std::uint32_t asset_pack_version = 1;
+
+enum class asset_type : std::uint32_t {
+    blob,
+    image_bgr24,
+};
+
+std::uint32_t fnv1a(std::uint8_t const* data, std::size_t size);
+
+class asset_pack {
+public:
+    struct entry {
+        std::string name;
+        asset_type type;
+        std::uint8_t const* data;
+        std::uint32_t size;
+        std::uint32_t checksum;
+        int width;
+        int height;
+    };
+
+    /// Map a pack. Entry names are relative to `base_dir`, which lets find()
+    /// accept paths that still include it (e.g. "../assets/levels/foo.lua").
+    ///
+    /// @throws std::runtime_error if the pack is missing or malformed
+    asset_pack(std::string const& path, std::string base_dir);
+
+    /// Verify every entry's checksum, spread across `pool`.
+    ///
+    /// @return The names of entries that failed; empty if all is well
+    std::vector<std::string> validate(thread_pool& pool) const;
+
+    /// @return nullptr if there's no such entry
+    entry const* find(std::string const& name) const;
+
+    std::vector<entry> const& entries() const { return _entries; }
+
+    /// Wrap an image entry in a surface that points into the mapping (no
+    /// copy). The pack must outlive the surface. Magenta is set as the color
+    /// key, like sdl_app::load_image.
+    sdl::surface make_surface(entry const& image) const;
+
+private:
+    mapped_file _file;
+    std::string _base_prefix;
+    std::vector<entry> _entries;
+    std::unordered_map<std::string, std::size_t> _index;
+};
+
+/// Write a pack of `names` (relative to `base_dir`) to `output`. Names ending
+/// in `.bmp` are converted to images, the rest are stored as blobs.
+///
+/// @throws std::runtime_error if an input can't be read or the output
+/// written
+void write_asset_pack(std::string const& output, std::string const& base_dir,
+    std::vector<std::string> const& names);
+
+} // namespace sdl_app
@@ -1,5 +1,7 @@
 #include "asset_store.hpp"
 
+#include "asset_pack.hpp"
+
 using namespace std::string_literals;
 
 namespace {
@@ -7,6 +9,10 @@ namespace {
 constexpr auto format_bmp_no_alpha = SDL_PIXELFORMAT_BGR24;
 constexpr auto purple_b8g8r8 = 0x00FF00FF;
 
+} // namespace
+
+namespace sdl_app {
+
 sdl::surface load_image(std::string const& path)
 {
     auto surf = sdl::make_surface(SDL_LoadBMP(path.c_str()));
@@ -25,10 +31,6 @@ sdl::surface load_image(std::string const& path)
     return surf;
 }
 
-} // namespace
-
-namespace sdl_app {
-
 asset_store::asset_store(std::string base_dir)
 : _base_dir{std::move(base_dir)}
 {
@@ -38,8 +40,14 @@ SDL_Surface* asset_store::get_asset(std::string const& path)
 {
     auto const full_path = _base_dir + "/" + path;
     if (_asset_map.find(full_path) == _asset_map.end()) {
-        SDL_Log("Loading asset: %s", full_path.c_str());
-        _asset_map[full_path] = load_image(full_path);
+        auto const packed = _pack ? _pack->find(path) : nullptr;
+        if (packed) {
+            SDL_Log("Loading packed asset: %s", path.c_str());
+            _asset_map[full_path] = _pack->make_surface(*packed);
+        } else {
+            SDL_Log("Loading asset: %s", full_path.c_str());
+            _asset_map[full_path] = load_image(full_path);
+        }
     } else {
         SDL_Log("Retrieving: %s. Don't do this in a loop, it is slow!",
             full_path.c_str());
@@ -48,4 +56,14 @@ SDL_Surface* asset_store::get_asset(std::string const& path)
     return _asset_map[full_path].get();
 }
 
+void asset_store::mount(std::shared_ptr<asset_pack const> pack)
+{
+    _pack = std::move(pack);
+}
+
+std::shared_ptr<asset_pack const> const& asset_store::get_pack() const
+{
+    return _pack;
+}
+
 } // namespace sdl_app
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory>
 #include <string>
 #include <unordered_map>
 
@@ -7,6 +8,14 @@
 
 namespace sdl_app {
 
+class asset_pack;
+
+/// Load a BGR24 BMP and set magenta as its color key.
+///
+/// @throws std::runtime_error if the image can't be loaded or is the wrong
+/// format
+sdl::surface load_image(std::string const& path);
+
 /// Manages asset lifetime.
 class asset_store {
 public:
@@ -14,11 +23,18 @@ public:
 
     SDL_Surface* get_asset(std::string const& path);
 
+    /// Look in `pack` before the asset directory from now on.
+    void mount(std::shared_ptr<asset_pack const> pack);
+
+    /// @return The mounted pack, or nullptr
+    std::shared_ptr<asset_pack const> const& get_pack() const;
+
 private:
     using asset_map = std::unordered_map<std::string, sdl::surface>;
 
     std::string _base_dir;
     asset_map _asset_map;
+    std::shared_ptr<asset_pack const> _pack;
 };
 
 } // namespace raycaster
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+
+namespace sdl_app {
+
+/// Durations counted in 1 ms buckets: bucket `i` counts durations from `i`
+/// to `i + 1` ms, and the last one everything longer.
+struct duration_histogram {
+    static constexpr auto bucket_count = 64;
+
+    std::array<unsigned, bucket_count> buckets{};
+    unsigned samples = 0;
+    double total_ms = 0.;
+    double worst_ms = 0.;
+
+    void add(double ms)
+    {
+        auto const bucket = std::min(
+            static_cast<int>(std::max(ms, 0.)), bucket_count - 1);
+        ++buckets[bucket];
+        ++samples;
+        total_ms += ms;
+        worst_ms = std::max(worst_ms, ms);
+    }
+
+    double average_ms() const { return samples > 0 ? total_ms / samples : 0.; }
+
+    /// @return The upper edge of the bucket that `fraction` of the samples
+    /// are in or under, e.g. 0.95 for the 95th percentile. 0 without samples.
+    double percentile_ms(double fraction) const
+    {
+        if (samples == 0) {
+            return 0.;
+        }
+        auto const wanted = fraction * samples;
+        unsigned below = 0;
+        for (auto i = 0; i < bucket_count - 1; ++i) {
+            below += buckets[i];
+            if (below >= wanted) {
+                return i + 1.;
+            }
+        }
+        return worst_ms;
+    }
+};
+
+} // namespace sdl_app
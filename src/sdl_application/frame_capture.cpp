@@ -0,0 +1,233 @@
+#include "frame_capture.hpp"
+
+#include <sdl_raii/sdl_raii.hpp>
+
+#include <cstring>
+#include <utility>
+
+namespace sdl_app {
+
+frame_capture::frame_capture(std::size_t pool_size)
+{
+    for (std::size_t i = 0; i < pool_size; ++i) {
+        _free_buffers.push_back(std::make_unique<frame>());
+    }
+
+    _writer = std::thread([this] { writer_main(); });
+}
+
+frame_capture::~frame_capture()
+{
+    stop_recording();
+
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        _stopping = true;
+    }
+    _wake_writer.notify_one();
+    _writer.join();
+}
+
+void frame_capture::request_screenshot(std::string filename)
+{
+    _pending_screenshot = std::move(filename);
+}
+
+void frame_capture::start_recording(std::string filename)
+{
+    if (is_recording()) {
+        stop_recording();
+    }
+    _recording_filename = std::move(filename);
+}
+
+void frame_capture::stop_recording()
+{
+    if (!is_recording()) {
+        return;
+    }
+
+    // Markers carry no pixels so they bypass the pool and are never dropped
+    auto marker = std::make_unique<frame>();
+    marker->type = job_type::end_of_stream;
+    marker->filename = std::move(_recording_filename);
+    _recording_filename.clear();
+    enqueue(std::move(marker));
+}
+
+bool frame_capture::is_recording() const
+{
+    return !_recording_filename.empty();
+}
+
+void frame_capture::capture(SDL_Surface const& framebuffer)
+{
+    if (!_pending_screenshot.empty()) {
+        auto buffer = acquire_buffer();
+        if (buffer) {
+            buffer->type = job_type::screenshot;
+            buffer->filename = std::move(_pending_screenshot);
+            _pending_screenshot.clear();
+            copy_framebuffer(framebuffer, *buffer);
+            enqueue(std::move(buffer));
+        }
+        // Otherwise keep the request pending and try again next frame
+    }
+
+    if (is_recording()) {
+        auto buffer = acquire_buffer();
+        if (!buffer) {
+            ++_dropped_frames;
+            return;
+        }
+        buffer->type = job_type::video_frame;
+        buffer->filename = _recording_filename;
+        copy_framebuffer(framebuffer, *buffer);
+        enqueue(std::move(buffer));
+    }
+}
+
+unsigned frame_capture::get_dropped_frames() const
+{
+    return _dropped_frames.load();
+}
+
+unsigned frame_capture::get_written_frames() const
+{
+    return _written_frames.load();
+}
+
+frame_capture::frame_ptr frame_capture::acquire_buffer()
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+    if (_free_buffers.empty()) {
+        return nullptr;
+    }
+    auto buffer = std::move(_free_buffers.back());
+    _free_buffers.pop_back();
+    return buffer;
+}
+
+void frame_capture::copy_framebuffer(
+    SDL_Surface const& framebuffer, frame& dest)
+{
+    // Strip the row padding so video frames are tightly packed
+    auto const row_bytes = framebuffer.w * framebuffer.format->BytesPerPixel;
+
+    dest.w = framebuffer.w;
+    dest.h = framebuffer.h;
+    dest.pitch = row_bytes;
+    dest.format = framebuffer.format->format;
+    // Buffers are reused, so this only allocates on the first capture (or
+    // after the framebuffer grows)
+    dest.pixels.resize(static_cast<std::size_t>(row_bytes) * framebuffer.h);
+
+    auto const src = static_cast<std::uint8_t const*>(framebuffer.pixels);
+    for (auto row = 0; row < framebuffer.h; ++row) {
+        std::memcpy(dest.pixels.data() + row * row_bytes,
+            src + row * framebuffer.pitch, row_bytes);
+    }
+}
+
+void frame_capture::enqueue(frame_ptr job)
+{
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        _queue.push_back(std::move(job));
+    }
+    _wake_writer.notify_one();
+}
+
+void frame_capture::writer_main()
+{
+    while (true) {
+        frame_ptr job;
+        {
+            std::unique_lock<std::mutex> lock{_mutex};
+            _wake_writer.wait(
+                lock, [this] { return _stopping || !_queue.empty(); });
+            if (_queue.empty()) {
+                // Only reachable when stopping with nothing left to write
+                break;
+            }
+            job = std::move(_queue.front());
+            _queue.pop_front();
+        }
+
+        write_job(*job);
+
+        if (job->type != job_type::end_of_stream) {
+            std::lock_guard<std::mutex> lock{_mutex};
+            _free_buffers.push_back(std::move(job));
+        }
+    }
+
+    if (_stream) {
+        std::fclose(_stream);
+        _stream = nullptr;
+    }
+}
+
+void frame_capture::write_job(frame& job)
+{
+    switch (job.type) {
+    case job_type::screenshot: {
+        auto const surf = SDL_CreateRGBSurfaceWithFormatFrom(job.pixels.data(),
+            job.w, job.h, SDL_BITSPERPIXEL(job.format), job.pitch, job.format);
+        if (!surf) {
+            SDL_Log("frame_capture: SDL_CreateRGBSurfaceWithFormatFrom "
+                    "failed: %s",
+                SDL_GetError());
+            return;
+        }
+        // Straight dump (note: gives undesired results if format includes
+        // alpha)
+        if (SDL_SaveBMP(surf, job.filename.c_str()) != 0) {
+            SDL_Log("frame_capture: SDL_SaveBMP failed: %s", SDL_GetError());
+        } else {
+            SDL_Log("saved screenshot to %s", job.filename.c_str());
+        }
+        SDL_FreeSurface(surf);
+        break;
+    }
+    case job_type::video_frame:
+        if (job.filename != _stream_filename) {
+            if (_stream) {
+                std::fclose(_stream);
+            }
+            _stream = std::fopen(job.filename.c_str(), "wb");
+            _stream_filename = job.filename;
+            if (!_stream) {
+                SDL_Log("frame_capture: couldn't open %s", job.filename.c_str());
+                return;
+            }
+            SDL_Log("recording %dx%d frames to %s (%u bytes per pixel)", job.w,
+                job.h, job.filename.c_str(), SDL_BYTESPERPIXEL(job.format));
+        }
+        if (!_stream) {
+            return;
+        }
+        if (std::fwrite(job.pixels.data(), 1, job.pixels.size(), _stream)
+            != job.pixels.size()) {
+            SDL_Log("frame_capture: short write to %s", job.filename.c_str());
+            return;
+        }
+        ++_written_frames;
+        break;
+    case job_type::end_of_stream:
+        // The name is kept even if it couldn't be opened, so every frame
+        // doesn't try again. Clear it regardless, so the next recording to
+        // the same file does.
+        if (job.filename == _stream_filename) {
+            if (_stream) {
+                std::fclose(_stream);
+                _stream = nullptr;
+                SDL_Log("finished recording %s", job.filename.c_str());
+            }
+            _stream_filename.clear();
+        }
+        break;
+    }
+}
+
+} // namespace sdl_app
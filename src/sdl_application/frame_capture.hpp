@@ -0,0 +1,96 @@
+#pragma once
+
+#include <SDL.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace sdl_app {
+
+/// Copies the framebuffer into pooled buffers and hands them to a background
+/// writer thread, so disk I/O never stalls the frame.
+///
+/// Screenshots are written as BMP. Recordings are written as one raw,
+/// uncompressed stream of tightly packed frames (no header), which ffmpeg
+/// can read with `-f rawvideo`.
+///
+/// Only a fixed number of buffers exist. If the writer falls behind while
+/// recording, new frames are dropped (and counted) instead of blocking.
+class frame_capture {
+public:
+    explicit frame_capture(std::size_t pool_size = 4);
+    ~frame_capture();
+
+    frame_capture(frame_capture const& other) = delete;
+    frame_capture(frame_capture&& other) = delete;
+    frame_capture& operator=(frame_capture const& other) = delete;
+    frame_capture& operator=(frame_capture&& other) = delete;
+
+    /// Save the next captured frame to `filename`.
+    void request_screenshot(std::string filename);
+
+    /// Start appending every captured frame to `filename`.
+    void start_recording(std::string filename);
+    void stop_recording();
+    bool is_recording() const;
+
+    /// Call once per frame with the finished framebuffer. Only copies pixels;
+    /// all encoding and writing happens on the writer thread.
+    void capture(SDL_Surface const& framebuffer);
+
+    unsigned get_dropped_frames() const;
+    unsigned get_written_frames() const;
+
+private:
+    enum class job_type {
+        screenshot,
+        video_frame,
+        end_of_stream,
+    };
+
+    struct frame {
+        job_type type;
+        std::string filename;
+        std::vector<std::uint8_t> pixels;
+        int w;
+        int h;
+        int pitch;
+        Uint32 format;
+    };
+
+    using frame_ptr = std::unique_ptr<frame>;
+
+    frame_ptr acquire_buffer();
+    void copy_framebuffer(SDL_Surface const& framebuffer, frame& dest);
+    void enqueue(frame_ptr job);
+    void writer_main();
+    void write_job(frame& job);
+
+    std::mutex _mutex;
+    std::condition_variable _wake_writer;
+    std::vector<frame_ptr> _free_buffers;
+    std::deque<frame_ptr> _queue;
+    bool _stopping = false;
+
+    std::string _pending_screenshot;
+    std::string _recording_filename;
+
+    std::atomic<unsigned> _dropped_frames{0u};
+    std::atomic<unsigned> _written_frames{0u};
+
+    // Only touched by the writer thread
+    std::FILE* _stream = nullptr;
+    std::string _stream_filename;
+
+    std::thread _writer;
+};
+
+} // namespace sdl_app
@@ -0,0 +1,119 @@
+#include <sdl_application/frame_pacer.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+using namespace std::chrono;
+
+namespace {
+
+using micros = duration<double, std::micro>;
+
+constexpr auto min_spin_margin = micros{200.};
+constexpr auto max_spin_margin = micros{8000.};
+/// The margin is this many times the latest oversleep...
+constexpr auto margin_headroom = 1.5;
+/// ...right away if that's wider, else it narrows by this fraction of the
+/// difference each frame, so one quick sleep doesn't make it too tight
+constexpr auto margin_decay = 0.02;
+
+} // namespace
+
+namespace sdl_app {
+
+void frame_pacer::set_mode(pacing_mode mode) { _mode = mode; }
+
+pacing_mode frame_pacer::get_mode() const { return _mode; }
+
+void frame_pacer::set_target_fps(double fps)
+{
+    if (fps <= 0.) {
+        throw std::invalid_argument{"The target frame rate must be positive"};
+    }
+    _target_fps = fps;
+}
+
+double frame_pacer::get_target_fps() const { return _target_fps; }
+
+double frame_pacer::get_frame_rate_cap() const
+{
+    switch (_mode) {
+    case pacing_mode::fixed:
+        return _target_fps;
+    case pacing_mode::power_saver:
+        return std::min(_target_fps, power_saver_fps);
+    default:
+        return 0.;
+    }
+}
+
+void frame_pacer::wait_for_next_frame()
+{
+    auto const now = clock::now();
+    if (_mode == pacing_mode::uncapped) {
+        // So switching to a capped mode starts counting from here
+        _deadline = now;
+        record_frame(now);
+        return;
+    }
+
+    auto const fps = get_frame_rate_cap();
+    if (_deadline == clock::time_point{}) {
+        _deadline = now;
+    }
+    _deadline += duration_cast<clock::duration>(duration<double>{1. / fps});
+
+    if (now >= _deadline) {
+        // Nothing to wait for. Count the next frame from now rather than
+        // rush the ones after to catch up.
+        ++_stats.missed_deadlines;
+        _deadline = now;
+    } else {
+        sleep_until(_deadline, _mode == pacing_mode::fixed);
+    }
+    record_frame(clock::now());
+}
+
+void frame_pacer::sleep_until(clock::time_point deadline, bool spin)
+{
+    auto const wake = spin ? deadline - _spin_margin : deadline;
+    if (wake > clock::now()) {
+        std::this_thread::sleep_until(wake);
+
+        if (spin) {
+            auto const oversleep = micros{clock::now() - wake};
+            auto const wanted = std::min(
+                std::max(oversleep * margin_headroom, min_spin_margin),
+                max_spin_margin);
+            auto margin = micros{_spin_margin};
+            margin = wanted > margin ? wanted
+                                     : margin - (margin - wanted) * margin_decay;
+            _spin_margin = duration_cast<clock::duration>(margin);
+        }
+    }
+
+    while (spin && clock::now() < deadline) {
+        std::this_thread::yield();
+    }
+}
+
+void frame_pacer::record_frame(clock::time_point now)
+{
+    if (_last_frame != clock::time_point{}) {
+        _stats.frame_times.add(
+            duration<double, std::milli>{now - _last_frame}.count());
+    }
+    _last_frame = now;
+}
+
+pacing_stats const& frame_pacer::get_stats() const { return _stats; }
+
+void frame_pacer::reset_stats() { _stats = pacing_stats{}; }
+
+double frame_pacer::get_spin_margin_ms() const
+{
+    return duration<double, std::milli>{_spin_margin}.count();
+}
+
+} // namespace sdl_app
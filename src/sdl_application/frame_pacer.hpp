@@ -0,0 +1,73 @@
+#pragma once
+
+#include <sdl_application/duration_histogram.hpp>
+
+#include <chrono>
+
+namespace sdl_app {
+
+enum class pacing_mode {
+    /// Start the next frame as soon as this one is presented
+    uncapped,
+    /// Present at `target_fps`, sleeping then spinning to hit each deadline
+    fixed,
+    /// At most `power_saver_fps`, and only ever sleeping. Frames may come a
+    /// little late, but the CPU idles in between.
+    power_saver,
+};
+
+struct pacing_stats {
+    /// From one presented frame to the next
+    duration_histogram frame_times;
+    /// Frames that weren't done by their deadline, so there was nothing to
+    /// wait for (not counted when uncapped)
+    unsigned missed_deadlines = 0;
+};
+
+/// Waits between frames so they're presented at a steady rate.
+///
+/// Sleeping alone isn't precise enough, e.g. SDL_Delay(1) on Linux can
+/// oversleep by several milliseconds. The pacer sleeps until a margin
+/// before the deadline, then spins. The margin follows how much sleeps
+/// have been overshooting lately, so it's only as wide as it needs to be.
+class frame_pacer {
+public:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr auto power_saver_fps = 30.;
+
+    void set_mode(pacing_mode mode);
+    pacing_mode get_mode() const;
+
+    /// Frame rate in fixed mode. Power saver mode uses this too if it's lower
+    /// than power_saver_fps.
+    ///
+    /// @throws std::invalid_argument if `fps` isn't positive
+    void set_target_fps(double fps);
+    double get_target_fps() const;
+    /// @return The frame rate the current mode aims for, 0 if uncapped
+    double get_frame_rate_cap() const;
+
+    /// Call once a frame has been presented. Waits until the next one is due
+    /// and counts the frame in the stats.
+    void wait_for_next_frame();
+
+    pacing_stats const& get_stats() const;
+    void reset_stats();
+
+    /// How long before a deadline sleeping stops and spinning starts
+    double get_spin_margin_ms() const;
+
+private:
+    void sleep_until(clock::time_point deadline, bool spin);
+    void record_frame(clock::time_point now);
+
+    pacing_mode _mode = pacing_mode::fixed;
+    double _target_fps = 60.;
+    clock::time_point _deadline{};
+    clock::time_point _last_frame{};
+    clock::duration _spin_margin = std::chrono::milliseconds{2};
+    pacing_stats _stats;
+};
+
+} // namespace sdl_app
@@ -4,6 +4,7 @@
 
 #include <SDL.h>
 
+#include <algorithm>
 #include <functional>
 
 using namespace mymath;
@@ -13,6 +14,18 @@ namespace sdl_app {
 void input_buffer::poll_events(
     std::function<void(SDL_Event const&)> unhandled_event)
 {
+    // Event timestamps are SDL_GetTicks() values, only to the millisecond.
+    // They're taken back from now, so the time an event waited in the queue
+    // counts.
+    auto const now = SDL_GetPerformanceCounter();
+    auto const now_ticks = SDL_GetTicks();
+    auto const counts_per_ms = SDL_GetPerformanceFrequency() / 1000;
+    auto const event_time = [&](SDL_KeyboardEvent const& key) {
+        // Signed, in case the event came in after now_ticks
+        auto const age = static_cast<Sint32>(now_ticks - key.timestamp);
+        return now - static_cast<Uint64>(std::max(age, 0)) * counts_per_ms;
+    };
+
     SDL_Event evt;
     while (SDL_PollEvent(&evt)) {
         switch (evt.type) {
@@ -21,9 +34,15 @@ void input_buffer::poll_events(
             break;
         case SDL_KEYDOWN:
             _key_pressed[evt.key.keysym.scancode] = true;
+            if (!evt.key.repeat) {
+                _key_events.push_back(
+                    {evt.key.keysym.scancode, event_time(evt.key)});
+            }
             break;
         case SDL_KEYUP:
             _key_pressed[evt.key.keysym.scancode] = false;
+            _key_events.push_back(
+                {evt.key.keysym.scancode, event_time(evt.key)});
             break;
         default:
             if (unhandled_event) {
@@ -55,4 +74,37 @@ point2i input_buffer::get_mouse_position() const
     return p;
 }
 
+input_buffer::key_state const& input_buffer::get_keys() const
+{
+    return _key_pressed;
+}
+
+void input_buffer::set_keys(key_state const& keys) { _key_pressed = keys; }
+
+void input_buffer::set_quit(bool quit) { _quit = quit; }
+
+void input_buffer::take_event_times(std::vector<Uint64>& times)
+{
+    for (auto const& event : _key_events) {
+        times.push_back(event.time);
+    }
+    _key_events.clear();
+}
+
+void input_buffer::take_event_times(
+    std::vector<Uint64>& times, std::initializer_list<SDL_Scancode> scancodes)
+{
+    auto const left = std::remove_if(_key_events.begin(), _key_events.end(),
+        [&](key_event const& event) {
+            auto const taken = std::find(scancodes.begin(), scancodes.end(),
+                                   event.scancode)
+                != scancodes.end();
+            if (taken) {
+                times.push_back(event.time);
+            }
+            return taken;
+        });
+    _key_events.erase(left, _key_events.end());
+}
+
 } // namespace sdl_app
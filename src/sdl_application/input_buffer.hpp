@@ -6,11 +6,15 @@
 
 #include <array>
 #include <functional>
+#include <initializer_list>
+#include <vector>
 
 namespace sdl_app {
 
 class input_buffer {
 public:
+    using key_state = std::array<bool, SDL_NUM_SCANCODES>;
+
     void poll_events(
         std::function<void(SDL_Event const&)> unhandled_event = {});
 
@@ -22,9 +26,30 @@ public:
 
     mymath::point2i get_mouse_position() const;
 
+    /// Every key's state, for recording and replaying input (see
+    /// input_recording.hpp)
+    key_state const& get_keys() const;
+    void set_keys(key_state const& keys);
+    void set_quit(bool quit);
+
+    /// Append when the key presses and releases polled since the last call
+    /// happened, as SDL_GetPerformanceCounter() values, oldest first. Key
+    /// repeats aren't included.
+    void take_event_times(std::vector<Uint64>& times);
+    /// Like take_event_times(), but only for `scancodes`. The others are
+    /// left for the next call.
+    void take_event_times(std::vector<Uint64>& times,
+        std::initializer_list<SDL_Scancode> scancodes);
+
 private:
-    std::array<bool, SDL_NUM_SCANCODES> _key_pressed{};
-    bool _quit;
+    struct key_event {
+        SDL_Scancode scancode;
+        Uint64 time;
+    };
+
+    std::vector<key_event> _key_events;
+    key_state _key_pressed{};
+    bool _quit = false;
 };
 
 } // namespace sdl_app
@@ -0,0 +1,194 @@
+#include <sdl_application/input_recording.hpp>
+
+#include <SDL.h>
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+using namespace std::string_literals;
+
+namespace {
+
+constexpr std::uint8_t magic[4] = {'R', 'C', 'I', 'N'};
+constexpr std::uint32_t version = 1;
+// magic, version, seed
+constexpr std::size_t header_size = 3 * sizeof(std::uint32_t);
+
+// Frame flags
+constexpr std::uint8_t frame_quit = 1 << 0;
+constexpr std::uint8_t frame_keys = 1 << 1;
+constexpr std::uint8_t frame_commands = 1 << 2;
+
+//
+// Little-endian, like the compiled levels
+//
+
+void put_u16(std::vector<std::uint8_t>& bytes, std::uint16_t u)
+{
+    bytes.push_back(static_cast<std::uint8_t>(u));
+    bytes.push_back(static_cast<std::uint8_t>(u >> 8));
+}
+
+void put_u32(std::vector<std::uint8_t>& bytes, std::uint32_t u)
+{
+    put_u16(bytes, static_cast<std::uint16_t>(u));
+    put_u16(bytes, static_cast<std::uint16_t>(u >> 16));
+}
+
+std::uint16_t read_u16(std::uint8_t const* p)
+{
+    return static_cast<std::uint16_t>(p[0] | p[1] << 8);
+}
+
+std::uint32_t read_u32(std::uint8_t const* p)
+{
+    return read_u16(p) | static_cast<std::uint32_t>(read_u16(p + 2)) << 16;
+}
+
+} // namespace
+
+namespace sdl_app {
+
+input_recorder::input_recorder(std::string const& path, std::uint32_t seed)
+: _seed{seed}
+{
+    _file = std::fopen(path.c_str(), "wb");
+    if (!_file) {
+        SDL_Log("Couldn't open %s for writing", path.c_str());
+        throw std::runtime_error{"Couldn't record input to "s + path};
+    }
+
+    std::vector<std::uint8_t> header{std::begin(magic), std::end(magic)};
+    put_u32(header, version);
+    put_u32(header, seed);
+    std::fwrite(header.data(), 1, header.size(), _file);
+}
+
+input_recorder::~input_recorder()
+{
+    if (_frames > 0) {
+        write_frame();
+    }
+    std::fclose(_file);
+}
+
+void input_recorder::record_frame(input_buffer const& input)
+{
+    if (_frames > 0) {
+        write_frame();
+    }
+    ++_frames;
+    _previous_keys = _keys;
+    _keys = input.get_keys();
+    _quit = input.is_quit();
+    _commands.clear();
+}
+
+void input_recorder::record_command(std::string const& command)
+{
+    _commands.push_back(command);
+}
+
+void input_recorder::write_frame()
+{
+    std::vector<std::uint16_t> changed;
+    for (std::size_t i = 0; i < _keys.size(); ++i) {
+        if (_keys[i] != _previous_keys[i]) {
+            changed.push_back(static_cast<std::uint16_t>(i));
+        }
+    }
+
+    std::vector<std::uint8_t> bytes;
+    bytes.push_back(static_cast<std::uint8_t>((_quit ? frame_quit : 0)
+        | (changed.empty() ? 0 : frame_keys)
+        | (_commands.empty() ? 0 : frame_commands)));
+    if (!changed.empty()) {
+        put_u16(bytes, static_cast<std::uint16_t>(changed.size()));
+        for (auto const scancode : changed) {
+            put_u16(bytes, scancode);
+        }
+    }
+    if (!_commands.empty()) {
+        put_u16(bytes, static_cast<std::uint16_t>(_commands.size()));
+        for (auto const& command : _commands) {
+            put_u32(bytes, static_cast<std::uint32_t>(command.size()));
+            bytes.insert(bytes.end(), command.begin(), command.end());
+        }
+    }
+
+    if (std::fwrite(bytes.data(), 1, bytes.size(), _file) != bytes.size()) {
+        SDL_Log("Failed to write recorded input");
+    }
+}
+
+input_player::input_player(std::string const& path)
+: _file{path}
+, _path{path}
+{
+    auto const data = _file.data();
+    if (_file.size() < header_size
+        || !std::equal(std::begin(magic), std::end(magic), data)) {
+        throw std::runtime_error{path + " isn't an input recording"};
+    }
+    if (read_u32(data + 4) != version) {
+        throw std::runtime_error{
+            path + " was recorded with a different version"};
+    }
+    _seed = read_u32(data + 8);
+    _offset = header_size;
+}
+
+bool input_player::is_finished() const { return _offset >= _file.size(); }
+
+std::vector<std::string> const& input_player::play_frame(input_buffer& input)
+{
+    auto const data = _file.data();
+    auto const size = _file.size();
+    auto const need = [&](std::size_t bytes) {
+        if (size - _offset < bytes) {
+            throw std::runtime_error{"Truncated input recording: " + _path};
+        }
+    };
+
+    need(1);
+    auto const flags = data[_offset++];
+
+    if (flags & frame_keys) {
+        need(2);
+        auto const count = read_u16(data + _offset);
+        _offset += 2;
+        need(2 * count);
+        for (auto i = 0; i < count; ++i) {
+            auto const scancode = read_u16(data + _offset);
+            _offset += 2;
+            if (scancode >= _keys.size()) {
+                throw std::runtime_error{"Corrupt input recording: " + _path};
+            }
+            _keys[scancode] = !_keys[scancode];
+        }
+    }
+
+    _commands.clear();
+    if (flags & frame_commands) {
+        need(2);
+        auto const count = read_u16(data + _offset);
+        _offset += 2;
+        for (auto i = 0; i < count; ++i) {
+            need(4);
+            auto const length = read_u32(data + _offset);
+            _offset += 4;
+            need(length);
+            _commands.emplace_back(
+                reinterpret_cast<char const*>(data + _offset), length);
+            _offset += length;
+        }
+    }
+
+    input.set_keys(_keys);
+    // Closing the window still works
+    input.set_quit(input.is_quit() || (flags & frame_quit));
+    return _commands;
+}
+
+} // namespace sdl_app
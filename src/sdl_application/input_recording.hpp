@@ -0,0 +1,83 @@
+#pragma once
+
+#include <sdl_application/input_buffer.hpp>
+#include <sdl_application/mapped_file.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace sdl_app {
+
+/// Records what an input_buffer held after polling each frame's events,
+/// along with the text commands the app ran during the frame and a random
+/// seed for the whole run, so input_player can drive the app through the
+/// same frames again.
+///
+/// The file is small: after a header, each frame is a flags byte, followed
+/// only by the keys that changed since the previous frame and the commands,
+/// if there are any. An idle frame is one byte.
+class input_recorder {
+public:
+    /// @throws std::runtime_error if `path` can't be written
+    input_recorder(std::string const& path, std::uint32_t seed);
+    /// Writes the last frame
+    ~input_recorder();
+
+    input_recorder(input_recorder const& other) = delete;
+    input_recorder(input_recorder&& other) = delete;
+    input_recorder& operator=(input_recorder const& other) = delete;
+    input_recorder& operator=(input_recorder&& other) = delete;
+
+    /// Start a new frame with the state `input` has right after polling.
+    /// Call before anything reads the input, e.g. with is_hit().
+    void record_frame(input_buffer const& input);
+
+    /// Add a command run during the current frame.
+    void record_command(std::string const& command);
+
+    std::uint32_t get_seed() const { return _seed; }
+    unsigned get_frames() const { return _frames; }
+
+private:
+    void write_frame();
+
+    std::FILE* _file = nullptr;
+    std::uint32_t const _seed;
+    unsigned _frames = 0;
+    input_buffer::key_state _previous_keys{};
+    input_buffer::key_state _keys{};
+    bool _quit = false;
+    std::vector<std::string> _commands;
+};
+
+/// Plays back a file written by input_recorder.
+class input_player {
+public:
+    /// @throws std::runtime_error if `path` can't be read or isn't a
+    /// recording
+    explicit input_player(std::string const& path);
+
+    std::uint32_t get_seed() const { return _seed; }
+    bool is_finished() const;
+
+    /// Overwrite `input`'s state with the next recorded frame's. Call where
+    /// input_recorder::record_frame() was called. The window can still be
+    /// closed while playing back.
+    ///
+    /// @throws std::runtime_error if the recording is truncated or corrupt
+    /// @return The commands run during the frame
+    std::vector<std::string> const& play_frame(input_buffer& input);
+
+private:
+    mapped_file _file;
+    std::string const _path;
+    std::uint32_t _seed = 0;
+    std::size_t _offset = 0;
+    input_buffer::key_state _keys{};
+    std::vector<std::string> _commands;
+};
+
+} // namespace sdl_app
@@ -0,0 +1,74 @@
+#include "mapped_file.hpp"
+
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SDL_APP_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#include <iterator>
+#endif
+
+using namespace std::string_literals;
+
+namespace sdl_app {
+
+#ifdef SDL_APP_HAS_MMAP
+
+mapped_file::mapped_file(std::string const& path)
+{
+    auto const fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error{"Couldn't open "s + path};
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        throw std::runtime_error{"Couldn't stat "s + path};
+    }
+    _size = static_cast<std::size_t>(info.st_size);
+
+    if (_size > 0) {
+        auto const addr = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error{"Couldn't mmap "s + path};
+        }
+        _data = static_cast<std::uint8_t const*>(addr);
+    }
+
+    // The mapping keeps its own reference to the file
+    close(fd);
+}
+
+mapped_file::~mapped_file()
+{
+    if (_data) {
+        munmap(const_cast<std::uint8_t*>(_data), _size);
+    }
+}
+
+#else
+
+mapped_file::mapped_file(std::string const& path)
+{
+    std::ifstream file{path, std::ios::binary};
+    if (!file) {
+        throw std::runtime_error{"Couldn't open "s + path};
+    }
+    _fallback.assign(std::istreambuf_iterator<char>{file},
+        std::istreambuf_iterator<char>{});
+    _data = _fallback.data();
+    _size = _fallback.size();
+}
+
+mapped_file::~mapped_file() = default;
+
+#endif
+
+} // namespace sdl_app
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace sdl_app {
+
+/// A read-only view of an entire file. On POSIX systems the file is
+/// memory-mapped so nothing is read until it's touched; elsewhere it falls
+/// back to reading the file into memory.
+class mapped_file {
+public:
+    /// @throws std::runtime_error if the file can't be opened or mapped
+    explicit mapped_file(std::string const& path);
+    ~mapped_file();
+
+    mapped_file(mapped_file const& other) = delete;
+    mapped_file(mapped_file&& other) = delete;
+    mapped_file& operator=(mapped_file const& other) = delete;
+    mapped_file& operator=(mapped_file&& other) = delete;
+
+    std::uint8_t const* data() const { return _data; }
+    std::size_t size() const { return _size; }
+
+private:
+    std::uint8_t const* _data = nullptr;
+    std::size_t _size = 0;
+    // Only used when mmap isn't available
+    std::vector<std::uint8_t> _fallback;
+};
+
+} // namespace sdl_app
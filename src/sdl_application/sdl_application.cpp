@@ -16,7 +16,8 @@ sdl_application::sdl_application(std::shared_ptr<sdl::sdl_init> sdl,
 , _input_buffer{std::move(input_buffer)}
 , _asset_store{std::move(assets)}
 {
-    _framebuffer = sdl::make_surface(SDL_GetWindowSurface(_window.get()));
+    _framebuffer = SDL_GetWindowSurface(_window.get());
+    SDL_CHECK(_framebuffer);
 }
 
 int sdl_application::exec()
@@ -27,16 +28,59 @@ int sdl_application::exec()
     }
 
     _running = true;
+    auto const frequency = SDL_GetPerformanceFrequency();
+    auto previous = SDL_GetPerformanceCounter();
+    // Time not simulated yet, in performance counter ticks
+    Uint64 accumulator = 0u;
     while (_running) {
         _input_buffer->poll_events(
-            [this](SDL_Event const& event) { unhandled_event(event); });
-        update();
-
+            [this](SDL_Event const& event) { handle_event(event); });
+
+        auto const now = SDL_GetPerformanceCounter();
+        auto const elapsed = now - previous;
+        previous = now;
+
+        if (_lockstep) {
+            update();
+            _input_buffer->take_event_times(_frame_event_times);
+            _tick_alpha = 1.f;
+            // One tick a frame, however long it took, so leaving lockstep
+            // doesn't owe any ticks
+            accumulator = 0u;
+        } else {
+            accumulator += elapsed;
+            auto const tick = static_cast<Uint64>(frequency / _tick_rate);
+            auto ticks = 0;
+            while (_running && accumulator >= tick
+                && ticks < max_catch_up_ticks) {
+                update();
+                _input_buffer->take_event_times(_frame_event_times);
+                accumulator -= tick;
+                ++ticks;
+            }
+            // Too far behind to catch up: let the game slow down rather than
+            // spend every frame simulating
+            if (accumulator >= tick) {
+                accumulator = tick - 1;
+            }
+            _tick_alpha = static_cast<float>(accumulator) / tick;
+        }
+        if (!_running) {
+            break;
+        }
+
+        if (_framebuffer_stale) {
+            reacquire_framebuffer();
+        }
         render();
-        SDL_CHECK(SDL_UpdateWindowSurface(_window.get()) == 0);
-
-        // Yield to OS, don't hog the CPU.
-        SDL_Delay(1);
+        // A resize in the middle of the frame (see latch_input()) leaves the
+        // surface just drawn invalid, in which case the frame is dropped
+        if (SDL_UpdateWindowSurface(_window.get()) != 0) {
+            SDL_CHECK(_framebuffer_stale);
+        }
+        record_input_latency();
+
+        _pacer.wait_for_next_frame();
     }
 
     return 0;
@@ -44,9 +88,71 @@ int sdl_application::exec()
 
 void sdl_application::quit() { _running = false; }
 
+frame_pacer& sdl_application::get_frame_pacer() { return _pacer; }
+
+duration_histogram const& sdl_application::get_input_latency() const
+{
+    return _input_latency;
+}
+
+void sdl_application::reset_input_latency()
+{
+    _input_latency = duration_histogram{};
+}
+
+void sdl_application::latch_input(std::initializer_list<SDL_Scancode> applied)
+{
+    _input_buffer->poll_events(
+        [this](SDL_Event const& event) { handle_event(event); });
+    _input_buffer->take_event_times(_frame_event_times, applied);
+}
+
+void sdl_application::handle_event(SDL_Event const& event)
+{
+    // SIZE_CHANGED comes after RESIZED, and also when the size was set from
+    // the code
+    if (event.type == SDL_WINDOWEVENT
+        && event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+        _framebuffer_stale = true;
+    }
+    unhandled_event(event);
+}
+
+void sdl_application::reacquire_framebuffer()
+{
+    _framebuffer = SDL_GetWindowSurface(_window.get());
+    SDL_CHECK(_framebuffer);
+    _framebuffer_stale = false;
+    framebuffer_changed(*_framebuffer);
+}
+
+void sdl_application::record_input_latency()
+{
+    auto const now = SDL_GetPerformanceCounter();
+    auto const counts_per_ms = SDL_GetPerformanceFrequency() / 1000.;
+    for (auto const time : _frame_event_times) {
+        _input_latency.add((now - time) / counts_per_ms);
+    }
+    _frame_event_times.clear();
+}
+
+void sdl_application::set_tick_rate(double ticks_per_second)
+{
+    if (ticks_per_second <= 0.) {
+        throw std::invalid_argument{"The tick rate must be positive"};
+    }
+    _tick_rate = ticks_per_second;
+}
+
+double sdl_application::get_tick_rate() const { return _tick_rate; }
+
+void sdl_application::set_lockstep(bool lockstep) { _lockstep = lockstep; }
+
+float sdl_application::get_tick_alpha() const { return _tick_alpha; }
+
 SDL_Window* sdl_application::get_window() { return _window.get(); }
 
-SDL_Surface* sdl_application::get_framebuffer() { return _framebuffer.get(); }
+SDL_Surface* sdl_application::get_framebuffer() { return _framebuffer; }
 
 input_buffer& sdl_application::get_input_buffer() { return *_input_buffer; }
 
@@ -1,18 +1,26 @@
 #pragma once
 
 #include <sdl_application/asset_store.hpp>
+#include <sdl_application/duration_histogram.hpp>
+#include <sdl_application/frame_capture.hpp>
+#include <sdl_application/frame_pacer.hpp>
 #include <sdl_application/input_buffer.hpp>
 #include <sdl_application/sdl_mymath.hpp>
 #include <sdl_application/surface_manipulation.hpp>
 
 #include <sdl_raii/sdl_raii.hpp>
 
+#include <initializer_list>
 #include <memory>
+#include <vector>
 
 namespace sdl_app {
 
 class sdl_application {
 public:
+    /// Most updates run in one frame, see set_tick_rate()
+    static constexpr auto max_catch_up_ticks = 5;
+
     explicit sdl_application(std::shared_ptr<sdl::sdl_init> sdl,
         sdl::window window, std::unique_ptr<input_buffer> input_buffer,
         std::unique_ptr<asset_store> assets);
@@ -26,24 +34,81 @@ public:
 
     void quit();
 
+    /// Paces presented frames, 60 per second by default
+    frame_pacer& get_frame_pacer();
+
+    /// Time from key presses and releases to the first frame presented
+    /// after an update() (or latch_input()) took them in
+    duration_histogram const& get_input_latency() const;
+    void reset_input_latency();
+
+    /// update() runs this many times per second of real time, however fast
+    /// frames are rendered. A frame runs as many updates as it takes to
+    /// catch up, up to max_catch_up_ticks; past that the game slows down.
+    ///
+    /// @throws std::invalid_argument if `ticks_per_second` isn't positive
+    void set_tick_rate(double ticks_per_second);
+    double get_tick_rate() const;
+
+    /// Run exactly one update() per frame, however long frames take, e.g.
+    /// to replay a recording frame by frame
+    void set_lockstep(bool lockstep);
+
 protected:
     virtual void unhandled_event(SDL_Event const& event) = 0;
+    /// Called once per tick (see set_tick_rate())
     virtual void update() = 0;
+    /// Called once per frame. Anything moving should be drawn
+    /// get_tick_alpha() of the way from where it was at the start of the
+    /// last update() to where it is now.
     virtual void render() = 0;
 
+    /// Called before the first render() after the window's surface changed,
+    /// e.g. when the window was resized, with the new one. Anything sized to
+    /// the framebuffer should be rebuilt here, rather than checked for every
+    /// frame.
+    virtual void framebuffer_changed(SDL_Surface& framebuffer) {}
+
+    /// @return How far into the next tick render() is, from 0 to 1
+    float get_tick_alpha() const;
+
+    /// Poll events in the middle of a frame, e.g. right before drawing, so
+    /// it can show the latest input.
+    ///
+    /// @param applied The keys whose presses and releases this frame shows.
+    /// Their latency counts to this frame; other keys' counts to the frame
+    /// after the next update().
+    void latch_input(std::initializer_list<SDL_Scancode> applied);
+
     SDL_Window* get_window();
+    /// The window's surface. Only valid until the next framebuffer_changed().
     SDL_Surface* get_framebuffer();
     input_buffer& get_input_buffer();
     asset_store& get_asset_store();
 
 private:
+    void handle_event(SDL_Event const& event);
+    /// Get the window's surface again after a resize.
+    void reacquire_framebuffer();
+    void record_input_latency();
+
     std::shared_ptr<sdl::sdl_init> _sdl;
     sdl::window _window;
-    sdl::surface _framebuffer;
+    /// Owned by the window
+    SDL_Surface* _framebuffer = nullptr;
+    /// The window was resized since `_framebuffer` was got
+    bool _framebuffer_stale = false;
     std::unique_ptr<input_buffer> _input_buffer;
     std::unique_ptr<asset_store> _asset_store;
 
     bool _running = false;
+    frame_pacer _pacer;
+    duration_histogram _input_latency;
+    /// When the input taken in so far this frame happened
+    std::vector<Uint64> _frame_event_times;
+    double _tick_rate = 60.;
+    bool _lockstep = false;
+    float _tick_alpha = 1.f;
 };
 
 } // namespace sdl_app
@@ -10,6 +10,13 @@ using namespace mymath;
 namespace {
 
 constexpr auto desired_bpp = 3;
+
+/// Formats that store a packed_color as is
+bool is_packed_format(Uint32 format)
+{
+    return format == SDL_PIXELFORMAT_ARGB8888
+        || format == SDL_PIXELFORMAT_RGB888;
+}
 constexpr auto desired_format = SDL_PIXELFORMAT_BGR24;
 
 bool is_surface_of_desired_format(
@@ -37,4 +44,38 @@ color get_surface_pixel(SDL_Surface* surf, point2i p)
     return color{pixel[2], pixel[1], pixel[0]};
 }
 
+packed_color get_packed_pixel(SDL_Surface* surf, point2f const& uv)
+{
+    auto const x = static_cast<int>(uv.x * surf->w);
+    auto const y = static_cast<int>(uv.y * surf->h);
+    // Assuming BGR24
+    auto const pixel = static_cast<Uint8 const*>(surf->pixels) + y * surf->pitch
+        + x * 3;
+    return {0xFF000000u | static_cast<Uint32>(pixel[2]) << 16
+        | static_cast<Uint32>(pixel[1]) << 8 | pixel[0]};
+}
+
+Uint32 to_pixel(packed_color c, SDL_PixelFormat const& format)
+{
+    if (is_packed_format(format.format)) {
+        return c.value;
+    }
+    auto const rgb = unpack(c);
+    return SDL_MapRGBA(&format, rgb.r, rgb.g, rgb.b, alpha(c));
+}
+
+packed_color from_pixel(Uint32 pixel, SDL_PixelFormat const& format)
+{
+    if (format.format == SDL_PIXELFORMAT_ARGB8888) {
+        return {pixel};
+    }
+    if (format.format == SDL_PIXELFORMAT_RGB888) {
+        // The X byte is undefined
+        return {pixel | 0xFF000000u};
+    }
+    Uint8 r, g, b, a;
+    SDL_GetRGBA(pixel, &format, &r, &g, &b, &a);
+    return pack(color{r, g, b}, a);
+}
+
 } // namespace sdl_app
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <mycolor/mycolor.hpp>
+#include <mycolor/packed_color.hpp>
 #include <mymath/mymath.hpp>
 
 #include <SDL.h>
@@ -13,4 +14,15 @@ mycolor::color get_surface_pixel(SDL_Surface* surf, mymath::point2f const& uv);
 /// Query an image pixel based on image coordinates.
 mycolor::color get_surface_pixel(SDL_Surface* surf, mymath::point2i p);
 
+/// Like get_surface_pixel(), but packed (with full alpha). Assumes BGR24.
+mycolor::packed_color get_packed_pixel(
+    SDL_Surface* surf, mymath::point2f const& uv);
+
+/// Convert a color to a pixel value in `format`. For ARGB8888 and RGB888 (the
+/// framebuffer formats the raycaster accepts) that's the packed value as is.
+Uint32 to_pixel(mycolor::packed_color c, SDL_PixelFormat const& format);
+
+/// Convert a pixel value in `format` to a color. The inverse of to_pixel().
+mycolor::packed_color from_pixel(Uint32 pixel, SDL_PixelFormat const& format);
+
 } // namespace sdl_app
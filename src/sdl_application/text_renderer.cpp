@@ -0,0 +1,157 @@
+#include <sdl_application/text_renderer.hpp>
+
+#include <sdl_application/surface_manipulation.hpp>
+
+#include <mycolor/packed_color.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using namespace mycolor;
+using namespace mymath;
+
+namespace {
+
+constexpr auto all_ones = ~Uint32{0};
+
+/// `dst[i] = mask[i] ? src[i] : dst[i]` for `count` pixels
+void masked_copy(
+    Uint32 const* src, Uint32 const* mask, Uint32* dst, int count)
+{
+    auto i = 0;
+#if defined(MYCOLOR_HAS_SSE2)
+    for (; i + 4 <= count; i += 4) {
+        auto const s
+            = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i));
+        auto const m
+            = _mm_loadu_si128(reinterpret_cast<__m128i const*>(mask + i));
+        auto const d
+            = _mm_loadu_si128(reinterpret_cast<__m128i const*>(dst + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+            _mm_or_si128(_mm_and_si128(s, m), _mm_andnot_si128(m, d)));
+    }
+#endif
+    for (; i < count; ++i) {
+        dst[i] = (src[i] & mask[i]) | (dst[i] & ~mask[i]);
+    }
+}
+
+/// Copy the opaque pixels of a `size` image, whose rows are `stride` pixels
+/// apart, to `pos` on `dest`, clipped to it.
+void blit_masked(Uint32 const* pixels, Uint32 const* masks, int stride,
+    extent2i size, point2i pos, SDL_Surface& dest)
+{
+    auto const first_x = std::max(0, -pos.x);
+    auto const first_y = std::max(0, -pos.y);
+    auto const end_x = std::min(size.w, dest.w - pos.x);
+    auto const end_y = std::min(size.h, dest.h - pos.y);
+    if (first_x >= end_x) {
+        return;
+    }
+
+    for (auto y = first_y; y < end_y; ++y) {
+        auto const row = reinterpret_cast<Uint32*>(
+            static_cast<Uint8*>(dest.pixels) + (pos.y + y) * dest.pitch);
+        auto const offset = y * stride + first_x;
+        masked_copy(pixels + offset, masks + offset, row + pos.x + first_x,
+            end_x - first_x);
+    }
+}
+
+} // namespace
+
+namespace sdl_app {
+
+text_renderer::text_renderer(
+    SDL_Surface* font, extent2i glyph_size, SDL_PixelFormat const& format)
+: _glyph_size{glyph_size}
+{
+    if (font->format->format != SDL_PIXELFORMAT_BGR24
+        || format.BytesPerPixel != 4) {
+        SDL_Log("The font must be BGR24, and drawn to a 32-bit surface");
+        throw std::runtime_error{"Unsupported font or surface format"};
+    }
+
+    _glyph_count = std::min(font->w / glyph_size.w, 256);
+    auto const glyph_pixels = glyph_size.w * glyph_size.h;
+    _pixels.resize(static_cast<std::size_t>(_glyph_count) * glyph_pixels);
+    _masks.resize(_pixels.size());
+
+    auto const transparent = pack(color{255, 0, 255});
+    for (auto glyph = 0; glyph < _glyph_count; ++glyph) {
+        for (auto y = 0; y < glyph_size.h && y < font->h; ++y) {
+            auto const row = static_cast<Uint8 const*>(font->pixels)
+                + y * font->pitch + glyph * glyph_size.w * 3;
+            for (auto x = 0; x < glyph_size.w; ++x) {
+                auto const texel = row + x * 3;
+                auto const c = pack(color{texel[2], texel[1], texel[0]});
+                auto const i = static_cast<std::size_t>(glyph) * glyph_pixels
+                    + y * glyph_size.w + x;
+                _pixels[i] = to_pixel(c, format);
+                _masks[i] = same_rgb(c, transparent) ? 0u : all_ones;
+            }
+        }
+    }
+}
+
+std::size_t text_renderer::glyph_offset(unsigned char c) const
+{
+    if (c >= _glyph_count) {
+        return no_glyph;
+    }
+    return static_cast<std::size_t>(c) * _glyph_size.w * _glyph_size.h;
+}
+
+void text_renderer::draw(char const* text, std::size_t length, point2i pos,
+    SDL_Surface& dest) const
+{
+    for (std::size_t i = 0; i < length; ++i, pos.x += _glyph_size.w) {
+        auto const offset = glyph_offset(static_cast<unsigned char>(text[i]));
+        if (offset != no_glyph) {
+            blit_masked(&_pixels[offset], &_masks[offset], _glyph_size.w,
+                _glyph_size, pos, dest);
+        }
+    }
+}
+
+void text_renderer::draw(
+    std::string const& text, point2i pos, SDL_Surface& dest) const
+{
+    draw(text.data(), text.size(), pos, dest);
+}
+
+void text_line::draw(text_renderer const& renderer, char const* text,
+    point2i pos, SDL_Surface& dest)
+{
+    auto const glyph = renderer.get_glyph_size();
+    auto const length = std::strlen(text);
+
+    if (_text.size() != length || _text.compare(text) != 0) {
+        _text.assign(text, length);
+        _width = static_cast<int>(length) * glyph.w;
+        _pixels.assign(static_cast<std::size_t>(_width) * glyph.h, 0u);
+        _masks.assign(_pixels.size(), 0u);
+
+        for (std::size_t i = 0; i < length; ++i) {
+            auto const offset
+                = renderer.glyph_offset(static_cast<unsigned char>(text[i]));
+            if (offset == text_renderer::no_glyph) {
+                continue;
+            }
+            for (auto y = 0; y < glyph.h; ++y) {
+                auto const from = offset + y * glyph.w;
+                auto const to = y * _width + i * glyph.w;
+                std::copy_n(&renderer._pixels[from], glyph.w, &_pixels[to]);
+                std::copy_n(&renderer._masks[from], glyph.w, &_masks[to]);
+            }
+        }
+    }
+
+    if (_width > 0) {
+        blit_masked(_pixels.data(), _masks.data(), _width,
+            extent2i{_width, glyph.h}, pos, dest);
+    }
+}
+
+} // namespace sdl_app
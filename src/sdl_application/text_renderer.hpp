@@ -0,0 +1,70 @@
+#pragma once
+
+#include <mymath/mymath.hpp>
+
+#include <SDL.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace sdl_app {
+
+/// Draws text in a fixed-size bitmap font straight into a 32-bit surface.
+///
+/// The glyphs are unpacked once, into pixels already in the surface's format
+/// and a mask of the opaque ones, so a row of a glyph is a masked copy
+/// instead of an SDL_BlitSurface() with a color key per character.
+class text_renderer {
+public:
+    /// @param font One row of glyphs of `glyph_size` each, from character 0.
+    /// BGR24, with magenta for transparent.
+    /// @param format The pixel format of the surfaces drawn to, which must
+    /// be 32 bits per pixel
+    text_renderer(SDL_Surface* font, mymath::extent2i glyph_size,
+        SDL_PixelFormat const& format);
+
+    mymath::extent2i get_glyph_size() const { return _glyph_size; }
+
+    /// Draw `length` characters of `text` with their top left corner at
+    /// `pos`, clipped to `dest`. Characters the font doesn't have are
+    /// skipped over.
+    void draw(char const* text, std::size_t length, mymath::point2i pos,
+        SDL_Surface& dest) const;
+    void draw(
+        std::string const& text, mymath::point2i pos, SDL_Surface& dest) const;
+
+private:
+    friend class text_line;
+
+    static constexpr auto no_glyph = ~std::size_t{0};
+
+    /// @return Where `c`'s glyph starts in `_pixels` and `_masks`, or
+    /// no_glyph if the font doesn't have it
+    std::size_t glyph_offset(unsigned char c) const;
+
+    mymath::extent2i _glyph_size;
+    int _glyph_count = 0;
+    /// Every glyph one after the other, each row by row
+    std::vector<Uint32> _pixels;
+    /// All ones where `_pixels` is opaque, all zeroes elsewhere
+    std::vector<Uint32> _masks;
+};
+
+/// A line of text that's rendered once and then copied every frame, until
+/// its text changes. Meant for text drawn every frame that rarely changes,
+/// like the HUD.
+class text_line {
+public:
+    /// Draw `text`, rendering it first if it's not what was drawn last time.
+    void draw(text_renderer const& renderer, char const* text,
+        mymath::point2i pos, SDL_Surface& dest);
+
+private:
+    std::string _text;
+    int _width = 0;
+    std::vector<Uint32> _pixels;
+    std::vector<Uint32> _masks;
+};
+
+} // namespace sdl_app
@@ -0,0 +1,120 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+namespace sdl_app {
+
+thread_pool::thread_pool(unsigned thread_count)
+{
+    if (thread_count == 0) {
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // The thread calling parallel_for also does work
+    for (unsigned i = 1; i < thread_count; ++i) {
+        _threads.emplace_back([this] { worker_main(); });
+    }
+}
+
+thread_pool::~thread_pool()
+{
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        _stopping = true;
+    }
+    _wake_workers.notify_all();
+    for (auto& thread : _threads) {
+        thread.join();
+    }
+}
+
+void thread_pool::parallel_for(
+    std::size_t count, std::function<void(std::size_t)> const& fn)
+{
+    if (count == 0) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> batch_lock{_batch_mutex};
+
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        _fn = &fn;
+        _count = count;
+        _next = 0;
+        _finished = 0;
+        _error = nullptr;
+        ++_generation;
+    }
+    _wake_workers.notify_all();
+
+    run_batch();
+
+    std::exception_ptr error;
+    {
+        std::unique_lock<std::mutex> lock{_mutex};
+        _batch_done.wait(lock, [this] { return _finished == _count; });
+        _fn = nullptr;
+        error = _error;
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+unsigned thread_pool::size() const
+{
+    return static_cast<unsigned>(_threads.size()) + 1;
+}
+
+void thread_pool::worker_main()
+{
+    auto seen_generation = 0u;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock{_mutex};
+            _wake_workers.wait(lock, [this, seen_generation] {
+                return _stopping || _generation != seen_generation;
+            });
+            if (_stopping) {
+                return;
+            }
+            seen_generation = _generation;
+        }
+
+        run_batch();
+    }
+}
+
+void thread_pool::run_batch()
+{
+    while (true) {
+        std::size_t index;
+        std::function<void(std::size_t)> const* fn;
+        {
+            std::lock_guard<std::mutex> lock{_mutex};
+            if (!_fn || _next >= _count) {
+                return;
+            }
+            index = _next++;
+            fn = _fn;
+        }
+
+        try {
+            (*fn)(index);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock{_mutex};
+            if (!_error) {
+                _error = std::current_exception();
+            }
+        }
+
+        std::lock_guard<std::mutex> lock{_mutex};
+        if (++_finished == _count) {
+            _batch_done.notify_all();
+        }
+    }
+}
+
+} // namespace sdl_app
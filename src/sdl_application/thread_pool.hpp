@@ -0,0 +1,59 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sdl_app {
+
+/// A fixed set of worker threads for splitting up batch work (decoding,
+/// validating, ...). Only one batch runs at a time.
+class thread_pool {
+public:
+    /// @param thread_count 0 means one per hardware thread
+    explicit thread_pool(unsigned thread_count = 0);
+    ~thread_pool();
+
+    thread_pool(thread_pool const& other) = delete;
+    thread_pool(thread_pool&& other) = delete;
+    thread_pool& operator=(thread_pool const& other) = delete;
+    thread_pool& operator=(thread_pool&& other) = delete;
+
+    /// Call `fn(i)` for every `i` in [0, count) across the pool (the calling
+    /// thread helps too) and wait for all of them to finish.
+    ///
+    /// If any call throws, the first exception is rethrown here once the
+    /// batch is done.
+    void parallel_for(
+        std::size_t count, std::function<void(std::size_t)> const& fn);
+
+    unsigned size() const;
+
+private:
+    void worker_main();
+    /// Pull indices from the current batch until it's exhausted.
+    void run_batch();
+
+    std::vector<std::thread> _threads;
+
+    /// Serializes parallel_for callers
+    std::mutex _batch_mutex;
+
+    /// Guards everything below
+    std::mutex _mutex;
+    std::condition_variable _wake_workers;
+    std::condition_variable _batch_done;
+    bool _stopping = false;
+    unsigned _generation = 0;
+    std::function<void(std::size_t)> const* _fn = nullptr;
+    std::size_t _count = 0;
+    std::size_t _next = 0;
+    std::size_t _finished = 0;
+    std::exception_ptr _error;
+};
+
+} // namespace sdl_app
@@ -0,0 +1,141 @@
+/// Flies a camera in a straight line across a procedurally generated world
+/// with world_streamer and reports what stayed resident. The world is
+/// generated chunk by chunk as the camera gets near, so it can be far bigger
+/// than would fit in memory; resident bytes should stay around the budget
+/// however far the camera goes.
+///
+/// Run from the repo root, so the textures can be found in `assets/`.
+
+#include <raycaster/level.hpp>
+#include <raycaster/texture_registry.hpp>
+#include <raycaster/world_streamer.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+
+using namespace mymath;
+using namespace raycaster;
+using namespace std::chrono_literals;
+
+namespace {
+
+constexpr auto chunk_size = 64;
+/// Fraction of tile edges that have a wall
+constexpr auto wall_density = 0.3f;
+constexpr auto sprite_density = 0.01f;
+
+/// A random maze on the tile edges of chunk `c`, the same every time.
+std::unique_ptr<level> generate_chunk(chunk_coord c)
+{
+    std::seed_seq seed{c.x, c.y};
+    std::mt19937 rng{seed};
+    std::uniform_real_distribution<float> chance{0.f, 1.f};
+
+    auto chunk = std::make_unique<level>();
+    chunk->texture_names = {"", "wall.bmp", "floor.bmp", "ceil.bmp",
+        "barrel.bmp"};
+    chunk->floor_texture = 2;
+    chunk->ceiling_texture = 3;
+
+    auto const x0 = static_cast<float>(c.x * chunk_size);
+    auto const y0 = static_cast<float>(c.y * chunk_size);
+    for (auto y = 0; y < chunk_size; ++y) {
+        for (auto x = 0; x < chunk_size; ++x) {
+            auto const fx = x0 + x;
+            auto const fy = y0 + y;
+            if (chance(rng) < wall_density) {
+                chunk->walls.push_back(
+                    make_wall({{fx, fy}, {fx, fy + 1.f}}, 1));
+            }
+            if (chance(rng) < wall_density) {
+                chunk->walls.push_back(
+                    make_wall({{fx, fy}, {fx + 1.f, fy}}, 1));
+            }
+            if (chance(rng) < sprite_density) {
+                chunk->sprites.spawn({fx + 0.5f, fy + 0.5f}, 4);
+            }
+        }
+    }
+
+    chunk->grid = build_wall_grid(chunk->walls);
+    return chunk;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    auto const distance = argc > 1 ? std::atoi(argv[1]) : 200;
+    auto const budget_mb = argc > 2 ? std::atof(argv[2]) : 16.;
+    auto const speed = argc > 3 ? std::atof(argv[3]) : 1.;
+    if (distance <= 0 || budget_mb < 0. || speed <= 0.) {
+        std::fprintf(stderr,
+            "Usage: %s [distance in chunks] [budget in MB] "
+            "[units per frame]\n",
+            argv[0]);
+        return 1;
+    }
+
+    texture_registry textures{"assets"};
+    world_options options;
+    options.chunk_size = static_cast<float>(chunk_size);
+    options.budget_bytes
+        = static_cast<std::size_t>(budget_mb * 1024 * 1024);
+    world_streamer world{textures, generate_chunk, options};
+
+    // Diagonally, so chunks come in on two sides
+    auto const step = vec2f{1.f, 1.f} * static_cast<float>(speed / 1.4142);
+    auto const frames = static_cast<int>(
+        distance * chunk_size * 1.4142 / speed);
+    auto position = point2f{0.5f, 0.5f};
+
+    std::size_t peak_bytes = 0;
+    std::size_t peak_chunks = 0;
+    auto views = 0;
+    auto frames_waiting = 0;
+    auto main_thread_time = 0.0;
+
+    auto const start = std::chrono::steady_clock::now();
+    for (auto frame = 0; frame < frames; ++frame) {
+        auto const frame_start = std::chrono::steady_clock::now();
+        world.update(position);
+        if (world.take_view()) {
+            ++views;
+        }
+        main_thread_time += std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - frame_start)
+                                .count();
+
+        auto const stats = world.get_stats();
+        peak_bytes = std::max(peak_bytes, stats.resident_bytes);
+        peak_chunks = std::max(peak_chunks, stats.resident_chunks);
+        if (stats.pending_chunks > 0) {
+            ++frames_waiting;
+        }
+
+        position = position + step;
+        // Stand-in for the rest of the frame
+        std::this_thread::sleep_for(1ms);
+    }
+    auto const elapsed = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start);
+
+    auto const stats = world.get_stats();
+    std::printf("%d chunks travelled in %d frames (%.1f s), budget %.1f MB\n",
+        distance, frames, elapsed.count(), budget_mb);
+    std::printf("loads %u, evictions %u, views stitched %d\n",
+        static_cast<unsigned>(stats.loads),
+        static_cast<unsigned>(stats.evictions), views);
+    std::printf("resident: peak %u chunks, %.2f MB; last view %.2f MB\n",
+        static_cast<unsigned>(peak_chunks), peak_bytes / (1024. * 1024.),
+        stats.view_bytes / (1024. * 1024.));
+    std::printf("%.1f%% of frames waiting on chunks, %.2f us/frame on the "
+                "main thread\n",
+        100. * frames_waiting / frames, main_thread_time / frames);
+
+    return 0;
+}